@@ -0,0 +1,142 @@
+"""
+Minimal SocketCAN Broadcast Manager (CAN_BCM) socket.
+
+The BCM runs cyclic TX and content/timeout filtered RX jobs inside the
+kernel; userspace only programs jobs and reads their notifications. Each
+message on the socket is a bcm_msg_head followed by `nframes` can_frames:
+
+  OPCODE(u32) FLAGS(u32) COUNT(u32) IVAL1(timeval) IVAL2(timeval)
+  CAN_ID(u32) NFRAMES(u32) [CAN_FRAME(16 bytes)]...
+
+The head uses native alignment (timeval is two longs), so the same code
+works on 32-bit Raspberry Pi OS and 64-bit kernels. Needs the can-bcm
+module (`sudo modprobe can-bcm`).
+"""
+
+import math
+import select
+import socket
+import struct
+from typing import List, NamedTuple, Optional, Sequence
+
+BCM_HEAD = struct.Struct("@3I4l2I0q")  # 0q pads to the 8-byte aligned frames
+CAN_FRAME = struct.Struct("=IB3x8s")
+MAX_NFRAMES = 256
+
+# Opcodes (linux/can/bcm.h)
+TX_SETUP = 1
+TX_DELETE = 2
+TX_READ = 3
+TX_SEND = 4
+RX_SETUP = 5
+RX_DELETE = 6
+RX_READ = 7
+TX_STATUS = 8
+TX_EXPIRED = 9
+RX_STATUS = 10
+RX_TIMEOUT = 11
+RX_CHANGED = 12
+
+# Flags
+SETTIMER = 0x0001
+STARTTIMER = 0x0002
+TX_COUNTEVT = 0x0004
+TX_ANNOUNCE = 0x0008
+TX_CP_CAN_ID = 0x0010
+RX_FILTER_ID = 0x0020
+RX_CHECK_DLC = 0x0040
+RX_NO_AUTOTIMER = 0x0080
+RX_ANNOUNCE_RESUME = 0x0100
+TX_RESET_MULTI_IDX = 0x0200
+
+
+class BcmFrame(NamedTuple):
+    can_id: int
+    data: bytes
+
+
+class BcmMessage(NamedTuple):
+    opcode: int
+    flags: int
+    count: int
+    can_id: int
+    frames: List[BcmFrame]
+
+
+def _timeval(seconds: float) -> tuple:
+    usec = int(round(seconds * 1e6))
+    return usec // 1000000, usec % 1000000
+
+
+def pack(opcode: int, can_id: int, frames: Sequence[BcmFrame] = (), flags: int = 0,
+         count: int = 0, ival1: float = 0.0, ival2: float = 0.0) -> bytes:
+    if len(frames) > MAX_NFRAMES:
+        raise ValueError(f"at most {MAX_NFRAMES} frames per BCM job")
+    out = bytearray(BCM_HEAD.pack(opcode, flags, count, *_timeval(ival1), *_timeval(ival2),
+                                  can_id, len(frames)))
+    for frame in frames:
+        data = bytes(frame.data)
+        out += CAN_FRAME.pack(frame.can_id, len(data), data.ljust(8, b"\0"))
+    return bytes(out)
+
+
+def unpack(buf: bytes) -> BcmMessage:
+    opcode, flags, count, _s1, _u1, _s2, _u2, can_id, nframes = BCM_HEAD.unpack_from(buf)
+    frames = []
+    for i in range(nframes):
+        fid, dlc, data = CAN_FRAME.unpack_from(buf, BCM_HEAD.size + i * CAN_FRAME.size)
+        frames.append(BcmFrame(fid, data[:min(dlc, 8)]))
+    return BcmMessage(opcode, flags, count, can_id, frames)
+
+
+class BcmSocket:
+    def __init__(self, channel: str):
+        self.sock = socket.socket(socket.AF_CAN, socket.SOCK_DGRAM, socket.CAN_BCM)
+        try:
+            self.sock.connect((channel,))
+        except OSError:
+            self.sock.close()
+            raise
+
+    def fileno(self) -> int:
+        return self.sock.fileno()
+
+    def close(self) -> None:
+        self.sock.close()
+
+    def rx_setup(self, can_id: int, timeout: float, mask: Optional[bytes] = None,
+                 throttle: float = 0.0, flags: int = 0) -> None:
+        """Watches can_id: RX_TIMEOUT after `timeout` s of silence and, with a
+        mask, RX_CHANGED only when masked payload bits (or the DLC) change."""
+        flags |= SETTIMER | STARTTIMER
+        frames: List[BcmFrame] = []
+        if mask is None:
+            flags |= RX_FILTER_ID  # every frame is a change
+        else:
+            flags |= RX_CHECK_DLC
+            frames.append(BcmFrame(0, mask))
+        self.sock.send(pack(RX_SETUP, can_id, frames, flags, ival1=timeout, ival2=throttle))
+
+    def rx_delete(self, can_id: int) -> None:
+        self.sock.send(pack(RX_DELETE, can_id))
+
+    def tx_setup(self, can_id: int, frames: Sequence[BcmFrame], interval: float,
+                 count: int = 0, first_interval: float = 0.0, flags: int = 0) -> None:
+        """Cycles through `frames`, one per timer tick: `count` ticks every
+        `first_interval` s, then every `interval` s until deleted (0: never)."""
+        flags |= SETTIMER | STARTTIMER
+        if count:
+            flags |= TX_COUNTEVT
+        self.sock.send(pack(TX_SETUP, can_id, frames, flags, count, first_interval, interval))
+
+    def tx_delete(self, can_id: int) -> None:
+        self.sock.send(pack(TX_DELETE, can_id))
+
+    def recv(self, timeout: float = 0.0) -> Optional[BcmMessage]:
+        """Next notification, or None if none arrives within timeout seconds."""
+        if not math.isinf(timeout):
+            ready, _, _ = select.select([self.sock], [], [], max(timeout, 0.0))
+            if not ready:
+                return None
+        buf = self.sock.recv(BCM_HEAD.size + MAX_NFRAMES * CAN_FRAME.size)
+        return unpack(buf)
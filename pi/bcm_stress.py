@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""
+Bus stress from the Pi: kernel BCM cyclic TX vs. Python send() loop.
+
+bcm   programs one BCM TX_SETUP job that cycles through 256 frames carrying
+      make_pattern(0..255) (the ping-pong pattern, counter-sequenced) and
+      lets the kernel send one every 1/--rate s; Python just sleeps.
+user  calls bus.send() back to back from Python, retrying on ENOBUFS.
+
+The achieved rate comes from the interface's tx_packets counter (frames that
+actually made it onto the wire), so measuring costs nothing. CPU is reported
+for this process (user+sys, % of one core) and for the whole machine from
+/proc/stat, since BCM timers and softirqs are not charged to the process.
+
+Usage:
+  python3 pi/bcm_stress.py --mode both --seconds 10
+  python3 pi/bcm_stress.py --mode bcm --rate 800 --id 0x7C0
+"""
+
+import argparse
+import os
+import statistics
+import sys
+import time
+from typing import Dict, List, NamedTuple
+
+import can
+
+from bcm import BcmFrame, BcmSocket
+from burst_test import frame_bits
+from can_ping_pong import make_pattern
+
+STRESS_ID = 0x7C0  # STRESS_ID in src/main.cpp: counted but not logged by the ESP node
+
+
+class Sample(NamedTuple):
+    wall: float
+    proc_cpu: float
+    sys_busy: int
+    sys_total: int
+    tx_packets: int
+    tx_dropped: int
+
+
+def _net_stat(channel: str, name: str) -> int:
+    try:
+        with open(f"/sys/class/net/{channel}/statistics/{name}") as fp:
+            return int(fp.read())
+    except OSError:
+        return 0
+
+
+def _proc_stat() -> List[int]:
+    with open("/proc/stat") as fp:
+        fields = fp.readline().split()[1:]
+    return [int(v) for v in fields]
+
+
+def sample(channel: str) -> Sample:
+    cpu = _proc_stat()
+    idle = cpu[3] + (cpu[4] if len(cpu) > 4 else 0)  # idle + iowait
+    times = os.times()
+    return Sample(time.monotonic(), times.user + times.system, sum(cpu) - idle, sum(cpu),
+                  _net_stat(channel, "tx_packets"), _net_stat(channel, "tx_dropped"))
+
+
+def report(mode: str, start: Sample, end: Sample, frame_us: float, extra: Dict[str, str]) -> None:
+    wall = end.wall - start.wall
+    fps = (end.tx_packets - start.tx_packets) / wall
+    line_fps = 1e6 / frame_us
+    proc_cpu = (end.proc_cpu - start.proc_cpu) / wall * 100
+    total = end.sys_total - start.sys_total
+    sys_cpu = (end.sys_busy - start.sys_busy) / total * 100 if total else 0.0
+    fields = " ".join(f"{k}={v}" for k, v in extra.items())
+    print(f"STRESS mode={mode} seconds={wall:.1f} tx_fps={fps:.0f} "
+          f"line_rate={fps / line_fps * 100:.1f}% tx_dropped={end.tx_dropped - start.tx_dropped} "
+          f"cpu_proc={proc_cpu:.1f}% cpu_sys={sys_cpu:.1f}% {fields}".rstrip())
+
+
+def run_bcm(args: argparse.Namespace, frame_us: float) -> None:
+    bcm = BcmSocket(args.channel)
+    frames = [BcmFrame(args.id, make_pattern(i)) for i in range(256)]
+    interval = 1.0 / args.rate
+    start = sample(args.channel)
+    bcm.tx_setup(args.id, frames, interval)
+    try:
+        time.sleep(args.seconds)
+    finally:
+        bcm.tx_delete(args.id)
+        end = sample(args.channel)
+        bcm.close()
+    report("bcm", start, end, frame_us, {"target_fps": f"{args.rate:.0f}"})
+
+
+def run_user(args: argparse.Namespace, frame_us: float) -> None:
+    bus = can.Bus(interface="socketcan", channel=args.channel)
+    messages = [can.Message(arbitration_id=args.id, is_extended_id=False, data=make_pattern(i))
+                for i in range(256)]
+    sent = retries = 0
+    start = sample(args.channel)
+    deadline = start.wall + args.seconds
+    try:
+        while time.monotonic() < deadline:
+            try:
+                bus.send(messages[sent & 0xFF])
+                sent += 1
+            except can.CanError:
+                retries += 1  # TX queue full (ENOBUFS)
+                time.sleep(0.0002)
+    finally:
+        end = sample(args.channel)
+        bus.shutdown()
+    report("user", start, end, frame_us, {"send_calls": str(sent), "enobufs": str(retries)})
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="BCM vs. userspace CAN TX stress")
+    parser.add_argument("--channel", default="can0")
+    parser.add_argument("--bitrate", type=int, default=125000)
+    parser.add_argument("--mode", choices=("bcm", "user", "both"), default="both")
+    parser.add_argument("--seconds", type=float, default=10.0)
+    parser.add_argument("--rate", type=float, default=0.0,
+                        help="BCM frames/s (default: theoretical line rate)")
+    parser.add_argument("--id", type=lambda v: int(v, 0), default=STRESS_ID)
+    args = parser.parse_args()
+
+    if not 0 <= args.id <= 0x7FF:
+        sys.exit("--id must be a standard 11-bit identifier")
+
+    mean_bits = statistics.mean(frame_bits(args.id, make_pattern(i)) for i in range(256))
+    frame_us = mean_bits * 1e6 / args.bitrate
+    if args.rate <= 0:
+        args.rate = 1e6 / frame_us
+    print(f"id=0x{args.id:X} bitrate={args.bitrate} mean_frame_us={frame_us:.1f} "
+          f"line_rate_fps={1e6 / frame_us:.0f}")
+
+    try:
+        if args.mode in ("bcm", "both"):
+            try:
+                run_bcm(args, frame_us)
+            except OSError as exc:
+                print(f"BCM unavailable ({exc}); try 'sudo modprobe can-bcm'")
+        if args.mode in ("user", "both"):
+            if args.mode == "both":
+                time.sleep(1.0)  # let the TX queue drain between runs
+            run_user(args, frame_us)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
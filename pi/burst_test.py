@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""
+TX burst pacing test: how close together can frames go on the wire?
+
+Sends bursts of N frames (ID 0x7B0, payload BURST SEQ_LO SEQ_HI ...) with
+one of three pacing modes:
+
+  none    hand frames to the kernel as fast as send() returns
+  gap     busy-wait a fixed --gap-us between send() calls
+  bucket  token bucket: --rate frames/s sustained, --bucket-size frames of burst
+
+Achieved spacing is measured twice:
+  - Pi side from the kernel timestamps of our own TX echo (receive_own_messages)
+  - ESP side from the MCP2515 INT edge timestamps; the node answers each burst
+    with a 0x7B1 report: FRAMES MIN_GAP_US AVG_GAP_US MAX_GAP_US (u16 LE each)
+
+Both are compared with the theoretical minimum spacing at the bitrate: the
+exact stuffed length of each frame plus the 3-bit interframe space.
+
+Usage:
+  python3 pi/burst_test.py --count 200 --bursts 5 --pacing none
+  python3 pi/burst_test.py --pacing bucket --rate 2000 --bucket-size 16
+"""
+
+import argparse
+import statistics
+import struct
+import sys
+import time
+from typing import List, Optional, Tuple
+
+import can
+
+BURST_DATA_ID = 0x7B0    # Pi -> ESP
+BURST_REPORT_ID = 0x7B1  # ESP -> Pi
+REPORT = struct.Struct("<4H")
+
+REPORT_TIMEOUT_SEC = 2.0
+ECHO_TIMEOUT_SEC = 1.0
+
+
+def _bits(value: int, width: int) -> List[int]:
+    return [(value >> (width - 1 - i)) & 1 for i in range(width)]
+
+
+def _crc15(bits: List[int]) -> int:
+    crc = 0
+    for b in bits:
+        nxt = b ^ ((crc >> 14) & 1)
+        crc = (crc << 1) & 0x7FFF
+        if nxt:
+            crc ^= 0x4599
+    return crc
+
+
+def frame_bits(can_id: int, data: bytes, extended: bool = False) -> int:
+    """Exact on-wire length of a classic data frame, including IFS."""
+    dlc = len(data)
+    if extended:
+        head = ([0] + _bits(can_id >> 18, 11) + [1, 1] + _bits(can_id & 0x3FFFF, 18) +
+                [0, 0, 0])  # SOF, base ID, SRR, IDE, ext ID, RTR, r1, r0
+    else:
+        head = [0] + _bits(can_id, 11) + [0, 0, 0]  # SOF, ID, RTR, IDE, r0
+    stuffed = head + _bits(dlc, 4)
+    for byte in data:
+        stuffed += _bits(byte, 8)
+    stuffed += _bits(_crc15(stuffed), 15)
+
+    # Bit stuffing: after five equal bits a complement bit is inserted, and
+    # the stuff bit counts towards the next run.
+    stuff = 0
+    run_bit, run_len = stuffed[0], 1
+    for b in stuffed[1:]:
+        if b == run_bit:
+            run_len += 1
+            if run_len == 5:
+                stuff += 1
+                run_bit, run_len = 1 - b, 1
+        else:
+            run_bit, run_len = b, 1
+
+    # CRC delimiter, ACK slot + delimiter, EOF(7), IFS(3)
+    return len(stuffed) + stuff + 1 + 2 + 7 + 3
+
+
+def make_payload(burst: int, seq: int, dlc: int) -> bytes:
+    head = bytes([burst & 0xFF, seq & 0xFF, (seq >> 8) & 0xFF])
+    return (head + bytes((seq * 37 + i) & 0xFF for i in range(3, 8)))[:dlc]
+
+
+def busy_wait_until(deadline: float) -> None:
+    while time.perf_counter() < deadline:
+        pass
+
+
+class BurstTest:
+    def __init__(self, args: argparse.Namespace):
+        self.args = args
+        self.bus = can.Bus(interface="socketcan", channel=args.channel,
+                           receive_own_messages=True)
+
+    def _send_burst(self, burst: int) -> List[can.Message]:
+        a = self.args
+        messages = [can.Message(arbitration_id=BURST_DATA_ID, is_extended_id=False,
+                                data=make_payload(burst, seq, a.dlc))
+                    for seq in range(a.count)]
+
+        tokens = float(a.bucket_size)
+        last = time.perf_counter()
+        next_at = last
+        for msg in messages:
+            if a.pacing == "gap":
+                busy_wait_until(next_at)
+                next_at = time.perf_counter() + a.gap_us / 1e6
+            elif a.pacing == "bucket":
+                now = time.perf_counter()
+                tokens = min(a.bucket_size, tokens + (now - last) * a.rate)
+                last = now
+                if tokens < 1.0:
+                    busy_wait_until(now + (1.0 - tokens) / a.rate)
+                    tokens, last = 1.0, time.perf_counter()
+                tokens -= 1.0
+
+            while True:
+                try:
+                    self.bus.send(msg)
+                    break
+                except can.CanError:
+                    # TX queue full (ENOBUFS): the bus is the bottleneck, retry.
+                    time.sleep(0.0002)
+        return messages
+
+    def _collect(self, burst: int) -> Tuple[List[float], Optional[tuple]]:
+        """Returns kernel TX echo timestamps and the ESP report, if any."""
+        echoes: List[float] = []
+        report = None
+        deadline = time.monotonic() + ECHO_TIMEOUT_SEC
+        while time.monotonic() < deadline:
+            msg = self.bus.recv(timeout=0.05)
+            if msg is None:
+                continue
+            if msg.arbitration_id == BURST_DATA_ID and msg.data and msg.data[0] == burst:
+                echoes.append(msg.timestamp)
+                if len(echoes) == self.args.count:
+                    deadline = time.monotonic() + REPORT_TIMEOUT_SEC
+            elif msg.arbitration_id == BURST_REPORT_ID and len(msg.data) >= REPORT.size:
+                report = REPORT.unpack_from(bytes(msg.data))
+                if len(echoes) == self.args.count:
+                    break
+        return echoes, report
+
+    def run(self) -> None:
+        a = self.args
+        bit_us = 1e6 / a.bitrate
+        sample = make_payload(0, 0, a.dlc)
+        min_bits = [frame_bits(BURST_DATA_ID, make_payload(0, s, a.dlc)) for s in range(a.count)]
+        min_gap_us = statistics.mean(min_bits) * bit_us
+        print(f"pacing={a.pacing} count={a.count} dlc={len(sample)} bitrate={a.bitrate} "
+              f"min_frame_bits={min(min_bits)}..{max(min_bits)} "
+              f"theoretical_gap_us={min_gap_us:.1f}")
+
+        for burst in range(a.bursts):
+            t0 = time.perf_counter()
+            self._send_burst(burst)
+            send_us = (time.perf_counter() - t0) * 1e6
+            echoes, report = self._collect(burst)
+
+            line = f"BURST {burst} sent={a.count} send_call_us={send_us:.0f} echoed={len(echoes)}"
+            if len(echoes) > 1:
+                gaps = [(b - e) * 1e6 for e, b in zip(echoes, echoes[1:])]
+                avg = (echoes[-1] - echoes[0]) * 1e6 / (len(echoes) - 1)
+                line += (f" pi_gap_us min={min(gaps):.0f} avg={avg:.1f} max={max(gaps):.0f}"
+                         f" efficiency={min_gap_us / avg * 100:.1f}%")
+            if report is not None:
+                frames, rmin, ravg, rmax = report
+                line += f" | esp frames={frames} gap_us min={rmin} avg={ravg} max={rmax}"
+                if ravg:
+                    line += f" efficiency={min_gap_us / ravg * 100:.1f}%"
+            else:
+                line += " | esp report missing"
+            print(line)
+            time.sleep(a.pause)
+
+        self.bus.shutdown()
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="CAN TX burst pacing test")
+    parser.add_argument("--channel", default="can0")
+    parser.add_argument("--bitrate", type=int, default=125000)
+    parser.add_argument("--count", type=int, default=100, help="frames per burst")
+    parser.add_argument("--bursts", type=int, default=5)
+    parser.add_argument("--dlc", type=int, default=8, choices=range(3, 9))
+    parser.add_argument("--pacing", choices=("none", "gap", "bucket"), default="none")
+    parser.add_argument("--gap-us", type=float, default=1000.0, help="gap pacing interval")
+    parser.add_argument("--rate", type=float, default=1000.0, help="bucket refill, frames/s")
+    parser.add_argument("--bucket-size", type=int, default=8, help="bucket depth, frames")
+    parser.add_argument("--pause", type=float, default=0.5, help="seconds between bursts")
+    args = parser.parse_args()
+
+    if args.count > 0xFFFF or args.count < 2:
+        sys.exit("--count must be 2..65535")
+    try:
+        BurstTest(args).run()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
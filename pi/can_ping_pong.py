@@ -6,25 +6,64 @@ Behavior:
 1) Responds to ESP-initiated PING (0x123) with PONG (0x124) and prints MATCHED.
 2) Sends its own PING (0x223) every second, expects PONG (0x224) from ESP,
    and prints MATCHED when payload echoes exactly.
+3) Watches the ESP's periodic IDs with kernel BCM RX_SETUP jobs and prints
+   DROPOUT/RESUMED when either goes silent for --dropout-timeout seconds.
+
+Socket receive-queue drops (SO_RXQ_OVFL) are counted separately from bus
+loss: a Pi ping whose PONG went missing while the socket was dropping frames
+is a software loss, otherwise a bus loss. --rcvbuf sizes the queue.
+
+With --kernel-reflector the ESP PING -> PONG echo is a cangw rule instead
+(ID rewrite in the kernel, see pi/cangw.py); Python only observes it.
 
 Requirements:
 - SocketCAN interface up (e.g., `can0` via mcp2515 overlay, 125000 bit/s).
 - python-can installed (`sudo apt install -y python3-can`).
 """
 
+import argparse
+import select
 import signal
+import socket
+import struct
 import sys
 import time
-from typing import Optional
+from typing import BinaryIO, Dict, Optional
 
 import can
 
+from bcm import RX_ANNOUNCE_RESUME, RX_CHANGED, RX_TIMEOUT, BcmSocket
+from cangw import ReflectorRule
+from histogram import SERIES_PI_RTT, LatencyHistogram
+from link_quality import LinkQuality
+from soak import SoakMonitor
+from telemetry import RECORD_FILE_HEADER, RECORD_FILE_MAGIC, TYPE_HISTOGRAM
+
 ESP_PING_ID = 0x123  # ESP -> Pi
 ESP_PONG_ID = 0x124  # Pi -> ESP
 PI_PING_ID = 0x223   # Pi -> ESP
 PI_PONG_ID = 0x224   # ESP -> Pi
 
 PING_PERIOD_SEC = 1.0
+HEALTH_SAMPLE_SEC = 0.2   # same cadence as the ESP health check
+REPORT_PERIOD_SEC = 10.0
+DROPOUT_TIMEOUT_SEC = 2.5  # silence on a 1 Hz ESP ID before it counts as a dropout
+
+# Socket-level receive diagnostics (asm-generic/socket.h)
+SO_TIMESTAMP = 29
+SO_TIMESTAMPNS = 35
+SO_RCVBUFFORCE = 33
+SO_RXQ_OVFL = 40
+CAN_FRAME = struct.Struct("=IB3x8s")
+CAN_EFF_FLAG = 0x80000000
+CAN_RTR_FLAG = 0x40000000
+CAN_ERR_FLAG = 0x20000000
+TIMESTAMP_CMSG = {SO_TIMESTAMP: (struct.Struct("@2l"), 1e-6), SO_TIMESTAMPNS: (struct.Struct("@2l"), 1e-9)}
+RXQ_OVFL = struct.Struct("=I")
+
+# Only the constant pattern bytes: the counter bytes change every frame, and
+# the kernel should wake us for silence or corruption, not for every ping.
+PATTERN_CHANGE_MASK = bytes([0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF])
 
 
 def make_pattern(counter: int) -> bytes:
@@ -57,8 +96,60 @@ def pattern_matches(data: bytes) -> bool:
     )
 
 
+class DropoutWatch:
+    """Kernel-side silence detection for the ESP's periodic frames.
+
+    One BCM RX_SETUP job per ID: the kernel reports RX_TIMEOUT once an ID has
+    been silent for `timeout` seconds and RX_CHANGED only when the DLC or the
+    pattern bytes change (plus the first frame after a timeout), so polling
+    the BCM socket costs nothing while the link is healthy.
+    """
+
+    def __init__(self, channel: str, ids: Dict[int, str], timeout: float):
+        self.ids = ids
+        self.timeout = timeout
+        self.bcm = BcmSocket(channel)
+        for can_id in ids:
+            self.bcm.rx_setup(can_id, timeout, mask=PATTERN_CHANGE_MASK, flags=RX_ANNOUNCE_RESUME)
+        self.silent_since: Dict[int, float] = {}
+        self.seen: Dict[int, bool] = dict.fromkeys(ids, False)
+        self.dropouts: Dict[int, int] = dict.fromkeys(ids, 0)
+        self.pattern_changes: Dict[int, int] = dict.fromkeys(ids, 0)
+
+    def poll(self, now: float) -> None:
+        while True:
+            msg = self.bcm.recv(0.0)
+            if msg is None:
+                return
+            name = self.ids.get(msg.can_id, "?")
+            if msg.opcode == RX_TIMEOUT:
+                self.silent_since[msg.can_id] = now - self.timeout
+                self.dropouts[msg.can_id] += 1
+                print(f"DROPOUT id=0x{msg.can_id:X} ({name}) silent for {self.timeout:.1f}s")
+            elif msg.opcode == RX_CHANGED:
+                if msg.can_id in self.silent_since:
+                    gap = now - self.silent_since.pop(msg.can_id)
+                    print(f"RESUMED id=0x{msg.can_id:X} ({name}) after {gap:.1f}s")
+                elif self.seen[msg.can_id]:
+                    self.pattern_changes[msg.can_id] += 1
+                self.seen[msg.can_id] = True
+
+    def summary(self) -> str:
+        parts = " ".join(
+            f"{name}={self.dropouts[can_id]}/{self.pattern_changes[can_id]}"
+            for can_id, name in self.ids.items()
+        )
+        silent = ",".join(self.ids[i] for i in self.silent_since) or "-"
+        return f"DROPOUTS (dropouts/pattern changes) {parts} silent={silent}"
+
+    def close(self) -> None:
+        self.bcm.close()
+
+
 class PingPongRunner:
-    def __init__(self, channel: str = "can0"):
+    def __init__(self, channel: str = "can0", hist_out: Optional[str] = None, soak: bool = False,
+                 dropout_timeout: float = DROPOUT_TIMEOUT_SEC, kernel_reflector: bool = False,
+                 rcvbuf: int = 0):
         self.channel = channel
         self.bus: Optional[can.Bus] = None
         self.last_pi_ping_data: Optional[bytes] = None
@@ -68,8 +159,52 @@ class PingPongRunner:
         self.error_streak: int = 0
         self.max_error_streak: int = 5
 
+        self.link_quality = LinkQuality()
+        self.last_pi_ping_sent_at: float = 0.0
+        self.pi_ping_answered = True
+        self.reopened_since_sample = False
+        self.next_health_sample_at: float = time.monotonic()
+        self.next_report_at: float = time.monotonic() + REPORT_PERIOD_SEC
+
+        # Interval RTT histograms, mergeable with the ESP's (pi/histogram.py)
+        self.rtt_hist = LatencyHistogram()
+        self.hist_out: Optional[BinaryIO] = None
+        if hist_out:
+            self.hist_out = open(hist_out, "wb")
+            self.hist_out.write(RECORD_FILE_MAGIC)
+
+        # Long-run drift tracking (pi/soak.py), off unless --soak
+        self.soak: Optional[SoakMonitor] = SoakMonitor(time.monotonic()) if soak else None
+
+        # Receive-queue overflow accounting; the kernel counter restarts per socket
+        self.rcvbuf = rcvbuf
+        self.rcvbuf_effective = 0
+        self.rx_sock: Optional[socket.socket] = None
+        self.rxq_drops_base = 0
+        self.rxq_drops_socket = 0
+        self.rxq_drops_at_ping = 0
+        self.rxq_drops_at_sample = 0
+        self.rxq_drops_at_report = 0
+        self.lost_pings_bus = 0
+        self.lost_pings_socket = 0
+        self.anc_size = socket.CMSG_SPACE(16) + socket.CMSG_SPACE(RXQ_OVFL.size)
+
         self._open_bus(initial=True)
 
+        # ESP PING -> PONG in the kernel; reflected PONGs are echoed back to us
+        self.reflector = ReflectorRule(channel, ESP_PING_ID, ESP_PONG_ID)
+        self.reflected_pongs = 0
+        if kernel_reflector:
+            self.set_kernel_reflector(True)
+
+        self.dropout_watch: Optional[DropoutWatch] = None
+        if dropout_timeout > 0:
+            try:
+                self.dropout_watch = DropoutWatch(
+                    channel, {ESP_PING_ID: "esp_ping", PI_PONG_ID: "esp_pong"}, dropout_timeout)
+            except OSError as exc:
+                print(f"BCM dropout watch unavailable ({exc}); try 'sudo modprobe can-bcm'")
+
     def _open_bus(self, initial: bool = False) -> None:
         if self.bus is not None:
             try:
@@ -80,7 +215,12 @@ class PingPongRunner:
 
         try:
             self.bus = can.Bus(interface="socketcan", channel=self.channel)
+            self._configure_socket()
             self.error_streak = 0
+            if not initial:
+                self.reopened_since_sample = True
+                if self.soak is not None:
+                    self.soak.on_reopen()
             print(f"{'Opened' if initial else 'Reopened'} CAN bus on {self.channel}")
         except Exception as exc:  # noqa: BLE001 - show any init failure
             print(f"Failed to open CAN interface {self.channel}: {exc}")
@@ -88,17 +228,80 @@ class PingPongRunner:
                 sys.exit(1)
             time.sleep(1)
 
+    @property
+    def rxq_drops(self) -> int:
+        return self.rxq_drops_base + self.rxq_drops_socket
+
+    def _configure_socket(self) -> None:
+        self.rxq_drops_base += self.rxq_drops_socket
+        self.rxq_drops_socket = 0
+        self.rx_sock = getattr(self.bus, "socket", None)
+        if not isinstance(self.rx_sock, socket.socket):
+            self.rx_sock = None
+            print("Socket drop counter unavailable: python-can bus exposes no socket")
+            return
+        if self.rcvbuf:
+            try:
+                # FORCE ignores net.core.rmem_max but needs CAP_NET_ADMIN.
+                self.rx_sock.setsockopt(socket.SOL_SOCKET, SO_RCVBUFFORCE, self.rcvbuf)
+            except OSError:
+                self.rx_sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, self.rcvbuf)
+        self.rx_sock.setsockopt(socket.SOL_SOCKET, SO_RXQ_OVFL, 1)
+        self.rcvbuf_effective = self.rx_sock.getsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF)
+        print(f"Socket receive buffer {self.rcvbuf_effective} bytes (requested {self.rcvbuf or 'default'})")
+
+    def _recv(self, timeout: float) -> Optional[can.Message]:
+        """bus.recv() replacement that also reads the SO_RXQ_OVFL counter."""
+        if self.rx_sock is None:
+            return self.bus.recv(timeout=timeout)
+        ready, _, _ = select.select([self.rx_sock], [], [], timeout)
+        if not ready:
+            return None
+        frame, anc, _flags, _addr = self.rx_sock.recvmsg(CAN_FRAME.size, self.anc_size)
+        timestamp = time.time()
+        for level, kind, value in anc:
+            if level != socket.SOL_SOCKET:
+                continue
+            if kind in TIMESTAMP_CMSG:
+                layout, scale = TIMESTAMP_CMSG[kind]
+                sec, frac = layout.unpack_from(value)
+                timestamp = sec + frac * scale
+            elif kind == SO_RXQ_OVFL:
+                self.rxq_drops_socket = RXQ_OVFL.unpack_from(value)[0]
+        can_id, dlc, data = CAN_FRAME.unpack(frame[:CAN_FRAME.size].ljust(CAN_FRAME.size, b"\0"))
+        extended = bool(can_id & CAN_EFF_FLAG)
+        return can.Message(
+            timestamp=timestamp,
+            arbitration_id=can_id & (0x1FFFFFFF if extended else 0x7FF),
+            is_extended_id=extended,
+            is_remote_frame=bool(can_id & CAN_RTR_FLAG),
+            is_error_frame=bool(can_id & CAN_ERR_FLAG),
+            dlc=dlc,
+            data=data[:min(dlc, 8)],
+            channel=self.channel,
+        )
+
+    def set_kernel_reflector(self, enabled: bool) -> None:
+        if enabled:
+            self.reflector.install()
+        else:
+            self.reflector.remove()
+        print(f"{'Installed' if enabled else 'Removed'} kernel reflector ({self.reflector})")
+
     def _send(self, msg: can.Message, label: str) -> None:
         if self.bus is None:
             print(f"Cannot send ({label}): bus not available")
+            self.link_quality.on_tx_result(False)
             self._note_error()
             return
         try:
             self.bus.send(msg)
             print(label)
             self.error_streak = 0
+            self.link_quality.on_tx_result(True)
         except can.CanError as exc:
             print(f"ERROR sending {label}: {exc}")
+            self.link_quality.on_tx_result(False)
             self._note_error()
 
     def _handle_rx(self, msg: can.Message) -> None:
@@ -118,6 +321,9 @@ class PingPongRunner:
             else:
                 print("MISMATCH pattern from ESP")
 
+            if self.reflector.installed:
+                return  # cangw already sent the PONG
+
             pong = can.Message(
                 arbitration_id=ESP_PONG_ID,
                 is_extended_id=False,
@@ -125,19 +331,44 @@ class PingPongRunner:
             )
             self._send(pong, "TX PONG (Pi->ESP) in response to ESP PING")
 
+        # Kernel-reflected PONG (cangw echo), only counted
+        elif msg.arbitration_id == ESP_PONG_ID:
+            self.reflected_pongs += 1
+
         # Case B: PONG from ESP for Pi-initiated PING
         elif msg.arbitration_id == PI_PONG_ID:
-            if self.last_pi_ping_data is not None and bytes(msg.data) == self.last_pi_ping_data:
-                print("MATCHED (Pi-initiated)")
-            else:
-                print("MISMATCH (Pi-initiated)")
+            matched = self.last_pi_ping_data is not None and bytes(msg.data) == self.last_pi_ping_data
+            if not self.pi_ping_answered:
+                if matched:
+                    rtt_us = (time.monotonic() - self.last_pi_ping_sent_at) * 1e6
+                    self.link_quality.on_ping_matched(rtt_us)
+                    self.rtt_hist.record(int(rtt_us))
+                    if self.soak is not None:
+                        self.soak.on_rtt(rtt_us)
+                else:
+                    self.link_quality.on_ping_failed()
+                self.pi_ping_answered = True
+            print("MATCHED (Pi-initiated)" if matched else "MISMATCH (Pi-initiated)")
 
     def _send_pi_ping_if_due(self, now: float) -> None:
         if now < self.next_pi_ping_at:
             return
 
+        if not self.pi_ping_answered:
+            self.link_quality.on_ping_failed()  # previous ping never came back
+            if self.soak is not None:
+                self.soak.on_ping_lost()
+            # The PONG may have reached the host and been dropped at our socket.
+            if self.rxq_drops > self.rxq_drops_at_ping:
+                self.lost_pings_socket += 1
+            else:
+                self.lost_pings_bus += 1
+        self.rxq_drops_at_ping = self.rxq_drops
+
         data = make_pattern(self.pi_counter)
         self.last_pi_ping_data = data
+        self.last_pi_ping_sent_at = time.monotonic()
+        self.pi_ping_answered = False
 
         ping_msg = can.Message(
             arbitration_id=PI_PING_ID,
@@ -149,8 +380,50 @@ class PingPongRunner:
         self.pi_counter = (self.pi_counter + 1) & 0xFF
         self.next_pi_ping_at = now + PING_PERIOD_SEC
 
+    def _update_health(self, now: float) -> None:
+        if now >= self.next_health_sample_at:
+            self.next_health_sample_at = now + HEALTH_SAMPLE_SEC
+            overflow = self.rxq_drops > self.rxq_drops_at_sample
+            self.rxq_drops_at_sample = self.rxq_drops
+            self.link_quality.on_health_sample(overflow=overflow, reinit=self.reopened_since_sample)
+            self.reopened_since_sample = False
+
+        if now >= self.next_report_at:
+            self.next_report_at = now + REPORT_PERIOD_SEC
+            print(self.link_quality.summary())
+            self._report_histogram()
+            if self.dropout_watch is not None:
+                print(self.dropout_watch.summary())
+            if self.reflector.installed:
+                print(f"REFLECTOR pongs_seen={self.reflected_pongs}")
+            new_drops = self.rxq_drops - self.rxq_drops_at_report
+            self.rxq_drops_at_report = self.rxq_drops
+            if self.soak is not None:
+                self.soak.on_socket_drops(new_drops)
+            print(f"SOCKET rcvbuf={self.rcvbuf_effective} rxq_drops={self.rxq_drops} (+{new_drops}) "
+                  f"lost_pings bus={self.lost_pings_bus} socket={self.lost_pings_socket}")
+
+        if self.soak is not None:
+            self.soak.tick(now)
+
+    def _report_histogram(self) -> None:
+        h = self.rtt_hist
+        print(
+            f"RTTH n={h.total} p50={h.value_at_percentile(50.0)} p90={h.value_at_percentile(90.0)} "
+            f"p99={h.value_at_percentile(99.0)} p999={h.value_at_percentile(99.9)} max={h.max}"
+        )
+        if self.hist_out is not None:
+            ts_ns = time.time_ns()
+            for payload in h.encode(SERIES_PI_RTT):
+                self.hist_out.write(RECORD_FILE_HEADER.pack(ts_ns, TYPE_HISTOGRAM, len(payload)))
+                self.hist_out.write(payload)
+            self.hist_out.flush()
+        self.rtt_hist = LatencyHistogram()
+
     def _note_error(self) -> None:
         self.error_streak += 1
+        if self.soak is not None:
+            self.soak.on_error()
         if self.error_streak >= self.max_error_streak:
             print("Error streak threshold reached; reopening CAN interface...")
             self._open_bus()
@@ -166,9 +439,12 @@ class PingPongRunner:
 
             now = time.monotonic()
             self._send_pi_ping_if_due(now)
+            self._update_health(now)
+            if self.dropout_watch is not None:
+                self.dropout_watch.poll(now)
 
             try:
-                msg = self.bus.recv(timeout=0.1)
+                msg = self._recv(timeout=0.1)
             except (can.CanError, OSError) as exc:
                 print(f"Receive error: {exc}")
                 self._note_error()
@@ -183,11 +459,35 @@ class PingPongRunner:
     def stop(self) -> None:
         self.running = False
         self.bus.shutdown()
+        if self.hist_out is not None:
+            self.hist_out.close()
+        if self.dropout_watch is not None:
+            self.dropout_watch.close()
+        if self.reflector.installed:
+            self.set_kernel_reflector(False)
         print("Stopped.")
 
 
 def main() -> None:
-    runner = PingPongRunner(channel="can0")
+    parser = argparse.ArgumentParser(description="Bidirectional CAN ping-pong test")
+    parser.add_argument("--channel", default="can0")
+    parser.add_argument("--hist-out", help="write RTT histograms to this TELREC1 file")
+    parser.add_argument("--soak", action="store_true",
+                        help="track long-run drift (RTT, errors, RSS, fds) and flag degradations")
+    parser.add_argument("--dropout-timeout", type=float, default=DROPOUT_TIMEOUT_SEC,
+                        help="seconds of silence on an ESP ID before DROPOUT (0 disables)")
+    parser.add_argument("--kernel-reflector", action="store_true",
+                        help="echo ESP PINGs with a cangw rule instead of Python (needs root)")
+    parser.add_argument("--rcvbuf", type=int, default=0,
+                        help="socket receive buffer in bytes (default: kernel default)")
+    args = parser.parse_args()
+
+    try:
+        runner = PingPongRunner(channel=args.channel, hist_out=args.hist_out, soak=args.soak,
+                                dropout_timeout=args.dropout_timeout,
+                                kernel_reflector=args.kernel_reflector, rcvbuf=args.rcvbuf)
+    except RuntimeError as exc:
+        sys.exit(str(exc))
 
     def _signal_handler(sig, frame):  # noqa: ANN001, D401 - signal signature
         del sig, frame
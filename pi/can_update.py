@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+"""
+Flash new ESP firmware over CAN (ISO-TP, see src/firmware_update.h).
+
+  BEGIN  01 size:u32 crc32:u32      -> 41 status chunk_max:u16 window:u8
+  DATA   02 seq:u16 offset:u32 ...  -> 42 seq:u16 status next_offset:u24
+  END    03                         -> 43 status
+  ABORT  04                         -> 44 status
+
+The image goes out in chunks of up to 4088 bytes, one ISO-TP message each.
+Two levels of flow control keep the node's buffers from overrunning: inside
+a chunk the node's FC frames grant BS consecutive frames at a time; across
+chunks at most --window chunks (the node's two flash buffers) are
+unacknowledged, and the node acknowledges a chunk only once it is flashed.
+So chunk n+1 is on the wire while chunk n is being written. A rejected or
+lost chunk resynchronises to the offset the node reports (go-back-N).
+
+Reports the achieved payload rate against the bus's ISO-TP capacity (7 data
+bytes per consecutive frame at 100 % load, stuff bits included).
+
+Usage:
+  python3 pi/can_update.py .pio/build/esp32-s3-devkitc-1-update/firmware.bin
+"""
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+from typing import Dict, Tuple
+
+import can
+
+from burst_test import frame_bits
+from isotp import IsoTpError, IsoTpLink
+
+REQUEST_ID = 0x6F0   # UPDATE_REQUEST_ID in src/main.cpp
+RESPONSE_ID = 0x6F8
+
+REQ_BEGIN, REQ_DATA, REQ_END, REQ_ABORT = 0x01, 0x02, 0x03, 0x04
+RESPONSE = 0x40
+DATA_HEADER = struct.Struct("<BHI")
+DATA_RESPONSE = struct.Struct("<BHB3s")
+
+STATUS = ("ok", "busy", "too_large", "no_memory", "flash_error", "out_of_order",
+          "verify_failed", "not_active", "bad_request", "timeout")
+OK, BUSY, OUT_OF_ORDER = 0, 1, 5
+RESYNC_STATUS = (BUSY, OUT_OF_ORDER, 8)  # 8: bad_request, e.g. a truncated chunk
+
+ACK_TIMEOUT_SEC = 3.0
+END_TIMEOUT_SEC = 15.0   # esp_ota_end re-reads and hashes the image
+MAX_RETRIES = 20
+
+
+def status_name(code: int) -> str:
+    return STATUS[code] if code < len(STATUS) else f"status_{code}"
+
+
+def isotp_capacity_bps(bitrate: int) -> float:
+    """Payload bytes/s with the bus full of 8-byte consecutive frames.
+
+    The sample frame is 114 bits stuffed; UPDATE_FRAME_BITS in src/main.cpp
+    uses the same length so the node's efficiency figure matches ours.
+    """
+    sample = bytes([0x21]) + bytes(range(0x30, 0x37))
+    return bitrate / frame_bits(REQUEST_ID, sample) * 7
+
+
+class UpdateError(Exception):
+    pass
+
+
+class Uploader:
+    def __init__(self, link: IsoTpLink, image: bytes, window: int, chunk: int):
+        self.link = link
+        self.image = image
+        self.window = window
+        self.chunk = chunk
+        self.seq = 0
+        self.acked = 0          # flashed on the node
+        self.next_offset = 0    # next byte to send
+        self.inflight: Dict[int, Tuple[int, int]] = {}  # seq -> (offset, len)
+        self.sent_bytes = 0
+        self.resyncs = 0
+        self.timeouts = 0
+
+    def request(self, payload: bytes, code: int, timeout: float) -> bytes:
+        self.link.send(payload)
+        deadline = time.monotonic() + timeout
+        while True:
+            got = self.link.recv(max(deadline - time.monotonic(), 0.0))
+            if got is None:
+                raise UpdateError(f"no response to request 0x{code:02X}")
+            if got[0] and got[0][0] == code | RESPONSE:
+                return got[0]
+
+    def begin(self) -> None:
+        erase_timeout = 10.0 + len(self.image) / 20000  # erase runs at > 20 KB/s
+        reply = self.request(struct.pack("<BII", REQ_BEGIN, len(self.image), zlib.crc32(self.image)),
+                             REQ_BEGIN, erase_timeout)
+        if reply[1] != OK:
+            raise UpdateError(f"BEGIN refused: {status_name(reply[1])}")
+        if len(reply) >= 5:
+            chunk_max, window = struct.unpack_from("<HB", reply, 2)
+            self.chunk = min(self.chunk, chunk_max)
+            self.window = min(self.window, window)
+
+    def _send_next(self) -> None:
+        offset = self.next_offset
+        data = self.image[offset:offset + self.chunk]
+        seq = self.seq
+        self.seq = (self.seq + 1) & 0xFFFF
+        self.inflight[seq] = (offset, len(data))
+        self.next_offset += len(data)
+        self.sent_bytes += len(data)
+        try:
+            self.link.send(DATA_HEADER.pack(REQ_DATA, seq, offset) + data,
+                           abort_on=lambda reply: self._rejects(seq, reply))
+        except IsoTpError:
+            pass  # the node's response (or its silence) decides what happens next
+
+    @staticmethod
+    def _rejects(seq: int, reply: bytes) -> bool:
+        """True if reply refuses chunk seq. With a window above one the OK
+        for the previous chunk arrives while this one is on the wire; that
+        only queues for transfer() and must not cut the send short."""
+        if len(reply) < DATA_RESPONSE.size or reply[0] != REQ_DATA | RESPONSE:
+            return False
+        _, got, status, _ = DATA_RESPONSE.unpack_from(reply)
+        return got == seq and status != OK
+
+    def _resync(self, offset: int) -> None:
+        # Chunks below the node's offset were accepted and will still be acked.
+        self.inflight = {s: c for s, c in self.inflight.items() if c[0] < offset}
+        self.next_offset = offset
+        self.resyncs += 1
+
+    def _on_response(self, reply: bytes) -> None:
+        if len(reply) < DATA_RESPONSE.size or reply[0] != REQ_DATA | RESPONSE:
+            return
+        _, seq, status, nxt = DATA_RESPONSE.unpack_from(reply)
+        next_offset = int.from_bytes(nxt, "little")
+        if seq not in self.inflight:
+            return  # answer to a chunk from before a resync
+        if status == OK:
+            del self.inflight[seq]
+            self.acked = max(self.acked, next_offset)
+        elif status in RESYNC_STATUS:
+            self._resync(next_offset)
+        else:
+            raise UpdateError(f"chunk at {self.inflight[seq][0]} failed: {status_name(status)}")
+
+    def transfer(self, progress) -> None:
+        size = len(self.image)
+        retries = 0
+        while self.acked < size:
+            while len(self.inflight) < self.window and self.next_offset < size:
+                self._send_next()
+                while self.link.inbox:
+                    self._on_response(self.link.recv(0)[0])
+            got = self.link.recv(ACK_TIMEOUT_SEC)
+            if got is None:
+                # Lost chunk or lost ack: the node will name the offset it wants.
+                retries += 1
+                self.timeouts += 1
+                if retries > MAX_RETRIES:
+                    raise UpdateError(f"node stopped answering at offset {self.acked}")
+                self.inflight.clear()
+                self.next_offset = self.acked
+                continue
+            retries = 0
+            self._on_response(got[0])
+            progress(self)
+
+    def end(self) -> None:
+        reply = self.request(bytes([REQ_END]), REQ_END, END_TIMEOUT_SEC)
+        if reply[1] != OK:
+            raise UpdateError(f"END refused: {status_name(reply[1])}")
+
+    def abort(self) -> None:
+        try:
+            self.link.send(bytes([REQ_ABORT]))
+        except (IsoTpError, can.CanError):
+            pass
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Flash ESP firmware over CAN (ISO-TP)")
+    parser.add_argument("image", help="firmware .bin (e.g. .pio/build/<env>/firmware.bin)")
+    parser.add_argument("--channel", default="can0")
+    parser.add_argument("--bitrate", type=int, default=125000)
+    parser.add_argument("--window", type=int, default=2, help="unacknowledged chunks (node caps it)")
+    parser.add_argument("--chunk", type=int, default=4088, help="bytes per chunk (node caps it)")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as fp:
+        image = fp.read()
+    if not image or image[0] != 0xE9:
+        sys.exit(f"{args.image}: not an ESP app image (magic 0xE9)")
+
+    bus = can.Bus(interface="socketcan", channel=args.channel,
+                  can_filters=[{"can_id": RESPONSE_ID, "can_mask": 0x7FF, "extended": False}])
+    link = IsoTpLink(bus, REQUEST_ID, RESPONSE_ID)
+    up = Uploader(link, image, args.window, args.chunk)
+    capacity = isotp_capacity_bps(args.bitrate)
+    last_print = [0.0]
+    started = time.monotonic()
+
+    def progress(u: Uploader) -> None:
+        now = time.monotonic()
+        if now - last_print[0] >= 2.0:
+            last_print[0] = now
+            rate = u.acked / (now - started)
+            print(f"  {u.acked}/{len(image)} bytes  {rate:.0f} B/s  "
+                  f"({rate / capacity * 100:.0f}% of bus capacity)", file=sys.stderr)
+
+    try:
+        print(f"BEGIN size={len(image)} crc32=0x{zlib.crc32(image):08X} (node erases first)",
+              file=sys.stderr)
+        t0 = time.monotonic()
+        up.begin()
+        started = time.monotonic()
+        print(f"READY erase_s={started - t0:.1f} chunk={up.chunk} window={up.window}", file=sys.stderr)
+        up.transfer(progress)
+        seconds = time.monotonic() - started
+        up.end()
+    except UpdateError as exc:
+        up.abort()
+        bus.shutdown()
+        sys.exit(f"update failed: {exc}")
+    except KeyboardInterrupt:
+        up.abort()
+        bus.shutdown()
+        sys.exit("update aborted")
+    bus.shutdown()
+
+    rate = len(image) / seconds
+    print(f"UPDATE bytes={len(image)} seconds={seconds:.1f} rate_Bps={rate:.0f} "
+          f"capacity_Bps={capacity:.0f} efficiency={rate / capacity * 100:.1f}% "
+          f"resent_bytes={up.sent_bytes - len(image)} resyncs={up.resyncs} "
+          f"ack_timeouts={up.timeouts} fc_waits={link.fc_waits}")
+    print("Node verified the image and is rebooting into it.", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,54 @@
+"""
+Kernel CAN gateway (can-gw) rules via the `cangw` tool from can-utils.
+
+ReflectorRule rewrites one standard ID to another and sends the frame back
+out of the interface it arrived on, entirely in the kernel:
+
+  cangw -A -s can0 -d can0 -i -e -f 123:C00007FF -m SET:I:124.0.0000000000000000
+
+-i allows routing back to the incoming interface, -e echoes the sent frame
+to local sockets so userspace still sees the reflected PONG, and the filter
+mask keeps extended and RTR frames out. Needs root (CAP_NET_ADMIN), the
+can-gw module (`sudo modprobe can-gw`) and `sudo apt install -y can-utils`.
+"""
+
+import shutil
+import subprocess
+from typing import List
+
+
+class ReflectorRule:
+    def __init__(self, channel: str, src_id: int, dst_id: int):
+        self.channel = channel
+        self.src_id = src_id
+        self.dst_id = dst_id
+        self.installed = False
+
+    def _args(self) -> List[str]:
+        return [
+            "-s", self.channel, "-d", self.channel, "-i", "-e",
+            "-f", f"{self.src_id:03X}:C00007FF",
+            "-m", f"SET:I:{self.dst_id:03X}.0.{'0' * 16}",
+        ]
+
+    def _cangw(self, op: str) -> None:
+        tool = shutil.which("cangw")
+        if tool is None:
+            raise RuntimeError("cangw not found (sudo apt install -y can-utils)")
+        proc = subprocess.run([tool, op] + self._args(), capture_output=True, text=True)
+        if proc.returncode != 0:
+            detail = (proc.stderr or proc.stdout).strip()
+            raise RuntimeError(f"cangw {op} failed: {detail} (root and can-gw module required)")
+
+    def install(self) -> None:
+        if not self.installed:
+            self._cangw("-A")
+            self.installed = True
+
+    def remove(self) -> None:
+        if self.installed:
+            self._cangw("-D")
+            self.installed = False
+
+    def __str__(self) -> str:
+        return f"cangw {self.channel} 0x{self.src_id:X} -> 0x{self.dst_id:X}"
@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""
+Host decoder for the ESP streaming capture encoding (src/capture_encoder.h).
+
+Reads a raw serial dump (text log + telemetry records), decodes the
+TYPE_CAPTURE blocks and writes a CANCAP1 capture file and/or a candump-like
+listing. Also reports the achieved compression against 16-byte raw records.
+
+Usage:
+  python3 pi/capture_codec.py serial_dump.bin -o capture.cancap
+  python3 pi/capture_codec.py serial_dump.bin --list
+"""
+
+import argparse
+import sys
+from typing import List, Optional
+
+from capture_file import CAN_EFF_FLAG, CAN_RTR_FLAG, FLAG_TX, CaptureFrame, CaptureWriter
+from telemetry import TYPE_CAPTURE, TelemetryDemux
+
+DICT_SLOTS = 32
+FLAG_KEYFRAME = 0x01
+TAG_MISS = 0x80
+TAG_DLC = 0x40
+TAG_SAME = 0x20
+TAG_SLOT_MASK = 0x1F
+
+RAW_RECORD_BYTES = 16  # struct can_frame
+
+
+class _Slot:
+    __slots__ = ("key", "last_ts", "period", "dlc", "data")
+
+    def __init__(self, key: int):
+        self.key = key
+        self.last_ts = 0
+        self.period = 0
+        self.dlc = 0xFF
+        self.data = bytearray(8)
+
+
+def _unpack_key(key: int):
+    tx = key & 1
+    packed = key >> 1
+    can_id = packed & 0x1FFFFFFF
+    if packed & (1 << 29):
+        can_id |= CAN_EFF_FLAG
+    if packed & (1 << 30):
+        can_id |= CAN_RTR_FLAG
+    return can_id, bool(tx)
+
+
+class CaptureDecoder:
+    """Stateful block decoder mirroring CaptureEncoder.
+
+    Blocks after a sequence gap are skipped until the next keyframe, since
+    their dictionary/timestamp references cannot be resolved.
+    """
+
+    def __init__(self) -> None:
+        self.slots: List[Optional[_Slot]] = [None] * DICT_SLOTS
+        self.prev_ts = 0
+        self.expected_seq: Optional[int] = None
+        self.synced = False
+        self.blocks = 0
+        self.blocks_skipped = 0
+        self.seq_gaps = 0
+        self.frames = 0
+        self.encoded_bytes = 0
+        self._wrap = 0
+        self._last_raw_ts: Optional[int] = None
+
+    def _unwrap(self, ts32: int) -> int:
+        if self._last_raw_ts is not None and ts32 < self._last_raw_ts and \
+                self._last_raw_ts - ts32 > 0x80000000:
+            self._wrap += 1 << 32
+        self._last_raw_ts = ts32
+        return self._wrap + ts32
+
+    def decode_block(self, block: bytes) -> List[CaptureFrame]:
+        if len(block) < 2:
+            self.blocks_skipped += 1
+            return []
+        seq, flags = block[0], block[1]
+        pos = 2
+
+        if self.expected_seq is not None and seq != self.expected_seq:
+            self.seq_gaps += 1
+            self.synced = False
+        self.expected_seq = (seq + 1) & 0xFF
+
+        if flags & FLAG_KEYFRAME:
+            self.slots = [None] * DICT_SLOTS
+            self.prev_ts = int.from_bytes(block[pos:pos + 4], "little")
+            pos += 4
+            self.synced = True
+        if not self.synced:
+            self.blocks_skipped += 1
+            return []
+
+        self.blocks += 1
+        self.encoded_bytes += len(block)
+        out: List[CaptureFrame] = []
+        try:
+            while pos < len(block):
+                frame, pos = self._decode_frame(block, pos)
+                out.append(frame)
+        except (IndexError, ValueError):
+            self.synced = False
+            self.blocks_skipped += 1
+        self.frames += len(out)
+        return out
+
+    def _decode_frame(self, block: bytes, pos: int):
+        tag = block[pos]
+        pos += 1
+        idx = tag & TAG_SLOT_MASK
+
+        if tag & TAG_MISS:
+            key, pos = _varint(block, pos)
+            slot = _Slot(key)
+            self.slots[idx] = slot
+            dt, pos = _zigzag(block, pos)
+            ts = (self.prev_ts + dt) & 0xFFFFFFFF
+        else:
+            slot = self.slots[idx]
+            if slot is None:
+                raise ValueError("reference to empty dictionary slot")
+            resid, pos = _zigzag(block, pos)
+            delta = (slot.period + resid) & 0xFFFFFFFF
+            ts = (slot.last_ts + delta) & 0xFFFFFFFF
+            slot.period = delta
+
+        dlc = slot.dlc
+        if tag & TAG_DLC:
+            dlc = block[pos]
+            pos += 1
+        if dlc > 8:
+            raise ValueError("bad dlc")
+
+        data = bytearray(slot.data[:dlc])
+        if not tag & TAG_SAME:
+            mask = block[pos]
+            pos += 1
+            for i in range(dlc):
+                if mask & (1 << i):
+                    data[i] ^= block[pos]
+                    pos += 1
+
+        slot.data[:dlc] = data
+        slot.data[dlc:] = bytes(8 - dlc)
+        slot.dlc = dlc
+        slot.last_ts = ts
+        self.prev_ts = ts
+
+        can_id, tx = _unpack_key(slot.key)
+        frame = CaptureFrame(self._unwrap(ts), can_id, dlc, bytes(data), FLAG_TX if tx else 0)
+        return frame, pos
+
+
+def _varint(buf: bytes, pos: int):
+    value = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+        if shift > 28:
+            raise ValueError("varint too long")
+
+
+def _zigzag(buf: bytes, pos: int):
+    v, pos = _varint(buf, pos)
+    return (v >> 1) ^ -(v & 1), pos
+
+
+def format_frame(frame: CaptureFrame) -> str:
+    can_id = frame.can_id
+    if can_id & CAN_EFF_FLAG:
+        ident = f"{can_id & 0x1FFFFFFF:08X}"
+    else:
+        ident = f"{can_id & 0x7FF:03X}"
+    direction = "TX" if frame.flags & FLAG_TX else "RX"
+    payload = "R" if can_id & CAN_RTR_FLAG else frame.data.hex(" ").upper()
+    return f"({frame.ts_us / 1e6:.6f}) {direction} {ident} [{frame.dlc}] {payload}"
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Decode ESP capture stream")
+    parser.add_argument("input", help="raw serial dump ('-' for stdin)")
+    parser.add_argument("-o", "--output", help="write CANCAP1 capture file")
+    parser.add_argument("--list", action="store_true", help="print decoded frames")
+    args = parser.parse_args()
+
+    src = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+    writer = CaptureWriter(open(args.output, "wb")) if args.output else None
+    demux = TelemetryDemux()
+    decoder = CaptureDecoder()
+
+    while True:
+        chunk = src.read(1 << 16)
+        if not chunk:
+            break
+        for item in demux.feed(chunk):
+            if item[0] != "record" or item[1] != TYPE_CAPTURE:
+                continue
+            for frame in decoder.decode_block(item[2]):
+                if writer is not None:
+                    writer.write(frame)
+                if args.list:
+                    print(format_frame(frame))
+    for _ in demux.flush():
+        pass
+
+    if writer is not None:
+        writer.flush()
+
+    raw = decoder.frames * RAW_RECORD_BYTES
+    ratio = raw / decoder.encoded_bytes if decoder.encoded_bytes else 0.0
+    print(
+        f"frames={decoder.frames} blocks={decoder.blocks} "
+        f"skipped={decoder.blocks_skipped} seq_gaps={decoder.seq_gaps} "
+        f"bad_bytes={demux.bad_bytes} encoded={decoder.encoded_bytes}B "
+        f"raw={raw}B ratio={ratio:.2f}x",
+        file=sys.stderr,
+    )
+
+
+if __name__ == "__main__":
+    main()
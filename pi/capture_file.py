@@ -0,0 +1,122 @@
+"""
+Binary CAN capture file shared by the host tools.
+
+File:   MAGIC(8 bytes, b"CANCAP1\\0") RECORD...
+Record: <QIBB2x8s  (24 bytes, little endian)
+        ts_us   u64  microseconds (device clock unless FLAG_HOST_TS)
+        can_id  u32  linux/can.h layout (EFF 0x80000000, RTR 0x40000000)
+        dlc     u8
+        flags   u8   FLAG_* below
+        data    8 bytes, zero padded
+
+PcapngWriter writes the same frames as pcapng (LINKTYPE_CAN_SOCKETCAN,
+microsecond timestamps, TX/RX as packet direction) for Wireshark.
+"""
+
+import struct
+from typing import BinaryIO, Iterator, NamedTuple
+
+MAGIC = b"CANCAP1\0"
+RECORD = struct.Struct("<QIBB2x8s")
+
+FLAG_TX = 0x01        # frame sent by the capturing node
+FLAG_HOST_TS = 0x02   # timestamp taken on the host, not the device
+FLAG_TEXT_LOG = 0x04  # reconstructed from a text log (timestamp approximate)
+
+CAN_EFF_FLAG = 0x80000000
+CAN_RTR_FLAG = 0x40000000
+
+
+class CaptureFrame(NamedTuple):
+    ts_us: int
+    can_id: int
+    dlc: int
+    data: bytes
+    flags: int = 0
+
+
+class CaptureWriter:
+    def __init__(self, fp: BinaryIO, buffer_records: int = 4096):
+        self.fp = fp
+        self.count = 0
+        self._buf = bytearray()
+        self._flush_at = buffer_records * RECORD.size
+        fp.write(MAGIC)
+
+    def write(self, frame: CaptureFrame) -> None:
+        self._buf += RECORD.pack(
+            frame.ts_us & 0xFFFFFFFFFFFFFFFF,
+            frame.can_id,
+            frame.dlc,
+            frame.flags,
+            bytes(frame.data[:8]),
+        )
+        self.count += 1
+        if len(self._buf) >= self._flush_at:
+            self.flush()
+
+    def flush(self) -> None:
+        if self._buf:
+            self.fp.write(self._buf)
+            self._buf.clear()
+        self.fp.flush()
+
+
+LINKTYPE_CAN_SOCKETCAN = 227
+PCAPNG_EPB = struct.Struct("<IIIIIII")   # type, len, if_id, ts_hi, ts_lo, caplen, origlen
+SOCKETCAN_HEADER = struct.Struct(">IBBBB")  # can_id (network order), len, fd flags, res, len8_dlc
+
+
+class PcapngWriter:
+    """Same interface as CaptureWriter; one section, one CAN interface."""
+
+    def __init__(self, fp: BinaryIO, buffer_records: int = 4096):
+        self.fp = fp
+        self.count = 0
+        self._buf = bytearray()
+        self._flush_at = buffer_records * 48
+        # Section header: byte-order magic, version 1.0, unknown section length
+        fp.write(struct.pack("<IIIHHqI", 0x0A0D0D0A, 28, 0x1A2B3C4D, 1, 0, -1, 28))
+        # Interface: if_tsresol = 6 (microseconds), end of options
+        fp.write(struct.pack("<IIHHIHHB3xHHI", 1, 32, LINKTYPE_CAN_SOCKETCAN, 0, 0,
+                             9, 1, 6, 0, 0, 32))
+
+    def write(self, frame: CaptureFrame) -> None:
+        data = bytes(frame.data[:8])
+        packet = SOCKETCAN_HEADER.pack(frame.can_id, len(data), 0, 0, 0) + data
+        pad = -len(packet) % 4
+        total = PCAPNG_EPB.size + len(packet) + pad + 12 + 4  # epb_flags + end of options + trailer
+        ts = frame.ts_us & 0xFFFFFFFFFFFFFFFF
+        self._buf += PCAPNG_EPB.pack(6, total, 0, ts >> 32, ts & 0xFFFFFFFF, len(packet), len(packet))
+        self._buf += packet + bytes(pad)
+        direction = 2 if frame.flags & FLAG_TX else 1  # epb_flags: outbound / inbound
+        self._buf += struct.pack("<HHIHHI", 2, 4, direction, 0, 0, total)
+        self.count += 1
+        if len(self._buf) >= self._flush_at:
+            self.flush()
+
+    def flush(self) -> None:
+        if self._buf:
+            self.fp.write(self._buf)
+            self._buf.clear()
+        self.fp.flush()
+
+
+def open_writer(path: str):
+    """CaptureWriter, or PcapngWriter for *.pcapng."""
+    fp = open(path, "wb")
+    return PcapngWriter(fp) if path.endswith(".pcapng") else CaptureWriter(fp)
+
+
+def read_capture(fp: BinaryIO, chunk_records: int = 4096) -> Iterator[CaptureFrame]:
+    if fp.read(len(MAGIC)) != MAGIC:
+        raise ValueError("not a CANCAP1 capture file")
+    while True:
+        chunk = fp.read(chunk_records * RECORD.size)
+        if not chunk:
+            return
+        usable = len(chunk) - len(chunk) % RECORD.size
+        for ts_us, can_id, dlc, flags, data in RECORD.iter_unpack(chunk[:usable]):
+            yield CaptureFrame(ts_us, can_id, dlc, data[:dlc], flags)
+        if usable != len(chunk):
+            return  # truncated trailing record
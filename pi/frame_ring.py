@@ -0,0 +1,331 @@
+#!/usr/bin/env python3
+"""
+Shared-memory CAN frame fan-out for local consumers.
+
+One publisher owns the CAN socket and appends every frame to a broadcast
+ring in POSIX shared memory (/dev/shm/<name>). Any number of local consumers
+attach to the ring and read frames straight out of the mapping: no socket
+per tool, no kernel clone per frame, and no syscall per frame on the consumer
+side. The publisher never waits for consumers; a consumer that falls more
+than a ring behind detects the overrun and counts the frames it lost.
+
+Layout (little endian):
+  header     64 B   MAGIC(8) slots(u32) slot_size(u32) max_consumers(u32)
+                    publisher_pid(u32) write_seq(u64) ...
+  consumers  64 B each: pid(u32) pad(u32) cursor(u64) overruns(u64) lost(u64)
+  slots      slot_size B each: seq(u64) + capture_file.RECORD (24 B)
+
+Frame n (1-based) lives in slot (n - 1) % slots, tagged with seq = n. The
+publisher zeroes the tag, writes the record, then stores the tag and
+write_seq. A consumer reads the tag, the record and the tag again; a tag
+other than n means the slot was overwritten (overrun). The consumer table is
+for monitoring only: the publisher reports each consumer's lag.
+
+Usage:
+  python3 pi/frame_ring.py publish --channel can0
+  python3 pi/frame_ring.py dump                 # candump-like listing
+  python3 pi/frame_ring.py record -o run.cancap
+  python3 pi/frame_ring.py stats
+"""
+
+import argparse
+import os
+import signal
+import struct
+import sys
+import time
+from multiprocessing import shared_memory
+from typing import List, Optional
+
+from capture_file import (CAN_EFF_FLAG, CAN_RTR_FLAG, FLAG_HOST_TS, FLAG_TX, RECORD,
+                          CaptureFrame, CaptureWriter)
+
+MAGIC = b"CANRING1"
+HEADER = struct.Struct("<8sIIII")
+HEADER_SIZE = 64
+WRITE_SEQ_OFFSET = 24
+CONSUMER = struct.Struct("<IIQQQ")
+CONSUMER_SIZE = 64
+SLOT_TAG = struct.Struct("<Q")
+SLOT_SIZE = 32
+
+DEFAULT_NAME = "canring"
+DEFAULT_SLOTS = 1 << 16   # ~65 s at the 125 kbps bus maximum
+DEFAULT_CONSUMERS = 32
+
+IDLE_SLEEP_SEC = 0.001
+REPORT_PERIOD_SEC = 10.0
+
+U64 = struct.Struct("<Q")
+
+
+def _attach(name: str) -> shared_memory.SharedMemory:
+    try:
+        return shared_memory.SharedMemory(name=name, track=False)  # Python >= 3.13
+    except TypeError:
+        shm = shared_memory.SharedMemory(name=name)
+        # Older versions register attached segments with the resource tracker,
+        # which would unlink the publisher's ring when a consumer exits.
+        from multiprocessing import resource_tracker
+        resource_tracker.unregister(shm._name, "shared_memory")  # noqa: SLF001
+        return shm
+
+
+def _pid_alive(pid: int) -> bool:
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        pass
+    return True
+
+
+class _Ring:
+    def __init__(self, shm: shared_memory.SharedMemory):
+        self.shm = shm
+        self.buf = shm.buf
+        magic, self.slots, slot_size, self.max_consumers, self.publisher_pid = \
+            HEADER.unpack_from(self.buf, 0)
+        if magic != MAGIC or slot_size != SLOT_SIZE or self.slots & (self.slots - 1):
+            raise ValueError(f"{shm.name}: not a {MAGIC.decode()} ring")
+        self.mask = self.slots - 1
+        self.slots_offset = HEADER_SIZE + self.max_consumers * CONSUMER_SIZE
+
+    def write_seq(self) -> int:
+        return U64.unpack_from(self.buf, WRITE_SEQ_OFFSET)[0]
+
+    def consumer(self, index: int) -> tuple:
+        return CONSUMER.unpack_from(self.buf, HEADER_SIZE + index * CONSUMER_SIZE)
+
+
+class FrameRingPublisher(_Ring):
+    def __init__(self, name: str = DEFAULT_NAME, slots: int = DEFAULT_SLOTS,
+                 max_consumers: int = DEFAULT_CONSUMERS):
+        if slots & (slots - 1):
+            raise ValueError("slots must be a power of two")
+        size = HEADER_SIZE + max_consumers * CONSUMER_SIZE + slots * SLOT_SIZE
+        try:
+            shm = shared_memory.SharedMemory(name=name, create=True, size=size)
+        except FileExistsError:
+            # Left behind by a publisher that died; a live one keeps its pid.
+            old = _attach(name)
+            pid = HEADER.unpack_from(old.buf, 0)[4] if old.size >= HEADER_SIZE else 0
+            old.close()
+            if pid and _pid_alive(pid):
+                raise SystemExit(f"ring {name} already published by pid {pid}")
+            stale = shared_memory.SharedMemory(name=name)
+            stale.unlink()
+            stale.close()
+            shm = shared_memory.SharedMemory(name=name, create=True, size=size)
+
+        shm.buf[:HEADER_SIZE + max_consumers * CONSUMER_SIZE] = \
+            bytes(HEADER_SIZE + max_consumers * CONSUMER_SIZE)
+        HEADER.pack_into(shm.buf, 0, MAGIC, slots, SLOT_SIZE, max_consumers, os.getpid())
+        super().__init__(shm)
+        self.seq = 0
+
+    def publish(self, frame: CaptureFrame) -> None:
+        n = self.seq + 1
+        off = self.slots_offset + ((n - 1) & self.mask) * SLOT_SIZE
+        buf = self.buf
+        SLOT_TAG.pack_into(buf, off, 0)
+        RECORD.pack_into(buf, off + SLOT_TAG.size, frame.ts_us, frame.can_id,
+                         frame.dlc, frame.flags, bytes(frame.data[:8]))
+        SLOT_TAG.pack_into(buf, off, n)
+        U64.pack_into(buf, WRITE_SEQ_OFFSET, n)
+        self.seq = n
+
+    def report(self) -> str:
+        parts = [f"frames={self.seq}"]
+        for i in range(self.max_consumers):
+            pid, _, cursor, overruns, lost = self.consumer(i)
+            if pid:
+                parts.append(f"[pid {pid} lag={self.seq - cursor} overruns={overruns} lost={lost}]")
+        return " ".join(parts)
+
+    def close(self) -> None:
+        self.shm.close()
+        self.shm.unlink()
+
+
+class FrameRingReader(_Ring):
+    def __init__(self, name: str = DEFAULT_NAME, from_start: bool = False):
+        super().__init__(_attach(name))
+        self.index = self._claim()
+        ws = self.write_seq()
+        self.cursor = max(0, ws - self.slots + 1) if from_start else ws
+        self.overruns = 0
+        self.lost = 0
+        self._update_entry()
+
+    def _claim(self) -> int:
+        pid = os.getpid()
+        for i in range(self.max_consumers):
+            other = self.consumer(i)[0]
+            if other == 0 or not _pid_alive(other):
+                CONSUMER.pack_into(self.buf, HEADER_SIZE + i * CONSUMER_SIZE, pid, 0, 0, 0, 0)
+                if self.consumer(i)[0] == pid:
+                    return i
+        raise SystemExit("no free consumer entry in the ring")
+
+    def _update_entry(self) -> None:
+        CONSUMER.pack_into(self.buf, HEADER_SIZE + self.index * CONSUMER_SIZE,
+                           os.getpid(), 0, self.cursor, self.overruns, self.lost)
+
+    def _skip_to(self, n: int) -> None:
+        self.overruns += 1
+        self.lost += n - self.cursor
+        self.cursor = n
+
+    def read_batch(self, max_frames: int = 4096) -> List[CaptureFrame]:
+        ws = self.write_seq()
+        if ws - self.cursor > self.slots - 1:
+            # Keep one slot of slack: the oldest slot may be mid-rewrite.
+            self._skip_to(ws - self.slots + 1)
+
+        frames: List[CaptureFrame] = []
+        buf = self.buf
+        end = min(ws, self.cursor + max_frames)
+        n = self.cursor + 1
+        while n <= end:
+            off = self.slots_offset + ((n - 1) & self.mask) * SLOT_SIZE
+            tag = SLOT_TAG.unpack_from(buf, off)[0]
+            ts_us, can_id, dlc, flags, data = RECORD.unpack_from(buf, off + SLOT_TAG.size)
+            if tag != n or SLOT_TAG.unpack_from(buf, off)[0] != n:
+                # Overwritten under us: resync just behind the publisher.
+                self._skip_to(max(n, self.write_seq() - self.slots + 1))
+                n = self.cursor + 1
+                end = min(self.write_seq(), self.cursor + max_frames)
+                continue
+            frames.append(CaptureFrame(ts_us, can_id, dlc, data[:dlc], flags))
+            self.cursor = n
+            n += 1
+
+        if frames:
+            self._update_entry()
+        return frames
+
+    def poll(self, timeout: Optional[float] = None, max_frames: int = 4096) -> List[CaptureFrame]:
+        """Like read_batch() but sleeps (IDLE_SLEEP_SEC steps) until frames arrive."""
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while True:
+            frames = self.read_batch(max_frames)
+            if frames or (deadline is not None and time.monotonic() >= deadline):
+                return frames
+            time.sleep(IDLE_SLEEP_SEC)
+
+    def close(self) -> None:
+        CONSUMER.pack_into(self.buf, HEADER_SIZE + self.index * CONSUMER_SIZE, 0, 0, 0, 0, 0)
+        self.buf = None
+        self.shm.close()
+
+
+def _to_capture(msg) -> CaptureFrame:  # noqa: ANN001 - can.Message
+    can_id = msg.arbitration_id
+    if msg.is_extended_id:
+        can_id |= CAN_EFF_FLAG
+    if msg.is_remote_frame:
+        can_id |= CAN_RTR_FLAG
+    flags = FLAG_HOST_TS | (0 if msg.is_rx else FLAG_TX)
+    return CaptureFrame(int(msg.timestamp * 1e6), can_id, msg.dlc, bytes(msg.data), flags)
+
+
+def run_publisher(args: argparse.Namespace) -> None:
+    import can
+
+    ring = FrameRingPublisher(args.name, args.slots, args.consumers)
+    bus = can.Bus(interface="socketcan", channel=args.channel, receive_own_messages=args.own)
+    running = True
+
+    def _signal_handler(sig, frame):  # noqa: ANN001, D401 - signal signature
+        del sig, frame
+        nonlocal running
+        running = False
+
+    signal.signal(signal.SIGINT, _signal_handler)
+    signal.signal(signal.SIGTERM, _signal_handler)
+
+    print(f"Publishing {args.channel} to /dev/shm/{args.name} ({args.slots} slots)")
+    next_report = time.monotonic() + REPORT_PERIOD_SEC
+    while running:
+        msg = bus.recv(timeout=0.5)
+        if msg is not None and not msg.is_error_frame:
+            ring.publish(_to_capture(msg))
+        now = time.monotonic()
+        if now >= next_report:
+            print(ring.report(), file=sys.stderr)
+            next_report = now + REPORT_PERIOD_SEC
+
+    print(ring.report(), file=sys.stderr)
+    bus.shutdown()
+    ring.close()
+
+
+def run_consumer(args: argparse.Namespace) -> None:
+    from capture_codec import format_frame
+
+    reader = FrameRingReader(args.name, from_start=args.from_start)
+    writer = CaptureWriter(open(args.output, "wb")) if args.command == "record" else None
+    try:
+        while True:
+            for frame in reader.poll(timeout=1.0):
+                if writer is not None:
+                    writer.write(frame)
+                else:
+                    print(format_frame(frame))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if writer is not None:
+            writer.flush()
+            writer.fp.close()
+        print(f"cursor={reader.cursor} overruns={reader.overruns} lost={reader.lost}", file=sys.stderr)
+        reader.close()
+
+
+def run_stats(args: argparse.Namespace) -> None:
+    shm = _attach(args.name)
+    ring = _Ring(shm)
+    ws = ring.write_seq()
+    print(f"ring {args.name}: publisher pid {ring.publisher_pid} slots={ring.slots} frames={ws}")
+    for i in range(ring.max_consumers):
+        pid, _, cursor, overruns, lost = ring.consumer(i)
+        if pid:
+            state = "" if _pid_alive(pid) else " (dead)"
+            print(f"  consumer {i}: pid {pid}{state} lag={ws - cursor} overruns={overruns} lost={lost}")
+    shm.close()
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Shared-memory CAN frame ring")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    pub = sub.add_parser("publish", help="receive from SocketCAN into the ring")
+    pub.add_argument("--channel", default="can0")
+    pub.add_argument("--slots", type=int, default=DEFAULT_SLOTS, help="power of two")
+    pub.add_argument("--consumers", type=int, default=DEFAULT_CONSUMERS)
+    pub.add_argument("--own", action="store_true", help="also publish our own TX echoes")
+
+    for cmd in ("dump", "record"):
+        p = sub.add_parser(cmd, help="list frames" if cmd == "dump" else "write a CANCAP1 file")
+        p.add_argument("--from-start", action="store_true", help="replay what is still in the ring")
+        if cmd == "record":
+            p.add_argument("-o", "--output", required=True)
+
+    sub.add_parser("stats", help="show publisher and consumer lag")
+
+    for p in sub.choices.values():
+        p.add_argument("--name", default=DEFAULT_NAME, help="shared memory name")
+    args = parser.parse_args()
+
+    if args.command == "publish":
+        run_publisher(args)
+    elif args.command == "stats":
+        run_stats(args)
+    else:
+        run_consumer(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""
+Mergeable log-linear latency histograms (same layout as src/histogram.cpp).
+
+Values below 2**SUB_BITS get one bucket each; every octave above is split
+into 2**SUB_BITS equal buckets, so any two histograms merge exactly by adding
+bucket counts and fleet-wide percentiles come out the same as if all samples
+had been recorded in one place (to the bucket resolution, < 1/32 relative).
+
+Wire format (telemetry TYPE_HISTOGRAM and .telrec archives):
+  VERSION(u8) SERIES(u8) SUB_BITS(u8) MAX_BITS(u8) MIN(varint) MAX(varint)
+  { INDEX_DELTA(varint) COUNT(varint) }...   non-empty buckets only
+
+The ESP sends one interval histogram per 10 s report; the Pi runner writes
+the same records for its own RTT with --hist-out. Merge any number of
+archives (all records of a series are added up):
+  python3 pi/histogram.py node-*.telrec pi-*.telrec
+  python3 pi/histogram.py --series esp_rtt --per-file run*/node.telrec
+"""
+
+import argparse
+import math
+import sys
+from typing import Dict, Iterable, List, Optional, Tuple
+
+from telemetry import MAX_PAYLOAD, TYPE_HISTOGRAM, read_record_file
+
+VERSION = 1
+SUB_BITS = 5
+MAX_BITS = 24
+SUB_COUNT = 1 << SUB_BITS
+BUCKETS = SUB_COUNT * (1 + MAX_BITS - SUB_BITS)
+
+SERIES_ESP_RTT = 1  # ESP-initiated ping RTT, measured on the ESP
+SERIES_PI_RTT = 2   # Pi-initiated ping RTT, measured on the Pi
+SERIES_NAMES = {SERIES_ESP_RTT: "esp_rtt", SERIES_PI_RTT: "pi_rtt"}
+
+REPORT_PERCENTILES = (50.0, 90.0, 99.0, 99.9, 99.99)
+
+
+def index_of(value: int) -> int:
+    if value < SUB_COUNT:
+        return value
+    msb = value.bit_length() - 1
+    if msb >= MAX_BITS:
+        return BUCKETS - 1
+    octave = msb - SUB_BITS
+    return SUB_COUNT + octave * SUB_COUNT + ((value >> octave) - SUB_COUNT)
+
+
+def highest_equivalent(index: int) -> int:
+    if index < SUB_COUNT:
+        return index
+    octave = index // SUB_COUNT - 1
+    low = (SUB_COUNT + index % SUB_COUNT) << octave
+    return low + (1 << octave) - 1
+
+
+def _put_varint(out: bytearray, v: int) -> None:
+    while v >= 0x80:
+        out.append((v & 0x7F) | 0x80)
+        v >>= 7
+    out.append(v)
+
+
+def _get_varint(data: bytes, pos: int) -> Tuple[int, int]:
+    v = shift = 0
+    while True:
+        if pos >= len(data):
+            raise ValueError("truncated varint")
+        b = data[pos]
+        pos += 1
+        v |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return v, pos
+        shift += 7
+
+
+class LatencyHistogram:
+    def __init__(self) -> None:
+        self.counts: Dict[int, int] = {}  # sparse: bucket index -> count
+        self.total = 0
+        self.min: Optional[int] = None
+        self.max = 0
+
+    def record(self, value: int) -> None:
+        value = int(value)
+        i = index_of(value)
+        self.counts[i] = self.counts.get(i, 0) + 1
+        self.total += 1
+        self.min = value if self.min is None else min(self.min, value)
+        self.max = max(self.max, value)
+
+    def merge(self, other: "LatencyHistogram") -> None:
+        for i, c in other.counts.items():
+            self.counts[i] = self.counts.get(i, 0) + c
+        self.total += other.total
+        if other.min is not None:
+            self.min = other.min if self.min is None else min(self.min, other.min)
+        self.max = max(self.max, other.max)
+
+    def value_at_percentile(self, percentile: float) -> int:
+        if self.total == 0:
+            return 0
+        rank = min(max(math.ceil(percentile * self.total / 100.0), 1), self.total)
+        seen = 0
+        for i in sorted(self.counts):
+            seen += self.counts[i]
+            if seen >= rank:
+                return min(highest_equivalent(i), self.max)
+        return self.max
+
+    def encode(self, series: int, max_payload: int = MAX_PAYLOAD) -> List[bytes]:
+        """Splits into self-contained records of at most max_payload bytes."""
+        header = bytearray([VERSION, series, SUB_BITS, MAX_BITS])
+        _put_varint(header, self.min if self.min is not None else 0)
+        _put_varint(header, self.max)
+
+        chunks: List[bytes] = []
+        body = bytearray(header)
+        nxt = 0
+        for i in sorted(self.counts):
+            if len(body) + 3 + 5 > max_payload:
+                chunks.append(bytes(body))
+                body, nxt = bytearray(header), 0
+            _put_varint(body, i - nxt)
+            _put_varint(body, self.counts[i])
+            nxt = i + 1
+        chunks.append(bytes(body))
+        return chunks
+
+
+def decode(payload: bytes) -> Tuple[int, LatencyHistogram]:
+    """Returns (series, partial histogram) for one record."""
+    if len(payload) < 4:
+        raise ValueError("histogram record too short")
+    version, series, sub_bits, max_bits = payload[:4]
+    if version != VERSION or sub_bits != SUB_BITS or max_bits != MAX_BITS:
+        raise ValueError(f"unsupported histogram layout v{version} {sub_bits}/{max_bits}")
+
+    hist = LatencyHistogram()
+    lo, pos = _get_varint(payload, 4)
+    hist.max, pos = _get_varint(payload, pos)
+    nxt = 0
+    while pos < len(payload):
+        delta, pos = _get_varint(payload, pos)
+        count, pos = _get_varint(payload, pos)
+        i = nxt + delta
+        if i >= BUCKETS:
+            raise ValueError("histogram bucket out of range")
+        hist.counts[i] = hist.counts.get(i, 0) + count
+        hist.total += count
+        nxt = i + 1
+    hist.min = lo if hist.total else None
+    return series, hist
+
+
+def merge_files(paths: Iterable[str]) -> Dict[str, Dict[int, LatencyHistogram]]:
+    """Returns {path: {series: merged histogram}}."""
+    result: Dict[str, Dict[int, LatencyHistogram]] = {}
+    for path in paths:
+        per_series: Dict[int, LatencyHistogram] = {}
+        with open(path, "rb") as fp:
+            for rec in read_record_file(fp):
+                if rec.rtype != TYPE_HISTOGRAM:
+                    continue
+                try:
+                    series, hist = decode(rec.payload)
+                except ValueError as exc:
+                    print(f"{path}: skipping record: {exc}", file=sys.stderr)
+                    continue
+                per_series.setdefault(series, LatencyHistogram()).merge(hist)
+        result[path] = per_series
+    return result
+
+
+def format_row(label: str, hist: LatencyHistogram) -> str:
+    cells = " ".join(f"{hist.value_at_percentile(p):>9}" for p in REPORT_PERCENTILES)
+    return f"{label:<28} {hist.total:>10} {cells} {hist.max:>9}"
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Merge latency histograms from TELREC1 archives")
+    parser.add_argument("files", nargs="+", help=".telrec archives")
+    parser.add_argument("--series", choices=sorted(SERIES_NAMES.values()),
+                        help="only this series (default: all)")
+    parser.add_argument("--per-file", action="store_true", help="also print each file")
+    args = parser.parse_args()
+
+    per_file = merge_files(args.files)
+    fleet: Dict[int, LatencyHistogram] = {}
+    for per_series in per_file.values():
+        for series, hist in per_series.items():
+            fleet.setdefault(series, LatencyHistogram()).merge(hist)
+
+    pct = " ".join(f"{'p' + format(p, 'g'):>9}" for p in REPORT_PERCENTILES)
+    print(f"{'series (us)':<28} {'count':>10} {pct} {'max':>9}")
+    for series in sorted(fleet):
+        name = SERIES_NAMES.get(series, f"series{series}")
+        if args.series and name != args.series:
+            continue
+        if args.per_file:
+            for path, per_series in per_file.items():
+                if series in per_series:
+                    print(format_row(f"  {path}", per_series[series]))
+        print(format_row(f"{name} (merged)", fleet[series]))
+
+
+if __name__ == "__main__":
+    main()
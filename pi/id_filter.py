@@ -0,0 +1,279 @@
+#!/usr/bin/env python3
+"""
+Userspace CAN ID classifier for thousands of ID/mask rules.
+
+Kernel CAN_RAW_FILTER lists are scanned linearly per frame. Here the rules
+are compiled once:
+
+  11-bit  a 2048-entry table holding, for every standard ID, the index of
+          the first matching rule (each rule enumerates only the IDs its
+          mask leaves free)
+  29-bit  rules grouped by mask; each group is a hash (or, for batches, a
+          sorted key array behind a 64 Kibit presence bitmap) from id & mask
+          to the first rule index, so a frame costs one lookup per distinct
+          mask, not one per rule
+
+A frame's class is the first matching rule in file order, like a firewall;
+-1 means no rule matched. classify_batch() vectorises both paths with numpy
+when it is installed (`sudo apt install -y python3-numpy`): a table gather
+for 11-bit IDs; per mask group a bitmap gather that rejects most frames,
+then searchsorted for the few candidates.
+
+Rules file, one per line (# comments), IDs in hex like candump filters; an
+8-digit ID is extended:
+  <label> <can_id>:<can_mask>
+  engine  0CF00400:1FFFFF00
+  ping    123:7FF
+
+Usage:
+  python3 pi/id_filter.py rules.txt run.cancap      # frames per label
+  python3 pi/id_filter.py --bench --rules 5000      # ns per frame
+"""
+
+import argparse
+import random
+import sys
+import time
+from typing import Dict, List, NamedTuple, Optional, Sequence
+
+from capture_file import CAN_EFF_FLAG, read_capture
+
+try:
+    import numpy as np
+except ImportError:  # per-frame path still works
+    np = None
+
+SFF_MASK = 0x7FF
+EFF_MASK = 0x1FFFFFFF
+NO_MATCH = -1
+
+PRESENCE_BITS = 16  # per-mask-group prefilter: 64 Ki flags, fits in L2
+HASH_MULT = 2654435761
+
+
+def _presence_slot(keys):
+    """Multiplicative hash of uint32 keys to PRESENCE_BITS bits (numpy)."""
+    return (keys * np.uint32(HASH_MULT)) >> np.uint32(32 - PRESENCE_BITS)
+
+
+class Rule(NamedTuple):
+    label: str
+    can_id: int
+    mask: int
+    extended: bool
+
+
+def parse_rules(lines: Sequence[str]) -> List[Rule]:
+    rules = []
+    for lineno, line in enumerate(lines, 1):
+        line = line.split("#", 1)[0].strip()
+        if not line:
+            continue
+        try:
+            label, spec = line.split()
+            can_id, mask = spec.split(":")
+        except ValueError:
+            raise ValueError(f"line {lineno}: expected '<label> <can_id>:<can_mask>'") from None
+        extended = len(can_id) == 8
+        limit = EFF_MASK if extended else SFF_MASK
+        rules.append(Rule(label, int(can_id, 16) & limit, int(mask, 16) & limit, extended))
+    return rules
+
+
+class _MaskGroup:
+    def __init__(self, mask: int):
+        self.mask = mask
+        self.first: Dict[int, int] = {}  # id & mask -> first rule index
+        self.min_rule = sys.maxsize
+        self.keys = None                 # numpy views for classify_batch
+        self.rule_of_key = None
+        self.presence = None
+
+    def add(self, key: int, rule: int) -> None:
+        self.first.setdefault(key, rule)
+        self.min_rule = min(self.min_rule, rule)
+
+
+class IdFilter:
+    def __init__(self, rules: Sequence[Rule]):
+        self.rules = list(rules)
+        self.sff = [NO_MATCH] * (SFF_MASK + 1)
+        groups: Dict[int, _MaskGroup] = {}
+
+        for index, rule in enumerate(self.rules):
+            if rule.extended:
+                group = groups.setdefault(rule.mask, _MaskGroup(rule.mask))
+                group.add(rule.can_id & rule.mask, index)
+                continue
+            base = rule.can_id & rule.mask
+            free = ~rule.mask & SFF_MASK
+            sub = free
+            while True:  # every ID the mask leaves free
+                if self.sff[base | sub] == NO_MATCH:
+                    self.sff[base | sub] = index
+                if sub == 0:
+                    break
+                sub = (sub - 1) & free
+
+        # Groups holding low rule numbers first: later groups cannot win once
+        # a match beats their best rule.
+        self.eff_groups = sorted(groups.values(), key=lambda g: g.min_rule)
+        self._sff_np = None
+        if np is not None:
+            self._sff_np = np.array(self.sff, dtype=np.int32)
+            for g in self.eff_groups:
+                keys = np.array(sorted(g.first), dtype=np.uint32)
+                g.keys = keys
+                g.rule_of_key = np.array([g.first[int(k)] for k in keys], dtype=np.int32)
+                g.presence = np.zeros(1 << PRESENCE_BITS, dtype=bool)
+                g.presence[_presence_slot(keys)] = True
+
+    def classify(self, can_id: int) -> int:
+        """First matching rule index for a linux/can.h can_id, or -1."""
+        if not can_id & CAN_EFF_FLAG:
+            return self.sff[can_id & SFF_MASK]
+        raw = can_id & EFF_MASK
+        best = sys.maxsize
+        for g in self.eff_groups:
+            if g.min_rule >= best:
+                break
+            rule = g.first.get(raw & g.mask)
+            if rule is not None and rule < best:
+                best = rule
+        return NO_MATCH if best == sys.maxsize else best
+
+    def classify_batch(self, can_ids: Sequence[int]) -> List[int]:
+        if np is None:
+            return [self.classify(i) for i in can_ids]
+        return self.classify_array(np.asarray(can_ids, dtype=np.uint32)).tolist()
+
+    def classify_array(self, ids):
+        """numpy uint32 array in, int32 rule indices out."""
+        eff = (ids & CAN_EFF_FLAG) != 0
+        result = self._sff_np[ids & SFF_MASK]
+        if not self.eff_groups or not eff.any():
+            return np.where(eff, NO_MATCH, result)
+
+        raw = ids[eff] & EFF_MASK
+        best = np.full(raw.shape, np.iinfo(np.int32).max, dtype=np.int32)
+        for g in self.eff_groups:
+            key = raw & np.uint32(g.mask)
+            cand = np.flatnonzero(g.presence[_presence_slot(key)])
+            if not len(cand):
+                continue
+            ckey = key[cand]
+            pos = np.searchsorted(g.keys, ckey)
+            pos[pos == len(g.keys)] = 0
+            hit = g.keys[pos] == ckey
+            cand, pos = cand[hit], pos[hit]
+            best[cand] = np.minimum(best[cand], g.rule_of_key[pos])
+        result[eff] = np.where(best == np.iinfo(np.int32).max, NO_MATCH, best)
+        return result
+
+    def linear(self, can_id: int) -> int:
+        """Reference: what a CAN_RAW_FILTER-style scan does per frame."""
+        extended = bool(can_id & CAN_EFF_FLAG)
+        raw = can_id & (EFF_MASK if extended else SFF_MASK)
+        for index, rule in enumerate(self.rules):
+            if rule.extended == extended and (raw & rule.mask) == rule.can_id & rule.mask:
+                return index
+        return NO_MATCH
+
+
+def random_rules(count: int, seed: int = 1) -> List[Rule]:
+    rng = random.Random(seed)
+    eff_masks = [0x1FFFFFFF, 0x1FFFFF00, 0x03FFFF00, 0x1FF00000, 0x00FFFF00]
+    rules = []
+    for i in range(count):
+        if rng.random() < 0.3:
+            mask = rng.choice((0x7FF, 0x7FF, 0x7F0, 0x700))
+            rules.append(Rule(f"s{i}", rng.randrange(0x800) & mask, mask, False))
+        else:
+            mask = rng.choice(eff_masks)
+            rules.append(Rule(f"e{i}", rng.randrange(1 << 29) & mask, mask, True))
+    return rules
+
+
+def random_ids(rules: Sequence[Rule], count: int, seed: int = 2) -> List[int]:
+    """Half the IDs hit a random rule, half are random."""
+    rng = random.Random(seed)
+    ids = []
+    for _ in range(count):
+        if rng.random() < 0.5:
+            r = rng.choice(rules)
+            limit = EFF_MASK if r.extended else SFF_MASK
+            raw = (r.can_id & r.mask) | (rng.randrange(limit + 1) & ~r.mask & limit)
+            ids.append(raw | (CAN_EFF_FLAG if r.extended else 0))
+        elif rng.random() < 0.5:
+            ids.append(rng.randrange(SFF_MASK + 1))
+        else:
+            ids.append(rng.randrange(EFF_MASK + 1) | CAN_EFF_FLAG)
+    return ids
+
+
+def bench(rule_count: int, frame_count: int) -> None:
+    rules = random_rules(rule_count)
+    t0 = time.perf_counter()
+    flt = IdFilter(rules)
+    compile_ms = (time.perf_counter() - t0) * 1e3
+    ids = random_ids(rules, frame_count)
+    print(f"rules={rule_count} (eff mask groups={len(flt.eff_groups)}) compile_ms={compile_ms:.0f}")
+
+    sample = ids[:max(frame_count // 100, 100)]
+    t0 = time.perf_counter()
+    expected = [flt.linear(i) for i in sample]
+    linear_ns = (time.perf_counter() - t0) * 1e9 / len(sample)
+
+    t0 = time.perf_counter()
+    per_frame = [flt.classify(i) for i in ids]
+    frame_ns = (time.perf_counter() - t0) * 1e9 / len(ids)
+    if per_frame[:len(sample)] != expected:
+        sys.exit("classify() disagrees with the linear scan")
+    print(f"BENCH linear_scan ns_per_frame={linear_ns:.0f}")
+    print(f"BENCH compiled    ns_per_frame={frame_ns:.0f}")
+
+    if np is not None:
+        arr = np.asarray(ids, dtype=np.uint32)
+        t0 = time.perf_counter()
+        batched = flt.classify_array(arr)
+        batch_ns = (time.perf_counter() - t0) * 1e9 / len(ids)
+        if batched.tolist() != per_frame:
+            sys.exit("classify_array() disagrees with classify()")
+        print(f"BENCH batch_numpy ns_per_frame={batch_ns:.1f}")
+    else:
+        print("BENCH batch_numpy unavailable (no numpy)")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Classify CAN IDs with compiled ID/mask rules")
+    parser.add_argument("rules", nargs="?", help="rules file")
+    parser.add_argument("capture", nargs="?", help="CANCAP1 file to classify")
+    parser.add_argument("--bench", action="store_true", help="time random rules instead")
+    parser.add_argument("--rules", dest="rule_count", type=int, default=5000)
+    parser.add_argument("--frames", type=int, default=200000)
+    args = parser.parse_args()
+
+    if args.bench:
+        bench(args.rule_count, args.frames)
+        return
+    if not args.rules or not args.capture:
+        parser.error("rules file and capture file required (or --bench)")
+
+    with open(args.rules) as fp:
+        try:
+            rules = parse_rules(fp.readlines())
+        except ValueError as exc:
+            sys.exit(f"{args.rules}: {exc}")
+    flt = IdFilter(rules)
+    with open(args.capture, "rb") as fp:
+        ids = [f.can_id for f in read_capture(fp)]
+    counts: Dict[Optional[str], int] = {}
+    for index in flt.classify_batch(ids):
+        label = rules[index].label if index != NO_MATCH else None
+        counts[label] = counts.get(label, 0) + 1
+    for label, n in sorted(counts.items(), key=lambda kv: -kv[1]):
+        print(f"{n:>10}  {label if label is not None else '(unmatched)'}")
+
+
+if __name__ == "__main__":
+    main()
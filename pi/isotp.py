@@ -0,0 +1,215 @@
+"""
+Userspace ISO 15765-2 (ISO-TP) over a python-can bus, classic CAN, normal
+addressing, frames padded to 8 bytes. Same framing as src/isotp.cpp:
+
+  SF  0L dd..      L = 1..7
+  FF  1L LL dd..   12-bit length, 6 data bytes
+  CF  2N dd..      N = sequence number mod 16, first CF is 1
+  FC  3S BS ST     S: 0 continue, 1 wait, 2 overflow
+
+send() honours the receiver's flow control: after the first frame and
+every BS consecutive frames it waits for the next FC, which is the
+receiver's window, and keeps STmin between consecutive frames. Messages
+that arrive meanwhile are queued for recv(). Userspace rather than the
+kernel can-isotp socket so the tools see every flow control frame and
+timestamp; the bus should be opened with a filter on the RX ID.
+
+For response timing, also let the bus echo this side's frames
+(receive_own_messages=True and the TX ID in the filter): tx_echo_time then
+holds the kernel timestamp of the last frame that actually went out, and
+each received message remembers the echo that preceded its first frame.
+"""
+
+import collections
+import time
+from typing import Callable, Deque, Optional, Tuple
+
+import can
+
+SINGLE_MAX = 7
+MESSAGE_MAX = 4095
+PADDING = 0xCC
+
+PCI_SINGLE, PCI_FIRST, PCI_CONSECUTIVE, PCI_FLOW = range(4)
+FC_CONTINUE, FC_WAIT, FC_OVERFLOW = range(3)
+
+N_BS_SEC = 1.0   # max wait for a flow control frame
+N_CR_SEC = 1.0   # max gap between received consecutive frames
+WAIT_MAX = 10    # FC WAIT frames accepted in a row
+
+
+def st_min_seconds(st: int) -> float:
+    if st <= 0x7F:
+        return st / 1000.0
+    if 0xF1 <= st <= 0xF9:
+        return (st - 0xF0) / 10000.0
+    return 0.127  # reserved values mean the maximum
+
+
+class IsoTpError(Exception):
+    pass
+
+
+class IsoTpLink:
+    def __init__(self, bus: can.Bus, tx_id: int, rx_id: int, block_size: int = 0,
+                 st_min: int = 0):
+        self.bus = bus
+        self.tx_id = tx_id
+        self.rx_id = rx_id
+        self.block_size = block_size  # what this side grants a multi-frame sender
+        self.st_min = st_min
+        # (payload, last frame timestamp, first frame timestamp, tx_echo_time then)
+        self.inbox: Deque[Tuple[bytes, float, float, float]] = collections.deque()
+        self.last_tx_time = 0.0   # host time the last frame of a message was sent
+        self.tx_echo_time = 0.0   # bus timestamp of the latest echoed TX frame
+        self.rx_first_time = 0.0  # of the message recv() returned last
+        self.rx_request_end = 0.0
+        self.fc_waits = 0         # FC WAIT frames received
+        self.enobufs = 0          # TX queue full retries
+        self._rx: Optional[bytearray] = None
+        self._rx_len = 0
+        self._rx_sn = 0
+        self._rx_left = 0
+        self._rx_last = 0.0
+        self._rx_first = 0.0
+        self._rx_echo = 0.0
+
+    def _send_frame(self, data: bytes) -> None:
+        msg = can.Message(arbitration_id=self.tx_id, is_extended_id=False,
+                          data=data.ljust(8, bytes([PADDING])))
+        while True:
+            try:
+                self.bus.send(msg)
+                break
+            except can.CanError:
+                self.enobufs += 1  # socket TX queue full (ENOBUFS)
+                time.sleep(0.0002)
+        self.last_tx_time = time.monotonic()
+
+    def _send_fc(self, status: int) -> None:
+        self._send_frame(bytes([(PCI_FLOW << 4) | status, self.block_size, self.st_min]))
+
+    def _on_frame(self, msg: can.Message) -> Optional[Tuple[int, int, int]]:
+        """Handles one received frame. Returns (status, bs, st_min) for a flow
+        control frame; completed messages go to the inbox."""
+        data = bytes(msg.data)
+        if not data:
+            return None
+        pci = data[0] >> 4
+        if pci == PCI_FLOW:
+            if len(data) < 3:
+                return None
+            return data[0] & 0x0F, data[1], data[2]
+        if pci == PCI_SINGLE:
+            n = data[0] & 0x0F
+            if 0 < n <= SINGLE_MAX and n < len(data):
+                self._rx = None
+                self.inbox.append((data[1:1 + n], msg.timestamp, msg.timestamp, self.tx_echo_time))
+        elif pci == PCI_FIRST and len(data) == 8:
+            total = ((data[0] & 0x0F) << 8) | data[1]
+            if total > SINGLE_MAX:
+                self._rx = bytearray(data[2:8])
+                self._rx_len, self._rx_sn, self._rx_left = total, 1, self.block_size
+                self._rx_last = time.monotonic()
+                self._rx_first, self._rx_echo = msg.timestamp, self.tx_echo_time
+                self._send_fc(FC_CONTINUE)
+        elif pci == PCI_CONSECUTIVE and self._rx is not None:
+            if time.monotonic() - self._rx_last > N_CR_SEC or (data[0] & 0x0F) != self._rx_sn:
+                self._rx = None  # timed out or lost a frame: drop the message
+                return None
+            self._rx_sn = (self._rx_sn + 1) & 0x0F
+            self._rx_last = time.monotonic()
+            self._rx += data[1:1 + self._rx_len - len(self._rx)]
+            if len(self._rx) >= self._rx_len:
+                self.inbox.append((bytes(self._rx), msg.timestamp, self._rx_first, self._rx_echo))
+                self._rx = None
+            elif self.block_size:
+                self._rx_left -= 1
+                if self._rx_left == 0:
+                    self._rx_left = self.block_size
+                    self._send_fc(FC_CONTINUE)
+        return None
+
+    def _recv_frame(self, timeout: float) -> Optional[can.Message]:
+        msg = self.bus.recv(timeout)
+        if msg is None or msg.is_extended_id:
+            return None
+        if msg.arbitration_id == self.tx_id and not getattr(msg, "is_rx", True):
+            self.tx_echo_time = msg.timestamp
+            return None
+        if msg.arbitration_id != self.rx_id:
+            return None
+        return msg
+
+    def _wait_fc(self, abort_on: Optional[Callable[[bytes], bool]]) -> Tuple[int, int]:
+        deadline = time.monotonic() + N_BS_SEC
+        waits = 0
+        while True:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                raise IsoTpError("flow control timeout (N_Bs)")
+            msg = self._recv_frame(left)
+            if msg is None:
+                continue
+            queued = len(self.inbox)
+            fc = self._on_frame(msg)
+            if fc is None:
+                if abort_on and len(self.inbox) > queued and abort_on(self.inbox[-1][0]):
+                    raise IsoTpError("receiver answered mid-message")
+                continue
+            status, bs, st = fc
+            if status == FC_CONTINUE:
+                return bs, st
+            if status == FC_WAIT:
+                self.fc_waits += 1
+                waits += 1
+                if waits > WAIT_MAX:
+                    raise IsoTpError("too many flow control WAIT frames")
+                deadline = time.monotonic() + N_BS_SEC
+                continue
+            raise IsoTpError("receiver overflow: message too long")
+
+    def send(self, payload: bytes,
+             abort_on: Optional[Callable[[bytes], bool]] = None) -> None:
+        """Sends one message; raises IsoTpError if the receiver refuses or
+        stops answering. A message arriving mid-send stays queued for recv();
+        if abort_on returns True for it (the receiver gave up on this
+        message), the send is abandoned."""
+        n = len(payload)
+        if n <= SINGLE_MAX:
+            self._send_frame(bytes([(PCI_SINGLE << 4) | n]) + payload)
+            return
+        if n > MESSAGE_MAX:
+            raise ValueError(f"ISO-TP message too long: {n} bytes")
+        self._send_frame(bytes([(PCI_FIRST << 4) | (n >> 8), n & 0xFF]) + payload[:6])
+        pos, sn = 6, 1
+        bs, st = self._wait_fc(abort_on)
+        gap = st_min_seconds(st)
+        left = bs
+        while pos < n:
+            if gap:
+                time.sleep(gap)
+            self._send_frame(bytes([(PCI_CONSECUTIVE << 4) | sn]) + payload[pos:pos + 7])
+            pos += 7
+            sn = (sn + 1) & 0x0F
+            if bs and pos < n:
+                left -= 1
+                if left == 0:
+                    bs, st = self._wait_fc(abort_on)
+                    gap = st_min_seconds(st)
+                    left = bs
+
+    def recv(self, timeout: float) -> Optional[Tuple[bytes, float]]:
+        """Next complete message and the bus timestamp of its last frame; the
+        first frame's timestamp goes to rx_first_time and the echo before it
+        to rx_request_end."""
+        deadline = time.monotonic() + timeout
+        while not self.inbox:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            msg = self._recv_frame(left)
+            if msg is not None:
+                self._on_frame(msg)
+        payload, last, self.rx_first_time, self.rx_request_end = self.inbox.popleft()
+        return payload, last
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Exponentially weighted link quality score (same model as src/link_quality.cpp).
+
+Each component is an EWMA in [0, 1] updated in O(1) per event; the score is
+their weighted sum in permille. The Pi runner scores its own side of the
+link with LinkQuality; ESP nodes send TYPE_LINK_QUALITY telemetry records.
+
+Run as a script to rank links from TELREC1 archives (one per node), worst
+first, using the latest link quality record in each:
+  python3 pi/link_quality.py node-*.telrec
+"""
+
+import struct
+import sys
+from typing import Dict, List, NamedTuple
+
+from telemetry import TYPE_LINK_QUALITY, read_record_file
+
+COMPONENTS = ("delivery", "tx", "rx", "stability", "latency")
+WEIGHTS = (0.35, 0.20, 0.15, 0.15, 0.15)
+
+ALPHA_DELIVERY = 1.0 / 8
+ALPHA_TX = 1.0 / 16
+ALPHA_HEALTH = 1.0 / 64
+ALPHA_RTT = 1.0 / 8
+
+RTT_TARGET_US = 5000
+
+RECORD = struct.Struct("<6H3I")
+
+
+class LinkQuality:
+    def __init__(self) -> None:
+        self.comp: Dict[str, float] = dict.fromkeys(COMPONENTS, 1.0)
+        self.rtt_ewma_us = 0.0
+        self.pings = 0
+        self.failures = 0
+
+    def _ewma(self, name: str, sample: float, alpha: float) -> None:
+        self.comp[name] += alpha * (sample - self.comp[name])
+
+    def on_ping_matched(self, rtt_us: float) -> None:
+        self.pings += 1
+        self._ewma("delivery", 1.0, ALPHA_DELIVERY)
+        if self.rtt_ewma_us == 0.0:
+            self.rtt_ewma_us = float(rtt_us)
+        else:
+            self.rtt_ewma_us += ALPHA_RTT * (rtt_us - self.rtt_ewma_us)
+        self.comp["latency"] = 1.0 if self.rtt_ewma_us <= RTT_TARGET_US else RTT_TARGET_US / self.rtt_ewma_us
+
+    def on_ping_failed(self) -> None:
+        self.pings += 1
+        self.failures += 1
+        self._ewma("delivery", 0.0, ALPHA_DELIVERY)
+
+    def on_tx_result(self, ok: bool) -> None:
+        self._ewma("tx", 1.0 if ok else 0.0, ALPHA_TX)
+
+    def on_health_sample(self, overflow: bool, reinit: bool) -> None:
+        self._ewma("rx", 0.0 if overflow else 1.0, ALPHA_HEALTH)
+        self._ewma("stability", 0.0 if reinit else 1.0, ALPHA_HEALTH)
+
+    def score_permille(self) -> int:
+        return int(sum(w * self.comp[c] for w, c in zip(WEIGHTS, COMPONENTS)) * 1000 + 0.5)
+
+    def summary(self) -> str:
+        parts = " ".join(f"{c}={int(self.comp[c] * 1000 + 0.5)}" for c in COMPONENTS)
+        return f"LINKQ score={self.score_permille()} {parts} rtt_ewma_us={int(self.rtt_ewma_us)}"
+
+
+class LinkQualityRecord(NamedTuple):
+    score: int
+    components: Dict[str, int]
+    rtt_ewma_us: int
+    pings: int
+    failures: int
+
+
+def decode_record(payload: bytes) -> LinkQualityRecord:
+    values = RECORD.unpack_from(payload)
+    return LinkQualityRecord(
+        score=values[0],
+        components=dict(zip(COMPONENTS, values[1:6])),
+        rtt_ewma_us=values[6],
+        pings=values[7],
+        failures=values[8],
+    )
+
+
+def main() -> None:
+    if len(sys.argv) < 2:
+        print(__doc__.strip())
+        sys.exit(1)
+
+    rows: List = []
+    for path in sys.argv[1:]:
+        latest = None
+        with open(path, "rb") as fp:
+            for rec in read_record_file(fp):
+                if rec.rtype == TYPE_LINK_QUALITY and len(rec.payload) >= RECORD.size:
+                    latest = decode_record(rec.payload)
+        if latest is None:
+            print(f"{path}: no link quality records", file=sys.stderr)
+            continue
+        rows.append((latest.score, path, latest))
+
+    rows.sort(key=lambda r: r[0])
+    header = f"{'score':>6} " + " ".join(f"{c:>9}" for c in COMPONENTS) + f" {'rtt_us':>8} {'fail/pings':>12}  link"
+    print(header)
+    for score, path, rec in rows:
+        comps = " ".join(f"{rec.components[c]:>9}" for c in COMPONENTS)
+        print(f"{score:>6} {comps} {rec.rtt_ewma_us:>8} {rec.failures:>5}/{rec.pings:<6}  {path}")
+
+
+if __name__ == "__main__":
+    main()
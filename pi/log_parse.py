@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""
+Convert archived ESP serial text logs (`pio device monitor` output) into a
+CANCAP1 capture file and a JSON stats summary.
+
+The log is memory-mapped and scanned with a single compiled regex, so lines
+are never copied unless they match; multi-GB archives stream at disk speed.
+
+Timestamps: a `pio device monitor --filter time` prefix (HH:MM:SS.mmm > ) is
+used when present. Otherwise time is reconstructed from the ESP's 1 Hz PING
+cadence and every frame carries FLAG_TEXT_LOG to mark it as approximate.
+
+Usage:
+  python3 pi/log_parse.py monitor.log -o run.cancap -s run.json
+"""
+
+import argparse
+import json
+import mmap
+import re
+import sys
+from collections import Counter
+from typing import Dict, List, Optional
+
+from capture_file import CAN_EFF_FLAG, FLAG_TEXT_LOG, FLAG_TX, CaptureFrame, CaptureWriter
+
+PING_PERIOD_US = 1_000_000  # ESP ping cadence (PING_PERIOD_MS)
+
+LINE_RE = re.compile(
+    rb"^(?:(?P<hh>\d\d):(?P<mm>\d\d):(?P<ss>\d\d)\.(?P<ms>\d{3}) > )?"
+    rb"(?:"
+    rb"(?P<frame>TX PING \(ESP->Pi\)|TX PONG \(ESP->Pi\)|RX) ID=0x(?P<id>[0-9A-Fa-f]+)"
+    rb" DLC=(?P<dlc>\d+) DATA=(?P<data>[0-9A-Fa-f ]*)"
+    rb"|(?P<match>MATCHED|MISMATCH) (?P<mwhat>[^\r\n]*)"
+    rb"|Send error: (?P<senderr>-?\d+)"
+    rb"|(?P<event>Bus-off detected|RX overflow detected|Error-passive persists"
+    rb"|Too many send errors|Activity timeout with errors|Warning: error warning flag set"
+    rb"|MCP2515 ready|setBitrate failed|setNormalMode failed|Fatal: cannot initialize"
+    rb"|ESP32-S3 MCP2515 CAN Ping-Pong)"
+    rb"[^\r\n]*"
+    rb")\r?$",
+    re.M,
+)
+
+EVENT_NAMES = {
+    b"Bus-off detected": "bus_off",
+    b"RX overflow detected": "rx_overflow",
+    b"Error-passive persists": "error_passive",
+    b"Too many send errors": "send_error_reinit",
+    b"Activity timeout with errors": "activity_timeout",
+    b"Warning: error warning flag set": "ewarn",
+    b"MCP2515 ready": "can_ready",
+    b"setBitrate failed": "init_failed",
+    b"setNormalMode failed": "init_failed",
+    b"Fatal: cannot initialize": "fatal",
+    b"ESP32-S3 MCP2515 CAN Ping-Pong": "boot",
+}
+
+PI_PING_ID = 0x223
+
+
+class LogStats:
+    def __init__(self) -> None:
+        self.frames = Counter()
+        self.matches = Counter()
+        self.events = Counter()
+        self.send_errors = Counter()
+        self.timeline: List[Dict] = []
+        self.per_minute: Dict[int, Counter] = {}
+        self.esp_pings = 0
+        self.pi_pings_rx = 0
+        self.rejected = 0  # frame lines with a corrupt ID, DLC or DATA field
+
+    def bucket(self, ts_us: int) -> Counter:
+        minute = ts_us // 60_000_000
+        b = self.per_minute.get(minute)
+        if b is None:
+            b = self.per_minute[minute] = Counter()
+        return b
+
+    def note_event(self, ts_us: int, offset: int, name: str, detail: str = "") -> None:
+        self.events[name] += 1
+        self.bucket(ts_us)[name] += 1
+        self.timeline.append({"ts_s": ts_us / 1e6, "offset": offset, "event": name, "detail": detail})
+
+    def to_json(self, source: str, size: int, records: int, timed: bool) -> Dict:
+        def rate(ok: int, total: int) -> Optional[float]:
+            return round(ok / total, 6) if total else None
+
+        esp_ok = self.matches["MATCHED (ESP-initiated)"]
+        esp_bad = self.matches["MISMATCH (ESP-initiated)"]
+        pi_ok = self.matches["MATCHED (Pi->ESP PING)"]
+        pi_bad = self.matches["MISMATCH pattern from Pi"]
+        return {
+            "source": source,
+            "format": "esp-text-log",
+            "timestamps": "monitor" if timed else "reconstructed",
+            "bytes": size,
+            "records": records,
+            "rejected": self.rejected,
+            "frames": dict(self.frames),
+            "esp_initiated": {
+                "pings": self.esp_pings,
+                "matched": esp_ok,
+                "mismatched": esp_bad,
+                "lost": max(self.esp_pings - esp_ok - esp_bad, 0),
+                "match_rate": rate(esp_ok, self.esp_pings),
+            },
+            "pi_initiated": {
+                "pings_rx": self.pi_pings_rx,
+                "matched": pi_ok,
+                "mismatched": pi_bad,
+                "match_rate": rate(pi_ok, self.pi_pings_rx),
+            },
+            "send_errors": {str(k): v for k, v in self.send_errors.items()},
+            "events": dict(self.events),
+            "per_minute": [
+                {"minute": m, **dict(c)} for m, c in sorted(self.per_minute.items())
+            ],
+            "timeline": self.timeline,
+        }
+
+
+def parse_log(buf, stats: LogStats, writer: Optional[CaptureWriter]):
+    """Scan `buf` (bytes or mmap); returns (recognised_lines, timed).
+
+    Timeline entries carry byte offsets into the log rather than line numbers
+    so the scan never has to touch unmatched text.
+    """
+    ping_base_us = 0
+    seq_in_ping = 0
+    day_offset_us = 0
+    last_clock_us = -1
+    timed = False
+    matched = 0
+
+    for m in LINE_RE.finditer(buf):
+        matched += 1
+
+        if m.group("hh") is not None:
+            timed = True
+            clock_us = ((int(m.group("hh")) * 60 + int(m.group("mm"))) * 60 +
+                        int(m.group("ss"))) * 1_000_000 + int(m.group("ms")) * 1000
+            if clock_us + 43_200_000_000 < last_clock_us:
+                day_offset_us += 86_400_000_000  # monitor clock wrapped at midnight
+            last_clock_us = clock_us
+            ts_us = day_offset_us + clock_us
+        else:
+            ts_us = ping_base_us + seq_in_ping
+            seq_in_ping += 1
+
+        kind = m.group("frame")
+        if kind is not None:
+            can_id = int(m.group("id"), 16)
+            dlc = int(m.group("dlc"))
+            try:
+                data = bytes.fromhex(m.group("data").decode())
+            except ValueError:
+                data = None  # odd digit count from a garbled line
+            if data is None or dlc > 8 or len(data) != dlc or can_id > 0x1FFFFFFF:
+                stats.rejected += 1
+                continue
+            if can_id > 0x7FF:
+                can_id |= CAN_EFF_FLAG
+            tx = kind != b"RX"
+            stats.frames["tx" if tx else "rx"] += 1
+            stats.bucket(ts_us)["frames"] += 1
+
+            if kind.startswith(b"TX PING"):
+                stats.esp_pings += 1
+                if m.group("hh") is None:
+                    ping_base_us += PING_PERIOD_US
+                    ts_us = ping_base_us
+                    seq_in_ping = 1
+            elif not tx and (can_id & 0x1FFFFFFF) == PI_PING_ID:
+                stats.pi_pings_rx += 1
+
+            if writer is not None:
+                flags = FLAG_TEXT_LOG | (FLAG_TX if tx else 0)
+                writer.write(CaptureFrame(ts_us, can_id, dlc, data, flags))
+            continue
+
+        if m.group("match") is not None:
+            label = (m.group("match") + b" " + m.group("mwhat")).decode(errors="replace")
+            stats.matches[label] += 1
+            if m.group("match") == b"MISMATCH":
+                stats.bucket(ts_us)["mismatch"] += 1
+            continue
+
+        if m.group("senderr") is not None:
+            code = int(m.group("senderr"))
+            stats.send_errors[code] += 1
+            stats.note_event(ts_us, m.start(), "send_error", str(code))
+            continue
+
+        name = EVENT_NAMES[m.group("event")]
+        stats.note_event(ts_us, m.start(), name)
+
+    return matched, timed
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Parse ESP serial text logs")
+    parser.add_argument("log", help="pio device monitor output")
+    parser.add_argument("-o", "--capture", help="write CANCAP1 capture file")
+    parser.add_argument("-s", "--stats", help="write JSON stats (default: stdout)")
+    args = parser.parse_args()
+
+    stats = LogStats()
+    writer = CaptureWriter(open(args.capture, "wb")) if args.capture else None
+
+    with open(args.log, "rb") as fp:
+        try:
+            buf = mmap.mmap(fp.fileno(), 0, access=mmap.ACCESS_READ)
+        except ValueError:
+            buf = b""  # empty file cannot be mapped
+        size = len(buf)
+        matched, timed = parse_log(buf, stats, writer)
+
+    if writer is not None:
+        writer.flush()
+
+    doc = stats.to_json(args.log, size, matched, timed)
+    if args.stats:
+        with open(args.stats, "w") as out:
+            json.dump(doc, out, indent=1)
+    else:
+        json.dump(doc, sys.stdout, indent=1)
+        print()
+
+    print(f"bytes={size} recognised={matched} frames={sum(stats.frames.values())} "
+          f"rejected={stats.rejected}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""
+ESP-measured RTT: Python PONG echo vs. kernel cangw reflector.
+
+Runs the normal ping-pong runner and alternates, every --phase-seconds,
+between echoing ESP PINGs from Python (_handle_rx) and a cangw ID-rewrite
+rule (pi/cangw.py). Meanwhile it reads the ESP's serial port and assigns the
+node's 10 s RTT reports to the phase they were measured in; the first report
+after each switch straddles both paths and is dropped.
+
+With a telemetry build (CAN_TELEMETRY=1) the ESP's histogram records are
+merged per phase, giving exact percentiles. Otherwise the RTTH text lines
+are used: percentiles are then count-weighted means of the 10 s values
+(marked ~).
+
+Needs root for cangw and pyserial for the ESP port. The runner's own log
+goes to /dev/null; progress and results are printed to stderr.
+
+Usage:
+  sudo python3 pi/reflector_bench.py /dev/ttyACM0 --rounds 3 --phase-seconds 60
+"""
+
+import argparse
+import contextlib
+import os
+import re
+import sys
+import threading
+import time
+from typing import Dict, List, Tuple
+
+import serial
+
+from can_ping_pong import PingPongRunner
+from histogram import SERIES_ESP_RTT, LatencyHistogram, decode
+from telemetry import TYPE_HISTOGRAM, TelemetryDemux
+
+PHASES = ("python", "kernel")
+ESP_REPORT_SEC = 10.0  # METRICS_REPORT_MS on the node
+SETTLE_SEC = ESP_REPORT_SEC + 1.0
+
+RTTH_RE = re.compile(rb"RTTH n=(\d+) p50=(\d+) p90=(\d+) p99=(\d+) p999=(\d+) max=(\d+)")
+
+
+class PhaseStats:
+    def __init__(self) -> None:
+        self.hist = LatencyHistogram()
+        self.lines: List[Tuple[int, ...]] = []  # RTTH (n, p50, p90, p99, p999, max)
+
+    def row(self, name: str) -> str:
+        if self.hist.total:
+            h = self.hist
+            cells = [h.value_at_percentile(p) for p in (50.0, 90.0, 99.0, 99.9)]
+            return (f"{name:<8} {h.total:>8} " + " ".join(f"{v:>8}" for v in cells) +
+                    f" {h.max:>8}")
+        n = sum(line[0] for line in self.lines)
+        if not n:
+            return f"{name:<8} {0:>8}"
+        cells = [sum(line[0] * line[1 + i] for line in self.lines) / n for i in range(4)]
+        return (f"{name:<8} {n:>8} " + " ".join(f"{'~%.0f' % v:>8}" for v in cells) +
+                f" {max(line[5] for line in self.lines):>8}")
+
+
+class ReflectorBench:
+    def __init__(self, args: argparse.Namespace):
+        self.args = args
+        self.stats: Dict[str, PhaseStats] = {p: PhaseStats() for p in PHASES}
+        self.phase = PHASES[0]
+        self.phase_started = time.monotonic()
+        self.lock = threading.Lock()
+        self.running = True
+
+    def _on_item(self, item: tuple) -> None:
+        with self.lock:
+            if time.monotonic() - self.phase_started < SETTLE_SEC:
+                return  # report interval overlaps the previous phase
+            stats = self.stats[self.phase]
+        if item[0] == "record" and item[1] == TYPE_HISTOGRAM:
+            try:
+                series, hist = decode(item[2])
+            except ValueError:
+                return
+            if series == SERIES_ESP_RTT:
+                stats.hist.merge(hist)
+        elif item[0] == "text":
+            m = RTTH_RE.search(item[1])
+            if m and int(m.group(1)):
+                stats.lines.append(tuple(int(v) for v in m.groups()))
+
+    def _read_serial(self) -> None:
+        demux = TelemetryDemux()
+        with serial.Serial(self.args.port, self.args.baud, timeout=0.1) as port:
+            port.reset_input_buffer()
+            while self.running:
+                chunk = port.read(max(port.in_waiting, 1))
+                for item in demux.feed(chunk):
+                    self._on_item(item)
+
+    def run(self) -> None:
+        a = self.args
+        with open(os.devnull, "w") as devnull, contextlib.redirect_stdout(devnull):
+            runner = PingPongRunner(channel=a.channel, dropout_timeout=0)
+            reader = threading.Thread(target=self._read_serial, daemon=True)
+            reader.start()
+            worker = threading.Thread(target=runner.run, daemon=True)
+            worker.start()
+            try:
+                for rnd in range(a.rounds):
+                    for phase in PHASES:
+                        runner.set_kernel_reflector(phase == "kernel")
+                        with self.lock:
+                            self.phase = phase
+                            self.phase_started = time.monotonic()
+                        print(f"round {rnd + 1}/{a.rounds}: {phase} echo for {a.phase_seconds:.0f}s",
+                              file=sys.stderr)
+                        time.sleep(a.phase_seconds)
+            finally:
+                self.running = False
+                runner.running = False
+                worker.join(timeout=1.0)
+                runner.stop()  # also removes the cangw rule
+
+        print(f"{'echo':<8} {'n':>8} {'p50':>8} {'p90':>8} {'p99':>8} {'p99.9':>8} {'max':>8}"
+              "   (ESP-measured RTT, us)", file=sys.stderr)
+        for phase in PHASES:
+            print(self.stats[phase].row(phase), file=sys.stderr)
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Compare Python and cangw PONG echo RTT")
+    parser.add_argument("port", help="ESP serial device, e.g. /dev/ttyACM0")
+    parser.add_argument("-b", "--baud", type=int, default=115200)
+    parser.add_argument("--channel", default="can0")
+    parser.add_argument("--rounds", type=int, default=3)
+    parser.add_argument("--phase-seconds", type=float, default=60.0,
+                        help=f"per phase; the first {SETTLE_SEC:.0f}s of each are discarded")
+    args = parser.parse_args()
+
+    if args.phase_seconds <= SETTLE_SEC + ESP_REPORT_SEC:
+        sys.exit(f"--phase-seconds must exceed {SETTLE_SEC + ESP_REPORT_SEC:.0f}")
+    try:
+        ReflectorBench(args).run()
+    except RuntimeError as exc:
+        sys.exit(str(exc))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
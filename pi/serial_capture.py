@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""
+High-throughput capture client for the ESP serial/USB link.
+
+Replaces `pio device monitor` for recording: reads the port in large chunks,
+timestamps every text line and telemetry record on the host as it arrives,
+and writes them to disk with large buffered writes:
+
+  <prefix>.log     text log, each line prefixed `HH:MM:SS.mmm > ` (the same
+                   format as `pio device monitor --filter time`, so
+                   log_parse.py reads it directly)
+  <prefix>.telrec  raw telemetry records with host timestamps (TELREC1)
+  <prefix>.cancap  decoded capture frames, with --capture (CANCAP1)
+
+Arrival times are back-dated within each chunk by the serial byte time, so
+records read in the same chunk keep their relative spacing.
+
+Requirements: pyserial (`sudo apt install -y python3-serial`).
+
+Usage:
+  python3 pi/serial_capture.py /dev/ttyACM0 -o run1 --capture
+"""
+
+import argparse
+import signal
+import sys
+import time
+
+import serial
+
+from capture_codec import CaptureDecoder
+from capture_file import CaptureWriter
+from telemetry import RECORD_FILE_HEADER, RECORD_FILE_MAGIC, TYPE_CAPTURE, TelemetryDemux
+
+READ_CHUNK = 1 << 16
+WRITE_BUFFER = 1 << 20
+REPORT_PERIOD_SEC = 10.0
+
+
+class SerialCapture:
+    def __init__(self, port: str, baud: int, prefix: str, decode_capture: bool):
+        self.port = port
+        self.baud = baud
+        # 8N1: 10 bit times per byte on a UART; native USB CDC reports a nominal baud.
+        self.byte_ns = 10_000_000_000 // baud
+        self.running = True
+
+        self.demux = TelemetryDemux()
+        self.text_out = open(f"{prefix}.log", "wb", buffering=WRITE_BUFFER)
+        self.rec_out = open(f"{prefix}.telrec", "wb", buffering=WRITE_BUFFER)
+        self.rec_out.write(RECORD_FILE_MAGIC)
+
+        self.decoder = CaptureDecoder() if decode_capture else None
+        self.cap_out = CaptureWriter(open(f"{prefix}.cancap", "wb")) if decode_capture else None
+
+        self.bytes_in = 0
+        self.last_ts_ns = 0
+        self.chunks = 0
+        self.read_errors = 0
+        self.serial: serial.Serial = None
+
+    def _open(self) -> None:
+        # Short timeout + large read: returns as soon as data is queued, without
+        # the per-line wakeups of a line-oriented monitor.
+        self.serial = serial.Serial(self.port, self.baud, timeout=0.05)
+        self.serial.reset_input_buffer()
+        print(f"Capturing {self.port} @ {self.baud} baud")
+
+    def _write_text(self, wall_ns: int, line: bytes) -> None:
+        secs, rem = divmod(wall_ns, 1_000_000_000)
+        stamp = time.strftime("%H:%M:%S", time.localtime(secs))
+        self.text_out.write(f"{stamp}.{rem // 1_000_000:03d} > ".encode() + line + b"\n")
+
+    def _write_record(self, wall_ns: int, rtype: int, payload: bytes) -> None:
+        self.rec_out.write(RECORD_FILE_HEADER.pack(wall_ns, rtype, len(payload)))
+        self.rec_out.write(payload)
+
+        if self.decoder is not None and rtype == TYPE_CAPTURE:
+            for frame in self.decoder.decode_block(payload):
+                self.cap_out.write(frame)
+
+    def _process(self, chunk: bytes, wall_ns: int) -> None:
+        self.bytes_in += len(chunk)
+        self.chunks += 1
+        end_offset = self.bytes_in
+
+        for item in self.demux.feed(chunk):
+            ts = wall_ns - (end_offset - self.demux.offset) * self.byte_ns
+            # Back-dating is an estimate; never let it reorder records.
+            ts = max(ts, self.last_ts_ns)
+            self.last_ts_ns = ts
+            if item[0] == "text":
+                self._write_text(ts, item[1])
+            else:
+                self._write_record(ts, item[1], item[2])
+
+    def report(self) -> None:
+        d = self.demux
+        msg = (
+            f"bytes={self.bytes_in} chunks={self.chunks} lines={d.lines} "
+            f"records={d.records} bad_bytes={d.bad_bytes} read_errors={self.read_errors}"
+        )
+        if self.decoder is not None:
+            msg += (
+                f" frames={self.decoder.frames} seq_gaps={self.decoder.seq_gaps}"
+                f" blocks_skipped={self.decoder.blocks_skipped}"
+            )
+        print(msg, file=sys.stderr)
+
+    def run(self) -> None:
+        next_report = time.monotonic() + REPORT_PERIOD_SEC
+
+        while self.running:
+            if self.serial is None:
+                try:
+                    self._open()
+                except serial.SerialException as exc:
+                    print(f"Cannot open {self.port}: {exc}")
+                    time.sleep(1)
+                    continue
+
+            try:
+                waiting = self.serial.in_waiting
+                chunk = self.serial.read(min(max(waiting, 1), READ_CHUNK))
+            except serial.SerialException as exc:
+                # USB CDC disappears while the ESP resets; reopen and keep going.
+                print(f"Read error: {exc}")
+                self.read_errors += 1
+                self.serial.close()
+                self.serial = None
+                continue
+
+            if chunk:
+                self._process(chunk, time.time_ns())
+
+            now = time.monotonic()
+            if now >= next_report:
+                self.report()
+                next_report = now + REPORT_PERIOD_SEC
+
+    def stop(self) -> None:
+        self.running = False
+        wall_ns = time.time_ns()
+        for item in self.demux.flush():
+            if item[0] == "text":
+                self._write_text(wall_ns, item[1])
+        self.text_out.close()
+        self.rec_out.close()
+        if self.cap_out is not None:
+            self.cap_out.flush()
+            self.cap_out.fp.close()
+        self.report()
+        print("Stopped.")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Capture ESP serial output")
+    parser.add_argument("port", help="serial device, e.g. /dev/ttyACM0")
+    parser.add_argument("-b", "--baud", type=int, default=115200)
+    parser.add_argument("-o", "--prefix", default="capture", help="output file prefix")
+    parser.add_argument("--capture", action="store_true",
+                        help="decode capture telemetry into <prefix>.cancap")
+    args = parser.parse_args()
+
+    client = SerialCapture(args.port, args.baud, args.prefix, args.capture)
+
+    def _signal_handler(sig, frame):  # noqa: ANN001, D401 - signal signature
+        del sig, frame
+        client.stop()
+        sys.exit(0)
+
+    signal.signal(signal.SIGINT, _signal_handler)
+    signal.signal(signal.SIGTERM, _signal_handler)
+
+    client.run()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+Soak-test drift detection (same model as src/soak_monitor.cpp / src/trend.cpp).
+
+Every minute each metric gets one sample; an incremental least-squares line
+against elapsed hours (Welford co-moments, O(1) per sample) gives its slope
+and the slope's t statistic. A metric is flagged as drifting when the slope
+points the bad way, |t| >= T_THRESHOLD over >= MIN_SAMPLES minutes, and the
+trend would amount to a material change over a day.
+
+The Pi runner tracks its own side with --soak:
+  python3 pi/can_ping_pong.py --soak
+and prints SOAK/TREND lines every 10 min and SOAK DRIFT when a metric is
+flagged, like the ESP soak build (env esp32-s3-devkitc-1-soak).
+"""
+
+import math
+import os
+import resource
+from typing import Dict, List, NamedTuple
+
+from histogram import LatencyHistogram
+
+MIN_SAMPLES = 30
+T_THRESHOLD = 5.0
+SAMPLE_PERIOD_SEC = 60.0
+REPORT_PERIOD_SEC = 600.0
+
+
+class MetricConfig(NamedTuple):
+    name: str
+    bad_direction: int      # +1: rising is a degradation, -1: falling
+    material_per_day: float  # smallest change per 24 h worth reporting
+
+
+METRICS = (
+    MetricConfig("rtt_p50_us", +1, 200.0),
+    MetricConfig("rtt_p99_us", +1, 500.0),
+    MetricConfig("errors_min", +1, 1.0),
+    MetricConfig("lost_min", +1, 1.0),
+    MetricConfig("reopens_min", +1, 0.1),
+    MetricConfig("rxq_drops_min", +1, 1.0),
+    MetricConfig("rss_kb", +1, 1024.0),
+    MetricConfig("open_fds", +1, 4.0),
+)
+
+
+class TrendTracker:
+    def __init__(self) -> None:
+        self.n = 0
+        self.mean_x = 0.0
+        self.mean_y = 0.0
+        self.cxx = 0.0
+        self.cxy = 0.0
+        self.cyy = 0.0
+
+    def add(self, x: float, y: float) -> None:
+        self.n += 1
+        dx = x - self.mean_x
+        dy = y - self.mean_y
+        self.mean_x += dx / self.n
+        self.mean_y += dy / self.n
+        self.cxx += dx * (x - self.mean_x)
+        self.cxy += dx * (y - self.mean_y)
+        self.cyy += dy * (y - self.mean_y)
+
+    def slope(self) -> float:
+        return self.cxy / self.cxx if self.cxx > 0 else 0.0
+
+    def t_stat(self) -> float:
+        if self.n < 3 or self.cxx <= 0:
+            return 0.0
+        b = self.slope()
+        residual = max(self.cyy - b * self.cxy, 0.0)
+        se = math.sqrt(residual / (self.n - 2) / self.cxx)
+        if se == 0.0:
+            return 0.0 if b == 0.0 else math.copysign(math.inf, b)
+        return b / se
+
+
+def _rss_kb() -> float:
+    try:
+        with open("/proc/self/statm") as fp:
+            return int(fp.read().split()[1]) * os.sysconf("SC_PAGE_SIZE") / 1024.0
+    except OSError:
+        return float(resource.getrusage(resource.RUSAGE_SELF).ru_maxrss)
+
+
+def _open_fds() -> float:
+    try:
+        return float(len(os.listdir("/proc/self/fd")))
+    except OSError:
+        return math.nan
+
+
+class SoakMonitor:
+    def __init__(self, now: float) -> None:
+        self.trends: Dict[str, TrendTracker] = {m.name: TrendTracker() for m in METRICS}
+        self.drifting: Dict[str, bool] = dict.fromkeys(self.trends, False)
+        self.start = now
+        self.next_sample_at = now + SAMPLE_PERIOD_SEC
+        self.next_report_at = now + REPORT_PERIOD_SEC
+        self._reset_minute()
+
+    def _reset_minute(self) -> None:
+        self.rtt = LatencyHistogram()
+        self.errors = 0
+        self.lost = 0
+        self.reopens = 0
+        self.socket_drops = 0
+
+    def on_rtt(self, rtt_us: float) -> None:
+        self.rtt.record(int(rtt_us))
+
+    def on_error(self) -> None:
+        self.errors += 1
+
+    def on_ping_lost(self) -> None:
+        self.lost += 1
+
+    def on_reopen(self) -> None:
+        self.reopens += 1
+
+    def on_socket_drops(self, count: int) -> None:
+        self.socket_drops += count
+
+    def _evaluate(self, cfg: MetricConfig) -> bool:
+        t = self.trends[cfg.name]
+        if t.n < MIN_SAMPLES:
+            return False
+        slope = t.slope() * cfg.bad_direction
+        return slope > 0 and abs(t.t_stat()) >= T_THRESHOLD and slope * 24 >= cfg.material_per_day
+
+    def add(self, hours: float, values: Dict[str, float]) -> List[str]:
+        """Feeds one sample per metric (NaN skips); returns newly drifting names."""
+        raised = []
+        for cfg in METRICS:
+            value = values.get(cfg.name, math.nan)
+            if math.isnan(value):
+                continue
+            self.trends[cfg.name].add(hours, value)
+            drifting = self._evaluate(cfg)
+            if drifting and not self.drifting[cfg.name]:
+                raised.append(cfg.name)
+            self.drifting[cfg.name] = drifting
+        return raised
+
+    def tick(self, now: float) -> None:
+        if now >= self.next_sample_at:
+            self.next_sample_at += SAMPLE_PERIOD_SEC
+            h = self.rtt
+            values = {
+                "rtt_p50_us": h.value_at_percentile(50.0) if h.total else math.nan,
+                "rtt_p99_us": h.value_at_percentile(99.0) if h.total else math.nan,
+                "errors_min": float(self.errors),
+                "lost_min": float(self.lost),
+                "reopens_min": float(self.reopens),
+                "rxq_drops_min": float(self.socket_drops),
+                "rss_kb": _rss_kb(),
+                "open_fds": _open_fds(),
+            }
+            self._reset_minute()
+            for name in self.add((now - self.start) / 3600.0, values):
+                t = self.trends[name]
+                print(f"SOAK DRIFT {name} slope_per_h={t.slope():.3f} t={t.t_stat():.1f} n={t.n}")
+
+        if now >= self.next_report_at:
+            self.next_report_at = now + REPORT_PERIOD_SEC
+            self.report(now)
+
+    def report(self, now: float) -> None:
+        print(f"SOAK uptime_s={int(now - self.start)} rss_kb={int(_rss_kb())} open_fds={int(_open_fds())}")
+        for cfg in METRICS:
+            t = self.trends[cfg.name]
+            print(f"TREND {cfg.name} n={t.n} mean={t.mean_y:.1f} slope_per_h={t.slope():.3f} "
+                  f"t={t.t_stat():.1f} drift={int(self.drifting[cfg.name])}")
+
+
+if __name__ == "__main__":
+    print(__doc__.strip())
@@ -0,0 +1,161 @@
+"""
+Demultiplexer for the ESP serial stream: text log lines interleaved with
+binary telemetry records (see src/telemetry.h).
+
+Record: SYNC(0xA5) TYPE(u8) LEN(u8) PAYLOAD[LEN] CRC8(TYPE, LEN, PAYLOAD)
+"""
+
+import struct
+from typing import BinaryIO, Iterator, NamedTuple, Tuple, Union
+
+SYNC = 0xA5
+MAX_PAYLOAD = 250
+
+# Record types (keep in sync with src/telemetry.h)
+TYPE_CAPTURE = 0x01
+TYPE_LINK_QUALITY = 0x02
+TYPE_HISTOGRAM = 0x03
+
+
+def _make_crc8_table() -> bytes:
+    table = bytearray(256)
+    for i in range(256):
+        crc = i
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+        table[i] = crc
+    return bytes(table)
+
+
+_CRC8_TABLE = _make_crc8_table()
+
+
+def crc8(data: bytes, crc: int = 0) -> int:
+    for b in data:
+        crc = _CRC8_TABLE[crc ^ b]
+    return crc
+
+
+def encode_record(rtype: int, payload: bytes) -> bytes:
+    if len(payload) > MAX_PAYLOAD:
+        raise ValueError("telemetry payload too long")
+    body = bytes([rtype, len(payload)]) + payload
+    return bytes([SYNC]) + body + bytes([crc8(body)])
+
+
+# Host-side archive of raw telemetry records, as written by serial_capture.py:
+# MAGIC(8) then per record <QBB> host_ts_ns, type, len, followed by payload.
+RECORD_FILE_MAGIC = b"TELREC1\0"
+RECORD_FILE_HEADER = struct.Struct("<QBB")
+
+
+class TelemetryRecord(NamedTuple):
+    host_ts_ns: int
+    rtype: int
+    payload: bytes
+
+
+def read_record_file(fp: BinaryIO) -> Iterator[TelemetryRecord]:
+    if fp.read(len(RECORD_FILE_MAGIC)) != RECORD_FILE_MAGIC:
+        raise ValueError("not a TELREC1 file")
+    while True:
+        header = fp.read(RECORD_FILE_HEADER.size)
+        if len(header) < RECORD_FILE_HEADER.size:
+            return
+        ts_ns, rtype, length = RECORD_FILE_HEADER.unpack(header)
+        payload = fp.read(length)
+        if len(payload) < length:
+            return
+        yield TelemetryRecord(ts_ns, rtype, payload)
+
+
+TextItem = Tuple[str, bytes]
+RecordItem = Tuple[str, int, bytes]
+
+
+class TelemetryDemux:
+    """Incremental splitter; feed() arbitrary chunks, iterate the results.
+
+    Yields ("text", line_without_newline) and ("record", type, payload).
+    Bytes that are neither valid ASCII text nor part of a CRC-valid record
+    are counted in `bad_bytes` and dropped. While an item is being yielded,
+    `offset` is the absolute stream offset just past its last byte, which
+    lets callers back-date arrival times within a chunk.
+    """
+
+    def __init__(self) -> None:
+        self._buf = bytearray()
+        self._base = 0
+        self.offset = 0
+        self.bad_bytes = 0
+        self.records = 0
+        self.lines = 0
+
+    def feed(self, chunk: bytes) -> Iterator[Union[TextItem, RecordItem]]:
+        buf = self._buf
+        buf += chunk
+        pos = 0
+        end = len(buf)
+
+        while pos < end:
+            sync = buf.find(SYNC, pos)
+            text_end = end if sync < 0 else sync
+
+            # Emit complete text lines before the next record start.
+            while pos < text_end:
+                nl = buf.find(b"\n", pos, text_end)
+                if nl < 0:
+                    break
+                self.offset = self._base + nl + 1
+                yield from self._text(bytes(buf[pos:nl]))
+                pos = nl + 1
+
+            if sync < 0:
+                break
+            if pos < sync:
+                # Partial line interrupted by a record; keep it as its own line.
+                self.offset = self._base + sync
+                yield from self._text(bytes(buf[pos:sync]))
+                pos = sync
+
+            if end - pos < 3:
+                break
+            length = buf[pos + 2]
+            total = 3 + length + 1
+            if length > MAX_PAYLOAD:
+                self.bad_bytes += 1
+                pos += 1
+                continue
+            if end - pos < total:
+                break
+            body = bytes(buf[pos + 1:pos + 3 + length])
+            if crc8(body) != buf[pos + total - 1]:
+                self.bad_bytes += 1
+                pos += 1
+                continue
+            self.records += 1
+            self.offset = self._base + pos + total
+            yield ("record", body[0], body[2:])
+            pos += total
+
+        del buf[:pos]
+        self._base += pos
+
+    def flush(self) -> Iterator[Union[TextItem, RecordItem]]:
+        self._base += len(self._buf)
+        self.offset = self._base
+        if self._buf and SYNC not in self._buf:
+            yield from self._text(bytes(self._buf))
+        else:
+            self.bad_bytes += len(self._buf)
+        self._buf.clear()
+
+    def _text(self, line: bytes) -> Iterator[TextItem]:
+        line = line.rstrip(b"\r")
+        if not line:
+            return
+        if max(line) >= 0x80:
+            self.bad_bytes += sum(1 for b in line if b >= 0x80)
+            line = bytes(b for b in line if b < 0x80)
+        self.lines += 1
+        yield ("text", line)
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Uploader against a simulated node on an in-memory bus, no CAN hardware.
+
+The node mirrors src/firmware_update.cpp closely enough for the host side:
+ISO-TP with flow control every BLOCK_SIZE frames, DATA accepted only at the
+expected offset, and the OK for a chunk sent only once the next chunk has
+started (the flash write of chunk n overlaps reception of chunk n+1). So
+with a window of two, every ACK lands between the host's first frame and
+the node's flow control for the following chunk.
+
+Usage (from pi/):
+  python3 -m unittest test_can_update
+"""
+
+import collections
+import struct
+import time
+import unittest
+import zlib
+from typing import Deque, List, Optional
+
+import can
+
+import can_update
+from isotp import IsoTpLink
+
+BLOCK_SIZE = 32   # FirmwareUpdate::BLOCK_SIZE
+CHUNK_MAX = 512
+WINDOW = 2        # FirmwareUpdate::BUFFERS
+
+
+class FakeBus:
+    """One end of an in-memory bus; send() delivers straight to the peer."""
+
+    def __init__(self) -> None:
+        self.queue: Deque[can.Message] = collections.deque()
+        self.on_send = None
+        self.on_idle = None
+
+    def send(self, msg: can.Message) -> None:
+        msg.timestamp = time.monotonic()
+        self.on_send(msg)
+
+    def recv(self, timeout: Optional[float] = None) -> Optional[can.Message]:
+        if not self.queue and self.on_idle:
+            self.on_idle()
+        return self.queue.popleft() if self.queue else None
+
+
+class SimulatedNode:
+    def __init__(self, host: FakeBus) -> None:
+        self.host = host
+        self.bus = FakeBus()
+        self.bus.on_send = host.queue.append
+        self.link = IsoTpLink(self.bus, can_update.RESPONSE_ID, can_update.REQUEST_ID,
+                              block_size=BLOCK_SIZE)
+        self.image = bytearray()
+        self.size = 0
+        self.crc = 0
+        self.pending: List[bytes] = []  # ACKs waiting for the flash write
+        self.refused = 0
+        host.on_send = self.on_frame
+        host.on_idle = self.flush
+
+    def flush(self) -> None:
+        while self.pending:
+            self.link.send(self.pending.pop(0))
+
+    def on_frame(self, msg: can.Message) -> None:
+        self.flush()  # the previous chunk finished flashing meanwhile
+        self.link._on_frame(msg)
+        while self.link.inbox:
+            self.on_request(self.link.inbox.popleft()[0])
+
+    def on_request(self, req: bytes) -> None:
+        code = req[0]
+        if code == can_update.REQ_BEGIN:
+            self.size, self.crc = struct.unpack_from("<II", req, 1)
+            self.link.send(struct.pack("<BBHB", code | can_update.RESPONSE, can_update.OK,
+                                       CHUNK_MAX, WINDOW))
+        elif code == can_update.REQ_DATA:
+            _, seq, offset = can_update.DATA_HEADER.unpack_from(req)
+            data = req[can_update.DATA_HEADER.size:]
+            status = can_update.OK
+            if offset != len(self.image):
+                status = can_update.OUT_OF_ORDER
+                self.refused += 1
+            else:
+                self.image += data
+            reply = can_update.DATA_RESPONSE.pack(code | can_update.RESPONSE, seq, status,
+                                                  len(self.image).to_bytes(3, "little"))
+            if status == can_update.OK:
+                self.pending.append(reply)
+            else:
+                self.link.send(reply)
+        elif code == can_update.REQ_END:
+            ok = len(self.image) == self.size and zlib.crc32(self.image) == self.crc
+            self.link.send(bytes([code | can_update.RESPONSE,
+                                  can_update.OK if ok else 6]))  # 6: verify_failed
+
+
+class UploaderTest(unittest.TestCase):
+    def upload(self, window: int) -> None:
+        image = bytes((i * 7 + (i >> 8)) & 0xFF for i in range(CHUNK_MAX * 6 + 100))
+        host = FakeBus()
+        node = SimulatedNode(host)
+        up = can_update.Uploader(IsoTpLink(host, can_update.REQUEST_ID, can_update.RESPONSE_ID),
+                                 image, window, 4088)
+        up.begin()
+        self.assertEqual(up.chunk, CHUNK_MAX)
+        up.transfer(lambda _: None)
+        up.end()
+        self.assertEqual(bytes(node.image), image)
+        self.assertEqual(node.refused, 0)
+        self.assertEqual(up.resyncs, 0)
+        self.assertEqual(up.sent_bytes, len(image))
+
+    def test_window_one(self) -> None:
+        self.upload(1)
+
+    def test_window_two_acks_mid_chunk_do_not_resend(self) -> None:
+        self.upload(2)
+
+
+if __name__ == "__main__":
+    unittest.main()
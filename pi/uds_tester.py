@@ -0,0 +1,305 @@
+#!/usr/bin/env python3
+"""
+UDS tester for the node's diagnostic server (src/uds_server.h): measures P2,
+the time from the end of a request to the start of its response, while the
+bus carries a kernel-paced background load.
+
+Requests go out on 0x6D0 through pi/isotp.py and the node answers on 0x6D8.
+P2 is taken on the bus: from the kernel echo of the request's last frame
+(it has left the Pi's controller) to the RX timestamp of the response's
+first frame. Where the interface gives no echo, the host time after send()
+stands in (ref=host in the report).
+
+Each load step runs a BCM cyclic TX job (pi/bcm.py) at a share of the line
+rate and meanwhile sends requests at --rate: TesterPresent, a single stats
+DID and a five-DID read whose request and response both need several
+frames. Per step it prints P2 percentiles (pi/histogram.py buckets), per
+service and overall, and counts responses later than the P2 the node
+announced in its DiagnosticSessionControl response. The node's own view,
+request complete to response queued, is read back from DIDs 0x0110..0x0112.
+
+Load frames use 0x7C0 by default, below the UDS IDs in priority, so they
+only delay a request by the frame already on the wire; a --load-id below
+0x6D0 wins arbitration instead. The tester holds the extended session for
+the whole run, and the node stops logging received frames to serial while
+it is active, so P2 does not include the node's serial backpressure.
+
+Usage:
+  python3 pi/uds_tester.py --load 0,50,90 --seconds 20
+  python3 pi/uds_tester.py --load 90 --load-id 0x100
+  python3 pi/uds_tester.py --read                 # stats DIDs once
+"""
+
+import argparse
+import statistics
+import struct
+import sys
+import time
+from typing import Dict, List, NamedTuple, Optional, Tuple
+
+import can
+
+from bcm import BcmFrame, BcmSocket
+from bcm_stress import sample
+from burst_test import frame_bits
+from can_ping_pong import make_pattern
+from histogram import LatencyHistogram
+from isotp import IsoTpError, IsoTpLink
+
+REQUEST_ID = 0x6D0   # UDS_REQUEST_ID in src/main.cpp
+RESPONSE_ID = 0x6D8
+LOAD_ID = 0x7C0      # bcm_stress.STRESS_ID, muted in the node's RX log
+
+SID_SESSION_CONTROL = 0x10
+SID_READ_DID = 0x22
+SID_TESTER_PRESENT = 0x3E
+SID_NEGATIVE = 0x7F
+NRC_RESPONSE_PENDING = 0x78
+SESSION_DEFAULT, SESSION_EXTENDED = 0x01, 0x03
+
+# Mirrors UDS_DIDS in src/main.cpp plus the built-in 0xF186.
+DIDS: Dict[int, Tuple[str, int]] = {
+    0x0100: ("rx_frames", 4),
+    0x0101: ("tx_frames", 4),
+    0x0102: ("tx_errors", 4),
+    0x0103: ("rx_overflows", 4),
+    0x0104: ("reinits", 4),
+    0x0105: ("last_rtt_us", 4),
+    0x0106: ("loop_us", 4),
+    0x0107: ("serial_tx_free", 4),
+    0x0108: ("int_edges", 4),
+    0x0109: ("idle_ms", 4),
+    0x010A: ("send_error_streak", 1),
+    0x0110: ("uds_responses", 4),
+    0x0111: ("uds_max_us", 4),
+    0x0112: ("uds_late", 4),
+    0xF186: ("active_session", 1),
+}
+NODE_TIMING_DIDS = (0x0110, 0x0111, 0x0112)
+
+SERVICES: Dict[str, bytes] = {
+    "tester_present": bytes([SID_TESTER_PRESENT, 0x00]),
+    "read_did": bytes([SID_READ_DID, 0x01, 0x06]),
+    "read_multi": bytes([SID_READ_DID]) + b"".join(struct.pack(">H", d) for d in
+                                                    (0x0100, 0x0101, 0x0102, 0x0103, 0x0104)),
+}
+
+P2_CLIENT_SEC = 1.0   # give up on a response after this long
+PERCENTILES = (50.0, 90.0, 99.0, 99.9)
+
+
+class UdsError(Exception):
+    pass
+
+
+class Exchange(NamedTuple):
+    response: Optional[bytes]   # final response; None on timeout
+    p2_us: Optional[int]        # request end to first response frame
+    pending: int                # response-pending (NRC 78) answers before the final one
+    echo: bool                  # P2 referenced to the request's TX echo
+
+
+class UdsClient:
+    def __init__(self, link: IsoTpLink):
+        self.link = link
+        self.p2_star_sec = 5.0
+
+    def request(self, payload: bytes, timeout: float = P2_CLIENT_SEC) -> Exchange:
+        while self.link.inbox:
+            self.link.recv(0)  # stale answer to an earlier, timed-out request
+        echo_before = self.link.tx_echo_time
+        self.link.send(payload)
+        host_end = time.time()  # socketcan timestamps are wall-clock too
+        p2_us = None
+        pending = 0
+        echo = False
+        deadline = time.monotonic() + timeout
+        while True:
+            got = self.link.recv(max(deadline - time.monotonic(), 0.0))
+            if got is None:
+                return Exchange(None, p2_us, pending, echo)
+            data = got[0]
+            if p2_us is None:
+                echo = self.link.rx_request_end > echo_before
+                end = self.link.rx_request_end if echo else host_end
+                p2_us = max(int((self.link.rx_first_time - end) * 1e6), 0)
+            if len(data) >= 3 and data[0] == SID_NEGATIVE and data[2] == NRC_RESPONSE_PENDING:
+                pending += 1
+                deadline = time.monotonic() + self.p2_star_sec
+                continue
+            return Exchange(data, p2_us, pending, echo)
+
+    def check(self, payload: bytes) -> bytes:
+        ex = self.request(payload)
+        if ex.response is None:
+            raise UdsError(f"no response to {payload[:1].hex()}")
+        if ex.response[0] == SID_NEGATIVE:
+            raise UdsError(f"{payload[:1].hex()}: negative response 0x{ex.response[2]:02X}")
+        return ex.response
+
+    def session(self, session: int) -> Tuple[int, int]:
+        """Switches the session; returns the node's P2 and P2* in ms."""
+        res = self.check(bytes([SID_SESSION_CONTROL, session]))
+        p2_ms, p2_star = struct.unpack_from(">HH", res, 2)
+        self.p2_star_sec = p2_star * 10 / 1000.0
+        return p2_ms, p2_star * 10
+
+    def read_dids(self, dids: List[int]) -> Dict[int, int]:
+        res = self.check(bytes([SID_READ_DID]) + b"".join(struct.pack(">H", d) for d in dids))
+        return parse_read_response(res)
+
+
+def parse_read_response(res: bytes) -> Dict[int, int]:
+    values = {}
+    pos = 1
+    while pos + 2 <= len(res):
+        did = struct.unpack_from(">H", res, pos)[0]
+        size = DIDS.get(did, ("", 0))[1]
+        if not size or pos + 2 + size > len(res):
+            raise UdsError(f"cannot parse DID 0x{did:04X} in response")
+        values[did] = int.from_bytes(res[pos + 2:pos + 2 + size], "big")
+        pos += 2 + size
+    return values
+
+
+class StepStats:
+    def __init__(self) -> None:
+        self.hist: Dict[str, LatencyHistogram] = {name: LatencyHistogram() for name in SERVICES}
+        self.requests = 0
+        self.timeouts = 0
+        self.negative = 0
+        self.pending = 0
+        self.late = 0
+        self.echo = 0
+
+    def overall(self) -> LatencyHistogram:
+        total = LatencyHistogram()
+        for h in self.hist.values():
+            total.merge(h)
+        return total
+
+
+def cells(hist: LatencyHistogram) -> str:
+    values = " ".join(f"p{p:g}={hist.value_at_percentile(p)}" for p in PERCENTILES)
+    return f"n={hist.total} {values} max={hist.max}"
+
+
+def run_step(args: argparse.Namespace, client: UdsClient, load: float, line_fps: float,
+             p2_ms: int) -> None:
+    bcm = None
+    if load > 0:
+        bcm = BcmSocket(args.channel)
+        frames = [BcmFrame(args.load_id, make_pattern(i)) for i in range(256)]
+        bcm.tx_setup(args.load_id, frames, 1.0 / (line_fps * load / 100.0))
+    st = StepStats()
+    names = list(SERVICES)
+    start = sample(args.channel)
+    try:
+        time.sleep(0.5 if bcm else 0.0)  # let the load settle
+        interval = 1.0 / args.rate
+        next_at = time.monotonic()
+        deadline = next_at + args.seconds
+        while time.monotonic() < deadline:
+            name = names[st.requests % len(names)]
+            st.requests += 1
+            try:
+                ex = client.request(SERVICES[name])
+            except IsoTpError:
+                st.timeouts += 1  # the node never granted the rest of the request
+                ex = None
+            if ex is not None:
+                if ex.p2_us is not None:
+                    st.hist[name].record(ex.p2_us)
+                    st.late += ex.p2_us > p2_ms * 1000
+                    st.echo += ex.echo
+                st.pending += ex.pending
+                if ex.response is None:
+                    st.timeouts += 1
+                elif ex.response[0] == SID_NEGATIVE:
+                    st.negative += 1
+            next_at += interval
+            time.sleep(max(next_at - time.monotonic(), 0.0))
+    finally:
+        end = sample(args.channel)
+        if bcm is not None:
+            bcm.tx_delete(args.load_id)
+            bcm.close()
+
+    wall = end.wall - start.wall
+    fps = (end.tx_packets - start.tx_packets) / wall if wall else 0.0
+    total = st.overall()
+    ref = "echo" if st.echo == total.total and total.total else ("host" if not st.echo else "mixed")
+    print(f"UDS load={load:.0f}% tx_fps={fps:.0f} requests={st.requests} timeouts={st.timeouts} "
+          f"negative={st.negative} pending={st.pending} p2_us {cells(total)} "
+          f"over_p2={st.late} p2_ms={p2_ms} ref={ref}")
+    for name, hist in st.hist.items():
+        if hist.total:
+            print(f"UDS   service={name} {cells(hist)}")
+
+
+def open_link(args: argparse.Namespace) -> Tuple[can.Bus, IsoTpLink]:
+    bus = can.Bus(interface="socketcan", channel=args.channel, receive_own_messages=True,
+                  can_filters=[{"can_id": RESPONSE_ID, "can_mask": 0x7FF, "extended": False},
+                               {"can_id": REQUEST_ID, "can_mask": 0x7FF, "extended": False}])
+    return bus, IsoTpLink(bus, REQUEST_ID, RESPONSE_ID)
+
+
+def read_stats(client: UdsClient) -> None:
+    for did, value in client.read_dids(list(DIDS)).items():
+        print(f"did 0x{did:04X} {DIDS[did][0]:<16} {value}")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="UDS P2 response time under bus load")
+    parser.add_argument("--channel", default="can0")
+    parser.add_argument("--bitrate", type=int, default=125000)
+    parser.add_argument("--load", default="0,50,90",
+                        help="comma-separated background load steps, %% of line rate")
+    parser.add_argument("--load-id", type=lambda v: int(v, 0), default=LOAD_ID)
+    parser.add_argument("--seconds", type=float, default=20.0, help="per load step")
+    parser.add_argument("--rate", type=float, default=20.0, help="requests per second")
+    parser.add_argument("--read", action="store_true", help="print the stats DIDs and exit")
+    args = parser.parse_args()
+
+    try:
+        steps = [float(v) for v in args.load.split(",") if v.strip()]
+    except ValueError:
+        parser.error("--load takes numbers, e.g. 0,50,90")
+    if any(not 0 <= v <= 100 for v in steps) or args.rate <= 0:
+        parser.error("--load steps must be 0..100 and --rate positive")
+    if not 0 <= args.load_id <= 0x7FF or args.load_id in (REQUEST_ID, RESPONSE_ID):
+        sys.exit("--load-id must be a free standard identifier")
+
+    mean_bits = statistics.mean(frame_bits(args.load_id, make_pattern(i)) for i in range(256))
+    line_fps = args.bitrate / mean_bits
+
+    bus, link = open_link(args)
+    client = UdsClient(link)
+    try:
+        if args.read:
+            read_stats(client)
+            return
+        p2_ms, p2_star_ms = client.session(SESSION_EXTENDED)
+        print(f"node P2={p2_ms} ms P2*={p2_star_ms} ms; {args.rate:.0f} requests/s, "
+              f"load id 0x{args.load_id:X} line rate {line_fps:.0f} fps", file=sys.stderr)
+        before = client.read_dids(list(NODE_TIMING_DIDS))
+        for load in steps:
+            run_step(args, client, load, line_fps, p2_ms)
+        after = client.read_dids(list(NODE_TIMING_DIDS))
+        client.session(SESSION_DEFAULT)
+        print(f"UDS node responses={after[0x0110] - before[0x0110]} max_us={after[0x0111]} "
+              f"late={after[0x0112] - before[0x0112]}   (request complete -> response queued)")
+        if link.enobufs:
+            print(f"socket TX queue full {link.enobufs} times", file=sys.stderr)
+    except (UdsError, IsoTpError) as exc:
+        sys.exit(f"UDS: {exc}")
+    except OSError as exc:
+        sys.exit(f"BCM unavailable ({exc}); try 'sudo modprobe can-bcm'")
+    except KeyboardInterrupt:
+        pass
+    finally:
+        bus.shutdown()
+
+
+if __name__ == "__main__":
+    main()
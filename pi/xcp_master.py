@@ -0,0 +1,368 @@
+#!/usr/bin/env python3
+"""
+Minimal XCP-on-CAN master for the node's measurement slave (src/xcp_slave.h).
+
+Connects on CRO 0x6E0 / DTO 0x6E8 and configures one dynamic DAQ list with
+the requested signals on one event channel. The ESP then pushes timestamped
+DAQ packets by itself; no printf and no polling. Every DTO frame goes into a
+capture file (CANCAP1 or pcapng, by extension), and the layout goes into a
+JSON file next to it, so --decode can turn a capture into CSV rows later.
+
+Signals are packed greedily into ODTs (one CAN frame each): the first ODT
+carries the PID, the 4-byte ESP timestamp (us) and 3 bytes of data; the
+others carry the PID and 7 bytes. A sample is one row per event, made of all
+ODTs of the list; a row with a missing ODT is counted as incomplete.
+
+Bus budget at 125 kbps: one 8-byte frame takes ~0.9 ms, so a 1 ms event with
+one ODT already fills ~90 % of the bus. Use --prescaler or fewer signals;
+overloads (the ESP's TX buffers were full) are flagged in the PID and counted.
+
+Usage:
+  python3 pi/xcp_master.py --list
+  python3 pi/xcp_master.py -s rx_batch,loop_us --event 1ms --prescaler 2 \\
+      --seconds 10 -o daq.cancap --csv daq.csv
+  python3 pi/xcp_master.py --decode daq.cancap --csv daq.csv
+  python3 pi/xcp_master.py --read rx_frames,reinits          # SHORT_UPLOAD once
+"""
+
+import argparse
+import csv
+import json
+import struct
+import sys
+import time
+from typing import Dict, List, NamedTuple, Optional, Sequence, Tuple
+
+import can
+
+from capture_file import FLAG_HOST_TS, CaptureFrame, open_writer, read_capture
+
+CRO_ID = 0x6E0   # XCP_CRO_ID in src/main.cpp
+DTO_ID = 0x6E8
+
+ADDR_EXT_TABLE = 1
+MAX_DTO = 8
+TIMESTAMP_LEN = 4
+PID_OVERLOAD = 0x80
+DAQ_MODE_TIMESTAMP = 0x10
+
+# Mirrors XCP_VARIABLES (index = address) and XcpEvent in src/main.cpp.
+VARIABLES: Dict[str, Tuple[int, str]] = {
+    "rx_frames": (0, "I"),
+    "tx_frames": (1, "I"),
+    "tx_errors": (2, "I"),
+    "rx_overflows": (3, "I"),
+    "reinits": (4, "I"),
+    "last_rtt_us": (5, "I"),
+    "loop_us": (6, "I"),
+    "serial_tx_free": (7, "I"),
+    "rx_batch": (8, "H"),
+    "send_error_streak": (9, "B"),
+    "int_edges": (10, "I"),
+    "idle_ms": (11, "I"),
+}
+EVENTS = {"loop": 0, "1ms": 1, "rx": 2}
+
+CMD_CONNECT, CMD_DISCONNECT, CMD_SHORT_UPLOAD = 0xFF, 0xFE, 0xF4
+CMD_SET_DAQ_PTR, CMD_WRITE_DAQ, CMD_SET_DAQ_LIST_MODE = 0xE2, 0xE1, 0xE0
+CMD_START_STOP_DAQ_LIST, CMD_START_STOP_SYNCH = 0xDE, 0xDD
+CMD_FREE_DAQ, CMD_ALLOC_DAQ, CMD_ALLOC_ODT, CMD_ALLOC_ODT_ENTRY = 0xD6, 0xD5, 0xD4, 0xD3
+
+ERRORS = {
+    0x00: "CMD_SYNCH", 0x10: "CMD_BUSY", 0x11: "DAQ_ACTIVE", 0x20: "CMD_UNKNOWN",
+    0x21: "CMD_SYNTAX", 0x22: "OUT_OF_RANGE", 0x24: "ACCESS_DENIED", 0x27: "MODE_NOT_VALID",
+    0x29: "SEQUENCE", 0x2A: "DAQ_CONFIG", 0x30: "MEMORY_OVERFLOW",
+}
+
+COMMAND_TIMEOUT_SEC = 0.5
+
+
+class XcpError(Exception):
+    pass
+
+
+class Layout(NamedTuple):
+    """Signals per ODT; ODT 0 starts with the timestamp."""
+    odts: List[List[str]]
+    first_pid: int = 0
+
+    def to_json(self) -> dict:
+        return {"odts": self.odts, "first_pid": self.first_pid}
+
+    @staticmethod
+    def from_json(obj: dict) -> "Layout":
+        return Layout(obj["odts"], obj["first_pid"])
+
+
+def plan_odts(signals: Sequence[str]) -> List[List[str]]:
+    """First-fit decreasing: each ODT is one CAN frame per sample."""
+    odts: List[List[str]] = [[]]
+    room = [MAX_DTO - 1 - TIMESTAMP_LEN]
+    size = {name: struct.calcsize("<" + VARIABLES[name][1]) for name in signals}
+    for name in sorted(signals, key=lambda n: -size[n]):
+        for i, free in enumerate(room):
+            if size[name] <= free:
+                break
+        else:
+            odts.append([])
+            room.append(MAX_DTO - 1)
+            i = len(odts) - 1
+        odts[i].append(name)
+        room[i] -= size[name]
+    return odts
+
+
+class XcpMaster:
+    def __init__(self, bus: can.Bus):
+        self.bus = bus
+
+    def command(self, *fields: int, fmt: Optional[str] = None) -> bytes:
+        payload = struct.pack("<" + fmt, *fields) if fmt else bytes(fields)
+        self.bus.send(can.Message(arbitration_id=CRO_ID, is_extended_id=False, data=payload))
+        deadline = time.monotonic() + COMMAND_TIMEOUT_SEC
+        while True:
+            msg = self.bus.recv(max(deadline - time.monotonic(), 0.0))
+            if msg is None:
+                raise XcpError(f"no response to command 0x{payload[0]:02X}")
+            if msg.arbitration_id != DTO_ID or not msg.data:
+                continue
+            if msg.data[0] == 0xFF:
+                return bytes(msg.data)
+            if msg.data[0] == 0xFE:
+                code = msg.data[1] if len(msg.data) > 1 else 0xFF
+                raise XcpError(f"command 0x{payload[0]:02X}: ERR_{ERRORS.get(code, hex(code))}")
+            # anything else is a DAQ packet from a previous session
+
+    def connect(self) -> None:
+        res = self.command(CMD_CONNECT, 0)
+        if not res[1] & 0x04:
+            raise XcpError("slave has no DAQ resource")
+
+    def upload(self, name: str) -> int:
+        index, code = VARIABLES[name]
+        size = struct.calcsize("<" + code)
+        res = self.command(CMD_SHORT_UPLOAD, size, 0, ADDR_EXT_TABLE, index, fmt="BBBBI")
+        return struct.unpack_from("<" + code, res, 1)[0]
+
+    def configure(self, signals: Sequence[str], event: int, prescaler: int) -> Layout:
+        odts = plan_odts(signals)
+        self.command(CMD_FREE_DAQ)
+        self.command(CMD_ALLOC_DAQ, 0, 1, fmt="BBH")
+        self.command(CMD_ALLOC_ODT, 0, 0, len(odts), fmt="BBHB")
+        for i, odt in enumerate(odts):
+            self.command(CMD_ALLOC_ODT_ENTRY, 0, 0, i, len(odt), fmt="BBHBB")
+        for i, odt in enumerate(odts):
+            self.command(CMD_SET_DAQ_PTR, 0, 0, i, 0, fmt="BBHBB")
+            for name in odt:
+                index, code = VARIABLES[name]
+                self.command(CMD_WRITE_DAQ, 0xFF, struct.calcsize("<" + code), ADDR_EXT_TABLE,
+                             index, fmt="BBBBI")
+        self.command(CMD_SET_DAQ_LIST_MODE, DAQ_MODE_TIMESTAMP, 0, event, prescaler, 0,
+                     fmt="BBHHBB")
+        first_pid = self.command(CMD_START_STOP_DAQ_LIST, 2, 0, fmt="BBH")[1]  # select
+        return Layout(odts, first_pid)
+
+    def start(self) -> None:
+        self.command(CMD_START_STOP_SYNCH, 1)
+
+    def stop(self) -> None:
+        self.command(CMD_START_STOP_SYNCH, 0)
+
+    def disconnect(self) -> None:
+        self.command(CMD_DISCONNECT)
+
+
+class Decoder:
+    """Reassembles DAQ packets into rows: (esp_ts_us, values...)."""
+
+    def __init__(self, layout: Layout):
+        self.layout = layout
+        self.formats = [struct.Struct("<" + "".join(VARIABLES[n][1] for n in odt))
+                        for odt in layout.odts]
+        self.names = [n for odt in layout.odts for n in odt]
+        self.rows = 0
+        self.incomplete = 0
+        self.overloads = 0
+        self.other = 0
+        self._row: Optional[list] = None
+        self._next_odt = 0
+
+    def feed(self, data: bytes) -> Optional[list]:
+        if not data or data[0] >= 0xFC:
+            return None  # command response or event
+        odt = (data[0] & ~PID_OVERLOAD) - self.layout.first_pid
+        if not 0 <= odt < len(self.formats):
+            self.other += 1
+            return None
+        if data[0] & PID_OVERLOAD:
+            self.overloads += 1
+        if odt == 0:
+            if self._row is not None:
+                self.incomplete += 1
+            ts = struct.unpack_from("<I", data, 1)[0]
+            self._row = [ts] + list(self.formats[0].unpack_from(data, 1 + TIMESTAMP_LEN))
+            self._next_odt = 1
+        elif self._row is not None and odt == self._next_odt:
+            self._row += self.formats[odt].unpack_from(data, 1)
+            self._next_odt += 1
+        else:
+            if self._row is not None:
+                self.incomplete += 1
+            self._row = None
+            return None
+        if self._next_odt == len(self.formats):
+            row, self._row = self._row, None
+            self.rows += 1
+            return row
+        return None
+
+
+def layout_path(capture: str) -> str:
+    return capture + ".xcp.json"
+
+
+def open_csv(path: Optional[str], names: List[str]):
+    if not path:
+        return None, None
+    fp = open(path, "w", newline="")
+    out = csv.writer(fp)
+    out.writerow(["esp_ts_us"] + names)
+    return fp, out
+
+
+def decode_capture(args: argparse.Namespace) -> None:
+    with open(layout_path(args.decode)) as fp:
+        layout = Layout.from_json(json.load(fp))
+    dec = Decoder(layout)
+    csv_fp, out = open_csv(args.csv, dec.names)
+    with open(args.decode, "rb") as fp:
+        for frame in read_capture(fp):
+            if frame.can_id == DTO_ID:
+                row = dec.feed(frame.data[:frame.dlc])
+                if row is not None and out is not None:
+                    out.writerow(row)
+    if csv_fp:
+        csv_fp.close()
+    print(f"rows={dec.rows} incomplete={dec.incomplete} overload_flags={dec.overloads}",
+          file=sys.stderr)
+
+
+def read_once(args: argparse.Namespace, signals: List[str]) -> None:
+    bus = can.Bus(interface="socketcan", channel=args.channel,
+                  can_filters=[{"can_id": DTO_ID, "can_mask": 0x7FF, "extended": False}])
+    master = XcpMaster(bus)
+    try:
+        master.connect()
+        for name in signals:
+            print(f"{name}={master.upload(name)}")
+        master.disconnect()
+    except XcpError as exc:
+        sys.exit(f"XCP: {exc}")
+    finally:
+        bus.shutdown()
+
+
+def parse_signals(text: str) -> List[str]:
+    signals = [s.strip() for s in text.split(",") if s.strip()]
+    unknown = [s for s in signals if s not in VARIABLES]
+    if not signals or unknown:
+        sys.exit(f"unknown signal(s): {', '.join(unknown) or '(none)'}; see --list")
+    return signals
+
+
+def measure(args: argparse.Namespace) -> None:
+    signals = parse_signals(args.signals)
+    bus = can.Bus(interface="socketcan", channel=args.channel,
+                  can_filters=[{"can_id": DTO_ID, "can_mask": 0x7FF, "extended": False}])
+    master = XcpMaster(bus)
+    writer = open_writer(args.output) if args.output else None
+    try:
+        master.connect()
+        layout = master.configure(signals, EVENTS[args.event], args.prescaler)
+        if args.output:
+            with open(layout_path(args.output), "w") as fp:
+                json.dump(layout.to_json(), fp)
+        dec = Decoder(layout)
+        csv_fp, out = open_csv(args.csv, dec.names)
+        print(f"DAQ {len(layout.odts)} ODT(s) per sample on event {args.event}, "
+              f"prescaler {args.prescaler}: {', '.join(signals)}", file=sys.stderr)
+
+        master.start()
+        t0 = time.monotonic()
+        frames = frame_bytes = 0
+        first_ts = last_ts = None
+        deadline = t0 + args.seconds
+        try:
+            while time.monotonic() < deadline:
+                msg = bus.recv(0.1)
+                if msg is None or msg.arbitration_id != DTO_ID:
+                    continue
+                data = bytes(msg.data)
+                frames += 1
+                frame_bytes += len(data)
+                if writer is not None:
+                    writer.write(CaptureFrame(int(msg.timestamp * 1e6), DTO_ID, len(data), data,
+                                              FLAG_HOST_TS))
+                row = dec.feed(data)
+                if row is not None:
+                    first_ts = row[0] if first_ts is None else first_ts
+                    last_ts = row[0]
+                    if out is not None:
+                        out.writerow(row)
+        except KeyboardInterrupt:
+            pass
+        wall = time.monotonic() - t0
+        master.stop()
+        master.disconnect()
+    except XcpError as exc:
+        sys.exit(f"XCP: {exc}")
+    finally:
+        if writer is not None:
+            writer.flush()
+            writer.fp.close()
+        bus.shutdown()
+    if csv_fp:
+        csv_fp.close()
+
+    esp_span = ((last_ts - first_ts) & 0xFFFFFFFF) / 1e6 if first_ts is not None else 0.0
+    rate = (dec.rows - 1) / esp_span if esp_span else 0.0
+    print(f"XCP seconds={wall:.1f} rows={dec.rows} sample_hz={rate:.0f} dto_frames={frames} "
+          f"dto_fps={frames / wall:.0f} payload_bytes={frame_bytes} incomplete={dec.incomplete} "
+          f"overload_flags={dec.overloads}")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Minimal XCP-on-CAN DAQ master")
+    parser.add_argument("--channel", default="can0")
+    parser.add_argument("-s", "--signals", help="comma-separated signal names (see --list)")
+    parser.add_argument("--event", choices=sorted(EVENTS, key=EVENTS.get), default="1ms")
+    parser.add_argument("--prescaler", type=int, default=1, help="sample every Nth event")
+    parser.add_argument("--seconds", type=float, default=10.0)
+    parser.add_argument("-o", "--output", help="capture file for DTO frames (*.cancap or *.pcapng)")
+    parser.add_argument("--csv", help="decoded samples as CSV")
+    parser.add_argument("--decode", metavar="CAPTURE", help="decode a recorded capture instead")
+    parser.add_argument("--read", metavar="SIGNALS", help="read signals once (SHORT_UPLOAD)")
+    parser.add_argument("--list", action="store_true", help="list signals and events")
+    args = parser.parse_args()
+
+    if args.list:
+        for name, (index, code) in VARIABLES.items():
+            print(f"signal {name:<18} address 1:{index:<3} {struct.calcsize(code)} byte(s)")
+        for name, number in EVENTS.items():
+            print(f"event  {name:<18} channel {number}")
+        return
+    if args.decode:
+        decode_capture(args)
+        return
+    if args.read:
+        read_once(args, parse_signals(args.read))
+        return
+    if not args.signals:
+        parser.error("--signals required (or --list / --read / --decode)")
+    if not 1 <= args.prescaler <= 255:
+        parser.error("--prescaler must be 1..255")
+    measure(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+Compare the Arduino and pure ESP-IDF builds of the node firmware.
+
+Footprint: builds both environments with `pio run` and parses the RAM/Flash
+summary PlatformIO prints. Runtime: parses the BENCH lines (-DCAN_BENCH=1)
+from a serial log of each build, e.g. recorded with pi/serial_capture.py.
+
+Usage:
+  python3 scripts/bench_compare.py [--arduino-log a.log] [--idf-log b.log] [--no-build]
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+from typing import Dict, Optional
+
+ENVS = {
+    "arduino": "esp32-s3-devkitc-1-bench",
+    "idf": "esp32-s3-devkitc-1-idf-bench",
+}
+
+SIZE_RE = re.compile(r"^(RAM|Flash):.*\(used (\d+) bytes from (\d+) bytes\)", re.M)
+BURST_RE = re.compile(r"BENCH platform=\w+ tx_burst frames=(\d+) us=(\d+) fps=(\d+)")
+RTT_RE = re.compile(r"BENCH platform=\w+ rtt_us n=(\d+) min=(\d+) avg=(\d+) max=(\d+)")
+COUNTER_RE = re.compile(r"BENCH platform=\w+ counter_inc_ns atomic=(\d+) sharded=(\d+)")
+
+
+def build_footprint(env: str) -> Dict[str, int]:
+    proc = subprocess.run(["pio", "run", "-e", env], capture_output=True, text=True)
+    if proc.returncode != 0:
+        sys.stderr.write(proc.stdout[-2000:] + proc.stderr[-2000:])
+        raise SystemExit(f"build failed for {env}")
+    return {kind.lower(): int(used) for kind, used, _total in SIZE_RE.findall(proc.stdout)}
+
+
+def parse_bench_log(path: str) -> Dict[str, int]:
+    result: Dict[str, int] = {}
+    with open(path, "r", errors="replace") as fp:
+        text = fp.read()
+    bursts = BURST_RE.findall(text)
+    if bursts:
+        result["burst_fps"] = max(int(b[2]) for b in bursts)
+    rtts = RTT_RE.findall(text)
+    if rtts:
+        # Lines are cumulative; the last one covers the whole run.
+        n, lo, avg, hi = (int(v) for v in rtts[-1])
+        result.update(rtt_n=n, rtt_min_us=lo, rtt_avg_us=avg, rtt_max_us=hi)
+    counters = COUNTER_RE.findall(text)
+    if counters:
+        atomic_ns, sharded_ns = (int(v) for v in counters[-1])
+        result.update(inc_atomic_ns=atomic_ns, inc_shard_ns=sharded_ns)
+    return result
+
+
+def fmt(v: Optional[int]) -> str:
+    return "-" if v is None else str(v)
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Arduino vs ESP-IDF build comparison")
+    parser.add_argument("--arduino-log", help="serial log of the Arduino bench build")
+    parser.add_argument("--idf-log", help="serial log of the ESP-IDF build")
+    parser.add_argument("--no-build", action="store_true", help="skip footprint builds")
+    args = parser.parse_args()
+
+    rows: Dict[str, Dict[str, int]] = {name: {} for name in ENVS}
+    if not args.no_build:
+        for name, env in ENVS.items():
+            rows[name].update(build_footprint(env))
+    if args.arduino_log:
+        rows["arduino"].update(parse_bench_log(args.arduino_log))
+    if args.idf_log:
+        rows["idf"].update(parse_bench_log(args.idf_log))
+
+    metrics = ["ram", "flash", "burst_fps", "rtt_min_us", "rtt_avg_us", "rtt_max_us", "rtt_n",
+               "inc_atomic_ns", "inc_shard_ns"]
+    print(f"{'metric':<14}{'arduino':>12}{'idf':>12}{'delta':>12}")
+    for m in metrics:
+        a = rows["arduino"].get(m)
+        b = rows["idf"].get(m)
+        delta = fmt(b - a) if a is not None and b is not None else "-"
+        print(f"{m:<14}{fmt(a):>12}{fmt(b):>12}{delta:>12}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+"""
+Per-feature memory footprint report and budget check for the ESP32-S3 build.
+
+Attributes every input section of the linker map to a feature module and
+sums it into one of four regions, by output section:
+
+  ram    internal DRAM (.dram0.*, .noinit)
+  iram   internal IRAM (.iram0.*)
+  flash  memory-mapped flash (.flash.*: code and rodata)
+  psram  external RAM (.ext_ram.*)
+
+Objects built from src/<module>.cpp are grouped into features according to
+scripts/footprint_budgets.json; anything from lib_deps is "lib:<name>" and
+the rest is "framework". With -fdata-sections/-ffunction-sections every
+variable and function has its own input section, so a feature pattern of
+the form "<module>/<symbol glob>" claims single objects, e.g. the XCP slave
+instance defined in main.cpp, for the feature of their type. The build
+fails when a feature exceeds a budget.
+
+Allocations made at runtime are not in the map. The node logs each one as
+`HEAP module=<module> internal=<bytes> psram=<bytes>`; --heap-log reads
+those lines from a serial log and checks the largest per module against the
+"heap" and "heap_psram" budgets.
+
+As a PlatformIO post-script (extra_scripts = post:scripts/footprint.py) it
+runs after every link and writes $BUILD_DIR/footprint.json. Standalone:
+  python3 scripts/footprint.py .pio/build/<env>/firmware.map
+  python3 scripts/footprint.py .pio/build/<env>/firmware.map --heap-log node.log
+"""
+
+import fnmatch
+import json
+import os
+import re
+import sys
+from collections import defaultdict
+from typing import Dict, List, Optional, Tuple
+
+REGIONS = ("ram", "iram", "flash", "psram")
+RUNTIME_REGIONS = ("heap", "heap_psram")
+
+REGION_PREFIXES = (
+    (".dram0.", "ram"),
+    (".noinit", "ram"),
+    (".iram0.", "iram"),
+    (".flash.", "flash"),
+    (".ext_ram.", "psram"),
+)
+
+OUTPUT_RE = re.compile(r"^(\.[\w.]+)(?:\s+0x[0-9a-fA-F]+\s+0x[0-9a-fA-F]+)?")
+INPUT_RE = re.compile(r"^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+INPUT_NAME_RE = re.compile(r"^ (\.\S+)$")
+SRC_OBJ_RE = re.compile(r"[/\\]src[/\\](?:.*[/\\])?([^/\\]+)\.(?:c|cc|cpp|S)\.o$")
+LIB_OBJ_RE = re.compile(r"\.pio[/\\]build[/\\][^/\\]+[/\\]lib[^/\\]*[/\\]([^/\\]+)[/\\]")
+SECTION_SYMBOL_RE = re.compile(r"^\.\w+\.(.+)$")  # .bss._ZL3xcp -> _ZL3xcp
+HEAP_RE = re.compile(r"HEAP module=(\S+) internal=(-?\d+) psram=(-?\d+)")
+
+BUDGETS_FILE = os.path.join("scripts", "footprint_budgets.json")  # relative to the project root
+
+
+def region_of(output_section: str) -> Optional[str]:
+    for prefix, region in REGION_PREFIXES:
+        if output_section.startswith(prefix):
+            return region
+    return None
+
+
+def owner_of(obj: str, section: Optional[str]) -> str:
+    m = SRC_OBJ_RE.search(obj)
+    if m:
+        s = SECTION_SYMBOL_RE.match(section) if section else None
+        return f"{m.group(1)}/{s.group(1)}" if s else m.group(1)
+    m = LIB_OBJ_RE.search(obj)
+    if m:
+        return f"lib:{m.group(1)}"
+    return "framework"
+
+
+def parse_map(path: str) -> Dict[str, Dict[str, int]]:
+    """Returns {owner: {region: bytes}} for every allocated input section.
+
+    Sections of our own sources are keyed "<module>/<symbol>" when the
+    section name carries one; group_features() folds them back.
+    """
+    usage: Dict[str, Dict[str, int]] = defaultdict(lambda: dict.fromkeys(REGIONS, 0))
+    in_map = False
+    region: Optional[str] = None
+    pending_name: Optional[str] = None
+
+    with open(path, "r", errors="replace") as fp:
+        for line in fp:
+            line = line.rstrip("\n")
+            if not in_map:
+                in_map = line.startswith("Linker script and memory map")
+                continue
+
+            if line.startswith("."):
+                m = OUTPUT_RE.match(line)
+                region = region_of(m.group(1)) if m else None
+                pending_name = None
+                continue
+            if region is None:
+                continue
+
+            m = INPUT_NAME_RE.match(line)
+            if m:
+                pending_name = m.group(1)  # long section name; address/size on next line
+                continue
+
+            m = INPUT_RE.match(line)
+            if m and (m.group(1) is not None or pending_name):
+                section = m.group(1) or pending_name
+                pending_name = None
+                if section == "*fill*":
+                    continue
+                size = int(m.group(3), 16)
+                if size:
+                    usage[owner_of(m.group(4).strip(), section)][region] += size
+            else:
+                pending_name = None
+
+    return dict(usage)
+
+
+def load_config(path: str) -> Tuple[Dict[str, List[str]], Dict[str, Dict[str, int]]]:
+    with open(path, "r") as fp:
+        cfg = json.load(fp)
+    return cfg.get("features", {}), cfg.get("budgets", {})
+
+
+def parse_heap_log(path: str) -> Dict[str, Dict[str, int]]:
+    """Returns {module: {runtime region: bytes}}, the largest logged per module."""
+    usage: Dict[str, Dict[str, int]] = defaultdict(lambda: dict.fromkeys(RUNTIME_REGIONS, 0))
+    with open(path, "r", errors="replace") as fp:
+        for line in fp:
+            m = HEAP_RE.search(line)
+            if m:
+                used = usage[m.group(1)]
+                used["heap"] = max(used["heap"], int(m.group(2)))
+                used["heap_psram"] = max(used["heap_psram"], int(m.group(3)))
+    return dict(usage)
+
+
+def feature_of(owner: str, features: Dict[str, List[str]]) -> str:
+    """Symbol patterns first, then the owner's module."""
+    module = owner.split("/", 1)[0]
+    for key in (owner, module) if module != owner else (owner,):
+        for name, patterns in features.items():
+            if any(fnmatch.fnmatch(key, p) for p in patterns):
+                return name
+    return module
+
+
+def group_features(usage: Dict[str, Dict[str, int]], features: Dict[str, List[str]],
+                   regions: Tuple[str, ...] = REGIONS) -> Dict[str, Dict[str, int]]:
+    grouped: Dict[str, Dict[str, int]] = defaultdict(lambda: dict.fromkeys(regions, 0))
+    for owner, used in usage.items():
+        feature = feature_of(owner, features)
+        for r, v in used.items():
+            grouped[feature][r] += v
+    return dict(grouped)
+
+
+def check_budgets(grouped: Dict[str, Dict[str, int]],
+                  budgets: Dict[str, Dict[str, int]]) -> List[str]:
+    violations = []
+    for feature, limits in budgets.items():
+        used = grouped.get(feature, dict.fromkeys(REGIONS, 0))
+        for region, limit in limits.items():
+            if used.get(region, 0) > limit:
+                violations.append(f"{feature}: {region} {used[region]} B exceeds budget {limit} B")
+    return violations
+
+
+def report(grouped: Dict[str, Dict[str, int]], budgets: Dict[str, Dict[str, int]],
+           regions: Tuple[str, ...] = REGIONS) -> str:
+    lines = [f"{'feature':<24}" + "".join(f"{r:>12}" for r in regions)]
+    order = sorted(grouped, key=lambda f: (f == "framework", f.startswith("lib:"), f))
+    for feature in order:
+        cells = []
+        for r in regions:
+            v = grouped[feature][r]
+            limit = budgets.get(feature, {}).get(r)
+            cells.append(f"{v}/{limit}" if limit is not None else str(v))
+        lines.append(f"{feature:<24}" + "".join(f"{c:>12}" for c in cells))
+    return "\n".join(lines)
+
+
+def run(map_path: str, config_path: str, json_out: Optional[str],
+        heap_log: Optional[str] = None) -> int:
+    features, budgets = load_config(config_path)
+    regions = REGIONS
+    usage = parse_map(map_path)
+    if heap_log:
+        regions = REGIONS + RUNTIME_REGIONS
+        for module, used in parse_heap_log(heap_log).items():
+            usage[module] = {**usage.get(module, dict.fromkeys(REGIONS, 0)), **used}
+    grouped = group_features(usage, features, regions)
+
+    print("Memory footprint by feature (bytes, used/budget):")
+    print(report(grouped, budgets, regions))
+    if json_out:
+        with open(json_out, "w") as fp:
+            json.dump({"features": grouped, "budgets": budgets}, fp, indent=1, sort_keys=True)
+
+    violations = check_budgets(grouped, budgets)
+    for v in violations:
+        print(f"FOOTPRINT BUDGET EXCEEDED: {v}")
+    return 1 if violations else 0
+
+
+def _platformio_hook() -> None:
+    Import("env")  # noqa: F821 - provided by SCons
+
+    map_path = os.path.join(env.subst("$BUILD_DIR"), "firmware.map")  # noqa: F821
+    budgets = os.path.join(env.subst("$PROJECT_DIR"), BUDGETS_FILE)  # noqa: F821
+    env.Append(LINKFLAGS=[f"-Wl,-Map={map_path}"])  # noqa: F821
+
+    def _post_link(target, source, env):  # noqa: ANN001 - SCons action signature
+        del target, source
+        json_out = os.path.join(env.subst("$BUILD_DIR"), "footprint.json")
+        return run(map_path, budgets, json_out)
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", _post_link)  # noqa: F821
+
+
+def main() -> None:
+    import argparse
+
+    parser = argparse.ArgumentParser(description="Per-feature footprint from a linker map")
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--budgets", default=BUDGETS_FILE)
+    parser.add_argument("--json", help="write the grouped report as JSON")
+    parser.add_argument("--heap-log", help="serial log with the node's HEAP module=... lines")
+    args = parser.parse_args()
+    sys.exit(run(args.map, args.budgets, args.json, args.heap_log))
+
+
+if __name__ == "__main__":
+    main()
+else:
+    _platformio_hook()  # loaded by PlatformIO/SCons via extra_scripts
@@ -0,0 +1,64 @@
+#include "burst_monitor.h"
+
+static uint16_t sat16(uint32_t v)
+{
+    return v > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(v);
+}
+
+void BurstMonitor::onFrame(const uint8_t *data, uint8_t dlc, uint32_t rxUs, uint32_t nowMs)
+{
+    if (dlc < 3) {
+        return;
+    }
+    const uint8_t  burst = data[0];
+    const uint16_t seq   = static_cast<uint16_t>(data[1] | (data[2] << 8));
+
+    if (!active_ || burst != burst_) {
+        active_  = true;
+        burst_   = burst;
+        frames_  = 1;
+        seqGaps_ = 0;
+        lastSeq_ = seq;
+        firstUs_ = rxUs;
+        lastUs_  = rxUs;
+        minGap_  = UINT32_MAX;
+        maxGap_  = 0;
+        lastMs_  = nowMs;
+        return;
+    }
+
+    const uint32_t gap = rxUs - lastUs_;
+    if (gap < minGap_) minGap_ = gap;
+    if (gap > maxGap_) maxGap_ = gap;
+    if (seq != static_cast<uint16_t>(lastSeq_ + 1)) {
+        seqGaps_++;
+    }
+
+    lastSeq_ = seq;
+    lastUs_  = rxUs;
+    lastMs_  = nowMs;
+    if (frames_ < 0xFFFF) {
+        frames_++;
+    }
+}
+
+bool BurstMonitor::takeReport(uint32_t nowMs, uint8_t report[8])
+{
+    if (!active_ || (nowMs - lastMs_) < IDLE_MS) {
+        return false;
+    }
+    active_ = false;
+
+    const uint32_t avg = frames_ > 1 ? (lastUs_ - firstUs_) / (frames_ - 1U) : 0;
+    const uint16_t fields[4] = {
+        frames_,
+        sat16(frames_ > 1 ? minGap_ : 0),
+        sat16(avg),
+        sat16(maxGap_),
+    };
+    for (uint8_t i = 0; i < 4; ++i) {
+        report[2 * i]     = static_cast<uint8_t>(fields[i]);
+        report[2 * i + 1] = static_cast<uint8_t>(fields[i] >> 8);
+    }
+    return true;
+}
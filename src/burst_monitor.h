@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Receive side of the Pi burst test (pi/burst_test.py). Burst frames carry
+// BURST(u8) SEQ(u16 LE); the monitor records inter-arrival gaps from the
+// RX timestamps and, once the burst goes quiet, produces a report the node
+// sends back on REPORT_ID:
+//   FRAMES(u16) MIN_GAP_US(u16) AVG_GAP_US(u16) MAX_GAP_US(u16), LE, saturating
+class BurstMonitor {
+public:
+    static constexpr uint32_t DATA_ID   = 0x7B0;  // Pi -> ESP burst frames
+    static constexpr uint32_t REPORT_ID = 0x7B1;  // ESP -> Pi summary
+    static constexpr uint32_t IDLE_MS   = 200;    // quiet time that ends a burst
+
+    void onFrame(const uint8_t *data, uint8_t dlc, uint32_t rxUs, uint32_t nowMs);
+
+    // True once per finished burst; fills the 8-byte report payload.
+    bool takeReport(uint32_t nowMs, uint8_t report[8]);
+
+    uint8_t  burst() const { return burst_; }
+    uint16_t frames() const { return frames_; }
+    uint16_t seqGaps() const { return seqGaps_; }
+
+private:
+    bool     active_  = false;
+    uint8_t  burst_   = 0;
+    uint16_t frames_  = 0;
+    uint16_t seqGaps_ = 0;
+    uint16_t lastSeq_ = 0;
+    uint32_t firstUs_ = 0;
+    uint32_t lastUs_  = 0;
+    uint32_t minGap_  = 0;
+    uint32_t maxGap_  = 0;
+    uint32_t lastMs_  = 0;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+// MCP2515 driver selection: the autowp library on the Arduino core, the
+// spi_master port with the same interface on bare ESP-IDF.
+#if defined(ARDUINO)
+#include <mcp2515.h>
+#else
+#include "mcp2515_idf.h"
+#endif
+
+#include <new>
+
+// Re-creates the driver with another SPI clock; the autowp class fixes the
+// clock at construction. On ESP-IDF this also releases the CS pin.
+inline void canDriverSetSpiClock(MCP2515 &mcp, uint8_t csPin, uint32_t hz)
+{
+    mcp.~MCP2515();
+    new (&mcp) MCP2515(csPin, hz);
+}
@@ -0,0 +1,168 @@
+#include "capture_encoder.h"
+
+#include <string.h>
+
+// linux/can.h flag bits as used by the MCP2515 library's struct can_frame
+static constexpr uint32_t CAN_EFF_BIT = 0x80000000UL;
+static constexpr uint32_t CAN_RTR_BIT = 0x40000000UL;
+static constexpr uint32_t CAN_ID_MASK = 0x1FFFFFFFUL;
+
+static uint32_t packKey(uint32_t canId, bool tx)
+{
+    uint32_t packed = canId & CAN_ID_MASK;
+    if (canId & CAN_EFF_BIT) packed |= 1UL << 29;
+    if (canId & CAN_RTR_BIT) packed |= 1UL << 30;
+    return (packed << 1) | (tx ? 1U : 0U);
+}
+
+CaptureEncoder::CaptureEncoder(Sink sink) : sink_(sink)
+{
+    resetDictionary();
+}
+
+void CaptureEncoder::resetDictionary()
+{
+    memset(slots_, 0, sizeof(slots_));
+    nextSlot_ = 0;
+    lastHit_  = 0;
+}
+
+void CaptureEncoder::openBlock(uint32_t tsUs)
+{
+    len_ = 0;
+    block_[len_++] = seq_;
+
+    if (blocksSinceKeyframe_ == 0) {
+        resetDictionary();
+        prevTsUs_ = tsUs;
+        block_[len_++] = FLAG_KEYFRAME;
+        block_[len_++] = static_cast<uint8_t>(tsUs);
+        block_[len_++] = static_cast<uint8_t>(tsUs >> 8);
+        block_[len_++] = static_cast<uint8_t>(tsUs >> 16);
+        block_[len_++] = static_cast<uint8_t>(tsUs >> 24);
+    } else {
+        block_[len_++] = 0;
+    }
+
+    hasOpenBlock_ = true;
+}
+
+void CaptureEncoder::flush()
+{
+    if (!hasOpenBlock_) {
+        return;
+    }
+    sink_(block_, len_);
+    bytesEmitted_ += len_;
+
+    hasOpenBlock_ = false;
+    seq_++;
+    if (++blocksSinceKeyframe_ >= KEYFRAME_INTERVAL) {
+        blocksSinceKeyframe_ = 0;
+    }
+}
+
+uint8_t CaptureEncoder::lookupOrInsert(uint32_t key, bool &miss)
+{
+    if (slots_[lastHit_].valid && slots_[lastHit_].key == key) {
+        miss = false;
+        return lastHit_;
+    }
+    for (uint8_t i = 0; i < DICT_SLOTS; ++i) {
+        if (slots_[i].valid && slots_[i].key == key) {
+            miss = false;
+            lastHit_ = i;
+            return i;
+        }
+    }
+
+    // Round-robin replacement; the slot index travels in the tag so the
+    // decoder never has to mirror the policy.
+    const uint8_t idx = nextSlot_;
+    nextSlot_ = static_cast<uint8_t>((nextSlot_ + 1) % DICT_SLOTS);
+
+    Slot &s = slots_[idx];
+    memset(&s, 0, sizeof(s));
+    s.key   = key;
+    s.dlc   = 0xFF;  // forces a DLC byte on first use
+    s.valid = true;
+
+    miss = true;
+    lastHit_ = idx;
+    return idx;
+}
+
+void CaptureEncoder::putVarint(uint32_t v)
+{
+    while (v >= 0x80) {
+        block_[len_++] = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    block_[len_++] = static_cast<uint8_t>(v);
+}
+
+void CaptureEncoder::putZigzag(int32_t v)
+{
+    putVarint((static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31));
+}
+
+void CaptureEncoder::add(uint32_t canId, uint8_t dlc, const uint8_t *data, uint32_t tsUs, bool tx)
+{
+    if (dlc > 8) {
+        dlc = 8;
+    }
+    if (hasOpenBlock_ && (BLOCK_CAPACITY - len_) < MAX_FRAME_BYTES) {
+        flush();
+    }
+    if (!hasOpenBlock_) {
+        openBlock(tsUs);
+    }
+
+    const uint32_t key = packKey(canId, tx);
+    bool miss = false;
+    const uint8_t idx = lookupOrInsert(key, miss);
+    Slot &s = slots_[idx];
+
+    uint8_t xorBytes[8];
+    uint8_t mask = 0;
+    for (uint8_t i = 0; i < dlc; ++i) {
+        xorBytes[i] = data[i] ^ s.data[i];
+        if (xorBytes[i] != 0) {
+            mask |= static_cast<uint8_t>(1U << i);
+        }
+    }
+
+    uint8_t tag = idx;
+    if (miss)         tag |= TAG_MISS;
+    if (dlc != s.dlc) tag |= TAG_DLC;
+    if (mask == 0)    tag |= TAG_SAME;
+    block_[len_++] = tag;
+
+    if (miss) {
+        putVarint(key);
+        putZigzag(static_cast<int32_t>(tsUs - prevTsUs_));
+    } else {
+        const uint32_t delta = tsUs - s.lastTsUs;
+        putZigzag(static_cast<int32_t>(delta - s.periodUs));
+        s.periodUs = delta;
+    }
+
+    if (tag & TAG_DLC) {
+        block_[len_++] = dlc;
+    }
+    if (mask != 0) {
+        block_[len_++] = mask;
+        for (uint8_t i = 0; i < dlc; ++i) {
+            if (mask & (1U << i)) {
+                block_[len_++] = xorBytes[i];
+            }
+        }
+    }
+
+    memcpy(s.data, data, dlc);
+    memset(s.data + dlc, 0, sizeof(s.data) - dlc);
+    s.dlc      = dlc;
+    s.lastTsUs = tsUs;
+    prevTsUs_  = tsUs;
+    framesEncoded_++;
+}
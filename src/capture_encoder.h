@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming capture encoder: packs CAN frames into compact blocks so live
+// captures fit over the serial link instead of 16-byte raw records.
+//
+// Block:  SEQ(u8) FLAGS(u8) [BASE_TS_US(u32 LE) if keyframe] FRAME...
+// Frame:  TAG(u8)              bit7 ID literal follows (dictionary miss)
+//                              bit6 DLC byte follows
+//                              bit5 payload unchanged for this ID
+//                              bit0-4 dictionary slot
+//         [KEY varint]         (id << 1) | tx, EFF/RTR packed into bits 29/30
+//         TS zigzag varint     miss: delta to previous frame
+//                              hit:  (delta to last frame of this ID) - last period
+//         [DLC u8]
+//         [MASK u8, BYTES]     payload XOR previous payload of this ID, only
+//                              the non-zero bytes flagged in MASK are sent
+//
+// Dictionary and timestamp state reset on every keyframe so the host decoder
+// (pi/capture_codec.py) resynchronises after a lost block. RAM: ~1 KB.
+class CaptureEncoder {
+public:
+    using Sink = void (*)(const uint8_t *block, size_t len);
+
+    static constexpr uint8_t DICT_SLOTS        = 32;
+    static constexpr size_t  BLOCK_CAPACITY    = 240;
+    static constexpr uint8_t KEYFRAME_INTERVAL = 16;  // blocks between state resets
+
+    static constexpr uint8_t FLAG_KEYFRAME = 0x01;
+
+    static constexpr uint8_t TAG_MISS      = 0x80;
+    static constexpr uint8_t TAG_DLC       = 0x40;
+    static constexpr uint8_t TAG_SAME      = 0x20;
+    static constexpr uint8_t TAG_SLOT_MASK = 0x1F;
+
+    explicit CaptureEncoder(Sink sink);
+
+    void add(uint32_t canId, uint8_t dlc, const uint8_t *data, uint32_t tsUs, bool tx);
+    void flush();
+
+    size_t   pendingBytes() const { return hasOpenBlock_ ? len_ : 0; }
+    uint32_t framesEncoded() const { return framesEncoded_; }
+    uint32_t bytesEmitted() const { return bytesEmitted_; }
+
+private:
+    struct Slot {
+        uint32_t key;
+        uint32_t lastTsUs;
+        uint32_t periodUs;
+        uint8_t  dlc;
+        uint8_t  data[8];
+        bool     valid;
+    };
+
+    static constexpr size_t MAX_FRAME_BYTES = 1 + 5 + 5 + 1 + 1 + 8;
+
+    void openBlock(uint32_t tsUs);
+    void resetDictionary();
+    uint8_t lookupOrInsert(uint32_t key, bool &miss);
+    void putVarint(uint32_t v);
+    void putZigzag(int32_t v);
+
+    Sink     sink_;
+    Slot     slots_[DICT_SLOTS];
+    uint8_t  nextSlot_ = 0;
+    uint8_t  lastHit_  = 0;
+    uint32_t prevTsUs_ = 0;
+
+    uint8_t  block_[BLOCK_CAPACITY];
+    size_t   len_ = 0;
+    bool     hasOpenBlock_ = false;
+    uint8_t  seq_ = 0;
+    uint8_t  blocksSinceKeyframe_ = 0;
+
+    uint32_t framesEncoded_ = 0;
+    uint32_t bytesEmitted_  = 0;
+};
@@ -0,0 +1,49 @@
+#include "console.h"
+
+#include "platform.h"
+
+void Console::poll()
+{
+    uint8_t buf[32];
+    size_t n;
+    while ((n = platformRead(buf, sizeof(buf))) > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            const char c = static_cast<char>(buf[i]);
+            if (c == '\r' || c == '\n') {
+                if (!overflow_ && len_ > 0) {
+                    dispatch();
+                }
+                len_      = 0;
+                overflow_ = false;
+            } else if (len_ < LINE_MAX) {
+                line_[len_++] = c;
+            } else {
+                overflow_ = true;
+            }
+        }
+    }
+}
+
+void Console::dispatch()
+{
+    line_[len_] = '\0';
+
+    char   *argv[ARGS_MAX];
+    uint8_t argc = 0;
+    char   *p    = line_;
+    while (*p != '\0' && argc < ARGS_MAX) {
+        while (*p == ' ') {
+            *p++ = '\0';
+        }
+        if (*p == '\0') {
+            break;
+        }
+        argv[argc++] = p;
+        while (*p != '\0' && *p != ' ') {
+            p++;
+        }
+    }
+    if (argc > 0) {
+        handler_(argc, argv);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Line-oriented command input on the serial link. poll() drains whatever the
+// host has typed, splits complete lines on spaces and hands them to the
+// handler; the host side needs nothing but a terminal.
+class Console {
+public:
+    static constexpr size_t  LINE_MAX = 64;
+    static constexpr uint8_t ARGS_MAX = 6;
+
+    using Handler = void (*)(uint8_t argc, char **argv);
+
+    explicit Console(Handler handler) : handler_(handler) {}
+
+    void poll();
+
+private:
+    void dispatch();
+
+    Handler handler_;
+    char    line_[LINE_MAX + 1] = {};
+    size_t  len_      = 0;
+    bool    overflow_ = false;  // current line too long; dropped at '\n'
+};
@@ -0,0 +1,326 @@
+#include "firmware_update.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+
+static constexpr uint8_t REQ_BEGIN  = 0x01;
+static constexpr uint8_t REQ_DATA   = 0x02;
+static constexpr uint8_t REQ_END    = 0x03;
+static constexpr uint8_t REQ_ABORT  = 0x04;
+static constexpr uint8_t RESPONSE   = 0x40;  // response code = request | RESPONSE
+
+static constexpr uint8_t BEGIN_LEN       = 9;
+static constexpr uint8_t DATA_HEADER_LEN = 7;
+
+static uint16_t readU16(const uint8_t *p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t readU32(const uint8_t *p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// CRC-32 (IEEE, as zlib.crc32); bitwise since it runs on the writer task.
+static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return crc;
+}
+
+FirmwareUpdate::FirmwareUpdate(uint32_t responseId, IsoTp::SendFn send)
+    : link_(responseId, send, BLOCK_SIZE, 0)
+{
+    link_.setRxBuffer(cmdBuf_, sizeof(cmdBuf_));
+}
+
+void FirmwareUpdate::writerTask(void *arg)
+{
+    static_cast<FirmwareUpdate *>(arg)->writerLoop();
+}
+
+void FirmwareUpdate::writerLoop()
+{
+    if (!platformOtaBegin(size_)) {
+        writerOk_ = false;
+        writerDone_.store(true, std::memory_order_release);
+        return;
+    }
+    erased_.store(true, std::memory_order_release);
+
+    uint32_t crc  = 0xFFFFFFFFu;
+    uint8_t  next = 0;
+    for (;;) {
+        Chunk &c = chunks_[next];
+        if (c.state.load(std::memory_order_acquire) == FULL) {
+            c.ok = platformOtaWrite(c.data, c.len);
+            crc  = crc32Update(crc, c.data, c.len);
+            c.state.store(WRITTEN, std::memory_order_release);
+            next = (next + 1) % BUFFERS;
+            continue;
+        }
+        const uint8_t cmd = command_.load(std::memory_order_acquire);
+        if (cmd == FINISH) {
+            writerOk_ = (crc ^ 0xFFFFFFFFu) == crc_;
+            if (writerOk_) {
+                writerOk_ = platformOtaEnd();
+            } else {
+                platformOtaAbort();
+            }
+            break;
+        }
+        if (cmd == ABORT) {
+            platformOtaAbort();
+            writerOk_ = false;
+            break;
+        }
+        platformDelay(1);
+    }
+    writerDone_.store(true, std::memory_order_release);
+}
+
+void FirmwareUpdate::respond(const uint8_t *msg, uint8_t len)
+{
+    link_.sendSingle(msg, len);  // a lost response surfaces as a host timeout
+}
+
+void FirmwareUpdate::respondData(uint16_t seq, Status status, uint32_t nextOffset)
+{
+    const uint8_t msg[] = {
+        REQ_DATA | RESPONSE, static_cast<uint8_t>(seq), static_cast<uint8_t>(seq >> 8), status,
+        static_cast<uint8_t>(nextOffset), static_cast<uint8_t>(nextOffset >> 8),
+        static_cast<uint8_t>(nextOffset >> 16),
+    };
+    respond(msg, sizeof(msg));
+}
+
+void FirmwareUpdate::release()
+{
+    free(block_);
+    block_ = nullptr;
+    rxBuf_ = cmdBuf_;
+    link_.setRxBuffer(cmdBuf_, sizeof(cmdBuf_));
+    state_ = IDLE;
+}
+
+void FirmwareUpdate::abort(Status status)
+{
+    lastStatus_ = status;
+    state_      = ABORTING;
+    command_.store(ABORT, std::memory_order_release);
+}
+
+void FirmwareUpdate::handleBegin(const uint8_t *msg, uint16_t len, uint32_t nowMs)
+{
+    uint8_t reply[5] = {REQ_BEGIN | RESPONSE, OK, 0, 0, 0};
+    if (len != BEGIN_LEN) {
+        reply[1] = BAD_REQUEST;
+    } else if (state_ != IDLE) {
+        reply[1] = BUSY;
+    } else {
+        const uint32_t size = readU32(msg + 1);
+        if (size != 0 && size <= platformOtaCapacity()) {
+            block_ = static_cast<uint8_t *>(malloc(IsoTp::MESSAGE_MAX + BUFFERS * CHUNK_MAX));
+        }
+        if (size == 0 || size > platformOtaCapacity()) {
+            reply[1] = TOO_LARGE;
+        } else if (!block_) {
+            reply[1] = NO_MEMORY;
+        } else {
+            size_       = size;
+            crc_        = readU32(msg + 5);
+            nextOffset_ = 0;
+            written_    = 0;
+            fillIndex_  = 0;
+            ackIndex_   = 0;
+            for (uint8_t i = 0; i < BUFFERS; ++i) {
+                chunks_[i].data = block_ + IsoTp::MESSAGE_MAX + i * CHUNK_MAX;
+                chunks_[i].state.store(FREE, std::memory_order_relaxed);
+            }
+            command_.store(RUN, std::memory_order_relaxed);
+            erased_.store(false, std::memory_order_relaxed);
+            writerDone_.store(false, std::memory_order_relaxed);
+            if (!platformRunOnCore(writerTask, this, WRITER_CORE)) {
+                release();
+                reply[1] = NO_MEMORY;
+            } else {
+                rxBuf_ = block_;
+                link_.setRxBuffer(block_, IsoTp::MESSAGE_MAX);
+                state_   = ERASING;
+                startMs_ = nowMs;
+                return;  // READY once the writer has erased the range
+            }
+        }
+    }
+    lastStatus_ = static_cast<Status>(reply[1]);
+    respond(reply, sizeof(reply));
+}
+
+void FirmwareUpdate::handleData(const uint8_t *msg, uint16_t len)
+{
+    if (len < 3) {
+        return;
+    }
+    const uint16_t seq = readU16(msg + 1);
+    if (state_ != RECEIVING) {
+        respondData(seq, NOT_ACTIVE, 0);
+        return;
+    }
+    if (len <= DATA_HEADER_LEN) {
+        respondData(seq, BAD_REQUEST, nextOffset_);
+        return;
+    }
+    const uint32_t offset = readU32(msg + 3);
+    const uint16_t n      = len - DATA_HEADER_LEN;
+    if (offset != nextOffset_) {
+        respondData(seq, OUT_OF_ORDER, nextOffset_);
+        return;
+    }
+    if (n > size_ - offset) {
+        respondData(seq, BAD_REQUEST, nextOffset_);
+        return;
+    }
+    Chunk &c = chunks_[fillIndex_];
+    if (c.state.load(std::memory_order_acquire) != FREE) {
+        respondData(seq, BUSY, nextOffset_);
+        return;
+    }
+    memcpy(c.data, msg + DATA_HEADER_LEN, n);
+    c.len = n;
+    c.seq = seq;
+    c.state.store(FULL, std::memory_order_release);
+    fillIndex_ = (fillIndex_ + 1) % BUFFERS;
+    nextOffset_ += n;
+}
+
+void FirmwareUpdate::handleMessage(const uint8_t *msg, uint16_t len, uint32_t nowMs)
+{
+    switch (msg[0]) {
+    case REQ_BEGIN:
+        handleBegin(msg, len, nowMs);
+        break;
+    case REQ_DATA:
+        handleData(msg, len);
+        break;
+    case REQ_END: {
+        uint8_t reply[2] = {REQ_END | RESPONSE, OK};
+        if (state_ != RECEIVING) {
+            reply[1] = NOT_ACTIVE;
+        } else if (written_ != size_) {
+            reply[1] = BAD_REQUEST;  // chunks still missing or unacknowledged
+        } else {
+            state_ = FINISHING;
+            command_.store(FINISH, std::memory_order_release);
+            return;  // answered once the writer has verified the image
+        }
+        respond(reply, sizeof(reply));
+        break;
+    }
+    case REQ_ABORT: {
+        const uint8_t reply[2] = {REQ_ABORT | RESPONSE,
+                                  static_cast<uint8_t>(state_ == IDLE || state_ == ABORTING ? NOT_ACTIVE : OK)};
+        respond(reply, sizeof(reply));
+        if (reply[1] == OK) {
+            abort(OK);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void FirmwareUpdate::onFrame(const uint8_t *data, uint8_t len, uint32_t nowMs)
+{
+    lastRxMs_ = nowMs;
+    switch (link_.onFrame(data, len, nowMs)) {
+    case IsoTp::MESSAGE:
+        handleMessage(rxBuf_, link_.rxLength(), nowMs);
+        break;
+    case IsoTp::ABORTED:
+        // Frames were lost mid-chunk: the first frame's header names it.
+        if (rxBuf_[0] == REQ_DATA && state_ == RECEIVING) {
+            respondData(readU16(rxBuf_ + 1), OUT_OF_ORDER, nextOffset_);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+FirmwareUpdate::Event FirmwareUpdate::poll(uint32_t nowMs)
+{
+    link_.poll(nowMs);
+    const bool writerDone = writerDone_.load(std::memory_order_acquire);
+
+    switch (state_) {
+    case IDLE:
+        return EVENT_NONE;
+
+    case ERASING:
+        if (writerDone) {
+            const uint8_t reply[5] = {REQ_BEGIN | RESPONSE, FLASH_ERROR, 0, 0, 0};
+            respond(reply, sizeof(reply));
+            lastStatus_ = FLASH_ERROR;
+            release();
+            return EVENT_FAILED;
+        }
+        if (erased_.load(std::memory_order_acquire)) {
+            const uint8_t reply[5] = {REQ_BEGIN | RESPONSE, OK, static_cast<uint8_t>(CHUNK_MAX),
+                                      static_cast<uint8_t>(CHUNK_MAX >> 8), BUFFERS};
+            respond(reply, sizeof(reply));
+            state_    = RECEIVING;
+            eraseMs_  = nowMs - startMs_;
+            startMs_  = nowMs;
+            lastRxMs_ = nowMs;
+            return EVENT_STARTED;
+        }
+        return EVENT_NONE;
+
+    case ABORTING:
+        if (writerDone) {
+            release();
+            return EVENT_FAILED;
+        }
+        return EVENT_NONE;
+
+    case RECEIVING:
+    case FINISHING:
+        break;
+    }
+
+    // Acknowledge flashed chunks in order.
+    Chunk &c = chunks_[ackIndex_];
+    if (c.state.load(std::memory_order_acquire) == WRITTEN) {
+        if (!c.ok) {
+            respondData(c.seq, FLASH_ERROR, written_);
+            abort(FLASH_ERROR);
+            return EVENT_NONE;
+        }
+        written_ += c.len;
+        respondData(c.seq, OK, written_);
+        c.state.store(FREE, std::memory_order_release);
+        ackIndex_ = (ackIndex_ + 1) % BUFFERS;
+    }
+
+    if (state_ == FINISHING && writerDone) {
+        lastStatus_ = writerOk_ ? OK : VERIFY_FAILED;
+        const uint8_t reply[2] = {REQ_END | RESPONSE, lastStatus_};
+        respond(reply, sizeof(reply));
+        release();
+        return lastStatus_ == OK ? EVENT_DONE : EVENT_FAILED;
+    }
+    if (state_ == RECEIVING && nowMs - lastRxMs_ > SESSION_TIMEOUT_MS) {
+        abort(TIMEOUT);
+    }
+    return EVENT_NONE;
+}
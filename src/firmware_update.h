@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "isotp.h"
+
+// Firmware download over CAN into the passive OTA partition. Requests and
+// responses are ISO-TP messages (isotp.h); the host (pi/can_update.py) keeps
+// at most BUFFERS DATA messages unacknowledged.
+//
+//   BEGIN  01 size:u32 crc32:u32      -> 41 status chunk_max:u16 window:u8
+//   DATA   02 seq:u16 offset:u32 ...  -> 42 seq:u16 status next_offset:u24
+//   END    03                         -> 43 status       (then reboot on 0)
+//   ABORT  04                         -> 44 status
+//
+// Integers are little-endian. A DATA message is copied into one of two
+// chunk buffers and acknowledged only once a writer task on the other core
+// has flashed it, so reception of chunk n+1 overlaps the flash write of
+// chunk n and the host window never outruns the buffers. Any DATA that is
+// not the expected next chunk is answered with the offset to resume from.
+// BEGIN erases the target range on the writer task too; READY (41) follows
+// when it is done.
+class FirmwareUpdate {
+public:
+    static constexpr uint8_t  BUFFERS            = 2;
+    static constexpr uint16_t CHUNK_MAX          = IsoTp::MESSAGE_MAX - 7;  // minus DATA header
+    static constexpr uint8_t  BLOCK_SIZE         = 32;     // CFs per flow control window
+    static constexpr uint32_t SESSION_TIMEOUT_MS = 10000;  // host silence that abandons a session
+    static constexpr uint8_t  WRITER_CORE        = 0;
+
+    enum Status : uint8_t {
+        OK = 0,
+        BUSY,           // another session, or chunk window exceeded
+        TOO_LARGE,      // image does not fit the OTA partition
+        NO_MEMORY,
+        FLASH_ERROR,
+        OUT_OF_ORDER,   // not the expected offset; resume at next_offset
+        VERIFY_FAILED,  // CRC or image validation failed
+        NOT_ACTIVE,
+        BAD_REQUEST,
+        TIMEOUT,        // host went silent mid-session
+    };
+
+    enum Event : uint8_t {
+        EVENT_NONE,
+        EVENT_STARTED,  // erase finished, receiving
+        EVENT_FAILED,   // session ended without a new image; see lastStatus()
+        EVENT_DONE,     // image verified and selected; reboot to run it
+    };
+
+    FirmwareUpdate(uint32_t responseId, IsoTp::SendFn send);
+
+    void  onFrame(const uint8_t *data, uint8_t len, uint32_t nowMs);
+    Event poll(uint32_t nowMs);
+
+    bool     active() const { return state_ != IDLE; }
+    uint32_t imageSize() const { return size_; }
+    uint32_t written() const { return written_; }
+    uint32_t eraseMs() const { return eraseMs_; }
+    uint32_t elapsedMs(uint32_t nowMs) const { return nowMs - startMs_; }  // since READY
+    Status   lastStatus() const { return lastStatus_; }
+    uint32_t transportAborts() const { return link_.aborts(); }
+
+private:
+    enum State : uint8_t { IDLE, ERASING, RECEIVING, FINISHING, ABORTING };
+    enum BufferState : uint8_t { FREE, FULL, WRITTEN };
+    enum Command : uint8_t { RUN, FINISH, ABORT };
+
+    struct Chunk {
+        uint8_t *data = nullptr;
+        uint16_t len  = 0;
+        uint16_t seq  = 0;
+        bool     ok   = false;
+        std::atomic<uint8_t> state{FREE};
+    };
+
+    static void writerTask(void *arg);
+    void writerLoop();
+
+    void handleMessage(const uint8_t *msg, uint16_t len, uint32_t nowMs);
+    void handleBegin(const uint8_t *msg, uint16_t len, uint32_t nowMs);
+    void handleData(const uint8_t *msg, uint16_t len);
+    void respond(const uint8_t *msg, uint8_t len);
+    void respondData(uint16_t seq, Status status, uint32_t nextOffset);
+    void abort(Status status);
+    void release();
+
+    IsoTp    link_;
+    uint8_t  cmdBuf_[16] = {};   // assembles requests between sessions
+    uint8_t *block_      = nullptr;  // rx buffer + BUFFERS chunks, one allocation
+    uint8_t *rxBuf_      = cmdBuf_;
+    Chunk    chunks_[BUFFERS];
+    uint8_t  fillIndex_  = 0;
+    uint8_t  ackIndex_   = 0;
+
+    State    state_       = IDLE;
+    Status   lastStatus_  = OK;
+    uint32_t size_        = 0;
+    uint32_t crc_         = 0;
+    uint32_t nextOffset_  = 0;   // accepted into a chunk buffer
+    uint32_t written_     = 0;   // flashed and acknowledged
+    uint32_t startMs_     = 0;
+    uint32_t eraseMs_     = 0;
+    uint32_t lastRxMs_    = 0;
+
+    // Shared with the writer task.
+    std::atomic<uint8_t> command_{RUN};
+    std::atomic<bool>    erased_{false};
+    std::atomic<bool>    writerDone_{false};
+    bool                 writerOk_ = false;  // published by writerDone_
+};
@@ -0,0 +1,102 @@
+#include "histogram.h"
+
+#include <math.h>
+#include <string.h>
+
+static constexpr uint32_t SUB_COUNT = 1U << LatencyHistogram::SUB_BITS;
+
+static uint8_t *putVarint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<uint8_t>(v);
+    return p;
+}
+
+uint16_t LatencyHistogram::indexOf(uint32_t value)
+{
+    if (value < SUB_COUNT) {
+        return static_cast<uint16_t>(value);
+    }
+    const uint32_t msb = 31U - static_cast<uint32_t>(__builtin_clz(value));
+    if (msb >= MAX_BITS) {
+        return BUCKETS - 1;
+    }
+    const uint32_t octave = msb - SUB_BITS;
+    return static_cast<uint16_t>(SUB_COUNT + octave * SUB_COUNT + ((value >> octave) - SUB_COUNT));
+}
+
+uint32_t LatencyHistogram::highestEquivalent(uint16_t index)
+{
+    if (index < SUB_COUNT) {
+        return index;
+    }
+    const uint32_t octave = index / SUB_COUNT - 1;
+    const uint32_t low    = (SUB_COUNT + index % SUB_COUNT) << octave;
+    return low + (1U << octave) - 1;
+}
+
+void LatencyHistogram::record(uint32_t value)
+{
+    counts_[indexOf(value)]++;
+    total_++;
+    if (value < min_) min_ = value;
+    if (value > max_) max_ = value;
+}
+
+void LatencyHistogram::reset()
+{
+    memset(counts_, 0, sizeof(counts_));
+    total_ = 0;
+    min_   = UINT32_MAX;
+    max_   = 0;
+}
+
+uint32_t LatencyHistogram::valueAtPercentile(double percentile) const
+{
+    if (total_ == 0) {
+        return 0;
+    }
+    // Rank of the sample at or below which `percentile` of samples fall;
+    // computed in double exactly like pi/histogram.py.
+    uint32_t rank = static_cast<uint32_t>(ceil(percentile * total_ / 100.0));
+    if (rank < 1) rank = 1;
+    if (rank > total_) rank = total_;
+
+    uint32_t seen = 0;
+    for (uint16_t i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            const uint32_t v = highestEquivalent(i);
+            return v < max_ ? v : max_;
+        }
+    }
+    return max_;
+}
+
+size_t LatencyHistogram::encode(uint8_t *out, size_t cap, uint8_t series, uint16_t &cursor) const
+{
+    uint8_t *p = out;
+    *p++ = VERSION;
+    *p++ = series;
+    *p++ = SUB_BITS;
+    *p++ = MAX_BITS;
+    p = putVarint(p, total_ ? min_ : 0);
+    p = putVarint(p, max_);
+
+    uint16_t next = 0;  // bucket after the previously encoded one in this chunk
+    while (cursor < BUCKETS) {
+        if (counts_[cursor] != 0) {
+            if (static_cast<size_t>(p - out) + 3 + 5 > cap) {
+                break;  // rest goes into the next chunk
+            }
+            p = putVarint(p, cursor - next);
+            p = putVarint(p, counts_[cursor]);
+            next = cursor + 1;
+        }
+        cursor++;
+    }
+    return static_cast<size_t>(p - out);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-linear (HDR-style) latency histogram with a fixed bucket layout shared
+// with pi/histogram.py, so histograms from any node or run merge by adding
+// bucket counts and percentiles stay exact to the bucket resolution.
+//
+// Values below 2^SUB_BITS get one bucket each; every octave above is split
+// into 2^SUB_BITS equal buckets (relative error < 1/32). Values at or above
+// 2^MAX_BITS land in the top bucket; the exact max is kept separately.
+//
+// Wire format (telemetry TYPE_HISTOGRAM, also used in .telrec files):
+//   VERSION(u8) SERIES(u8) SUB_BITS(u8) MAX_BITS(u8) MIN(varint) MAX(varint)
+//   { INDEX_DELTA(varint) COUNT(varint) }...   non-empty buckets only
+// INDEX_DELTA counts from the bucket after the previous pair (from bucket 0
+// for the first pair). A histogram may be split over several records; each
+// decodes on its own as a partial histogram and merges the same way.
+class LatencyHistogram {
+public:
+    static constexpr uint8_t  VERSION  = 1;
+    static constexpr uint8_t  SUB_BITS = 5;
+    static constexpr uint8_t  MAX_BITS = 24;  // 16.7 s in microseconds
+    static constexpr uint16_t BUCKETS  = (1U << SUB_BITS) * (1 + MAX_BITS - SUB_BITS);
+
+    // Series identifiers (keep in sync with pi/histogram.py)
+    static constexpr uint8_t SERIES_ESP_RTT = 1;  // ESP-initiated ping RTT, measured on the ESP
+    static constexpr uint8_t SERIES_PI_RTT  = 2;  // Pi-initiated ping RTT, measured on the Pi
+
+    static uint16_t indexOf(uint32_t value);
+    static uint32_t highestEquivalent(uint16_t index);
+
+    void record(uint32_t value);
+    void reset();
+
+    uint32_t count() const { return total_; }
+    uint32_t max() const { return max_; }
+    uint32_t valueAtPercentile(double percentile) const;
+
+    // Encodes buckets from `cursor` on into out[0..cap) and advances cursor;
+    // all buckets are sent once cursor == BUCKETS. cap must be >= MIN_CHUNK.
+    static constexpr size_t MIN_CHUNK = 4 + 5 + 5 + 3 + 5;
+    size_t encode(uint8_t *out, size_t cap, uint8_t series, uint16_t &cursor) const;
+
+private:
+    uint32_t counts_[BUCKETS] = {};
+    uint32_t total_ = 0;
+    uint32_t min_   = UINT32_MAX;
+    uint32_t max_   = 0;
+};
@@ -0,0 +1,220 @@
+#include "isotp.h"
+
+#include <string.h>
+
+static constexpr uint8_t PCI_SINGLE      = 0x0;
+static constexpr uint8_t PCI_FIRST       = 0x1;
+static constexpr uint8_t PCI_CONSECUTIVE = 0x2;
+static constexpr uint8_t PCI_FLOW        = 0x3;
+
+static constexpr uint8_t FC_CONTINUE = 0;
+static constexpr uint8_t FC_WAIT     = 1;
+static constexpr uint8_t FC_OVERFLOW = 2;
+
+// STmin: 0..127 ms, F1..F9 100..900 us (rounded up to 1 ms), reserved values
+// mean the maximum.
+static uint8_t stMinMs(uint8_t st)
+{
+    if (st <= 0x7F) {
+        return st;
+    }
+    return (st >= 0xF1 && st <= 0xF9) ? 1 : 0x7F;
+}
+
+void IsoTp::setRxBuffer(uint8_t *buf, uint16_t cap)
+{
+    rxBuf_     = buf;
+    rxCap_     = cap;
+    receiving_ = false;
+}
+
+bool IsoTp::sendFlowControl(uint8_t status)
+{
+    uint8_t fc[8];
+    memset(fc, PADDING, sizeof(fc));
+    fc[0] = static_cast<uint8_t>((PCI_FLOW << 4) | status);
+    fc[1] = blockSize_;
+    fc[2] = stMin_;
+    return send_(txId_, fc, sizeof(fc));
+}
+
+IsoTp::Result IsoTp::onFrame(const uint8_t *data, uint8_t len, uint32_t nowMs)
+{
+    if (len == 0 || !rxBuf_) {
+        return NONE;
+    }
+    switch (data[0] >> 4) {
+    case PCI_SINGLE: {
+        const uint8_t n = data[0] & 0x0F;
+        if (n == 0 || n > SINGLE_MAX || n >= len || n > rxCap_) {
+            return NONE;
+        }
+        receiving_ = false;  // a new message replaces an unfinished one
+        memcpy(rxBuf_, data + 1, n);
+        rxLen_ = n;
+        return MESSAGE;
+    }
+    case PCI_FIRST: {
+        if (len < 8) {
+            return NONE;
+        }
+        const uint16_t total = static_cast<uint16_t>(((data[0] & 0x0F) << 8) | data[1]);
+        if (total <= SINGLE_MAX) {
+            return NONE;
+        }
+        if (total > rxCap_) {
+            receiving_ = false;
+            sendFlowControl(FC_OVERFLOW);
+            return NONE;
+        }
+        memcpy(rxBuf_, data + 2, 6);
+        rxLen_     = total;
+        rxPos_     = 6;
+        nextSn_    = 1;
+        blockLeft_ = blockSize_;
+        receiving_ = true;
+        lastRxMs_  = nowMs;
+        fcPending_ = !sendFlowControl(FC_CONTINUE);
+        return NONE;
+    }
+    case PCI_CONSECUTIVE: {
+        if (!receiving_) {
+            return NONE;
+        }
+        if ((data[0] & 0x0F) != nextSn_) {
+            receiving_ = false;
+            aborts_++;
+            return ABORTED;
+        }
+        nextSn_   = (nextSn_ + 1) & 0x0F;
+        lastRxMs_ = nowMs;
+        uint16_t n = rxLen_ - rxPos_;
+        if (n > static_cast<uint16_t>(len - 1)) {
+            n = len - 1;
+        }
+        memcpy(rxBuf_ + rxPos_, data + 1, n);
+        rxPos_ += n;
+        if (rxPos_ >= rxLen_) {
+            receiving_ = false;
+            return MESSAGE;
+        }
+        if (blockSize_ && --blockLeft_ == 0) {
+            blockLeft_ = blockSize_;
+            fcPending_ = !sendFlowControl(FC_CONTINUE);
+        }
+        return NONE;
+    }
+    case PCI_FLOW:
+        onFlowControl(data, len, nowMs);
+        return NONE;
+    default:
+        return NONE;
+    }
+}
+
+void IsoTp::onFlowControl(const uint8_t *data, uint8_t len, uint32_t nowMs)
+{
+    if (txState_ != TX_WAIT_FC || len < 3) {
+        return;
+    }
+    switch (data[0] & 0x0F) {
+    case FC_CONTINUE: {
+        const uint8_t st = stMinMs(data[2]);
+        txBlockLeft_ = data[1];
+        txGapMs_     = st > TX_GAP_MIN_MS ? st : TX_GAP_MIN_MS;
+        txState_     = TX_SENDING;
+        txTimerMs_   = nowMs - txGapMs_;  // first consecutive frame right away
+        sendConsecutive(nowMs);
+        break;
+    }
+    case FC_WAIT:
+        txTimerMs_ = nowMs;  // the peer restarts N_Bs
+        break;
+    default:
+        txState_ = TX_IDLE;  // overflow: the peer cannot take the message
+        aborts_++;
+        break;
+    }
+}
+
+void IsoTp::sendConsecutive(uint32_t nowMs)
+{
+    if (nowMs - txTimerMs_ < txGapMs_) {
+        return;
+    }
+    uint8_t cf[8];
+    memset(cf, PADDING, sizeof(cf));
+    cf[0] = static_cast<uint8_t>((PCI_CONSECUTIVE << 4) | txSn_);
+    uint16_t n = txLen_ - txPos_;
+    if (n > 7) {
+        n = 7;
+    }
+    memcpy(cf + 1, txBuf_ + txPos_, n);
+    if (!send_(txId_, cf, sizeof(cf))) {
+        return;  // no TX buffer free; retried on the next poll
+    }
+    txPos_ += n;
+    txSn_      = (txSn_ + 1) & 0x0F;
+    txTimerMs_ = nowMs;
+    if (txPos_ >= txLen_) {
+        txState_ = TX_IDLE;
+    } else if (txBlockLeft_ && --txBlockLeft_ == 0) {
+        txState_ = TX_WAIT_FC;
+    }
+}
+
+void IsoTp::poll(uint32_t nowMs)
+{
+    if (txState_ == TX_SENDING) {
+        sendConsecutive(nowMs);
+    } else if (txState_ == TX_WAIT_FC && nowMs - txTimerMs_ > N_BS_MS) {
+        txState_ = TX_IDLE;
+        aborts_++;
+    }
+    if (!receiving_) {
+        return;
+    }
+    if (fcPending_) {
+        fcPending_ = !sendFlowControl(FC_CONTINUE);
+    }
+    if (nowMs - lastRxMs_ > N_CR_MS) {
+        receiving_ = false;
+        aborts_++;
+    }
+}
+
+bool IsoTp::sendSingle(const uint8_t *data, uint8_t len)
+{
+    if (len == 0 || len > SINGLE_MAX) {
+        return false;
+    }
+    uint8_t sf[8];
+    memset(sf, PADDING, sizeof(sf));
+    sf[0] = static_cast<uint8_t>((PCI_SINGLE << 4) | len);
+    memcpy(sf + 1, data, len);
+    return send_(txId_, sf, sizeof(sf));
+}
+
+bool IsoTp::send(const uint8_t *data, uint16_t len, uint32_t nowMs)
+{
+    if (txState_ != TX_IDLE || len == 0 || len > MESSAGE_MAX) {
+        return false;
+    }
+    if (len <= SINGLE_MAX) {
+        return sendSingle(data, static_cast<uint8_t>(len));
+    }
+    uint8_t ff[8];
+    ff[0] = static_cast<uint8_t>((PCI_FIRST << 4) | (len >> 8));
+    ff[1] = static_cast<uint8_t>(len);
+    memcpy(ff + 2, data, 6);
+    if (!send_(txId_, ff, sizeof(ff))) {
+        return false;
+    }
+    txBuf_     = data;
+    txLen_     = len;
+    txPos_     = 6;
+    txSn_      = 1;
+    txState_   = TX_WAIT_FC;
+    txTimerMs_ = nowMs;
+    return true;
+}
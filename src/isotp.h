@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ISO 15765-2 (ISO-TP) for classic CAN, normal addressing, frames padded to
+// 8 bytes. Messages of up to 4095 bytes arrive as a first frame plus
+// consecutive frames; after the first frame and every blockSize consecutive
+// frames the receiver answers with a flow control frame, which is the
+// sender's window. send() does the same in the other direction, driven by
+// the peer's flow control and paced by poll().
+//
+//   SF  0L dd..      L = 1..7
+//   FF  1L LL dd..   12-bit length, 6 data bytes
+//   CF  2N dd..      N = sequence number mod 16, first CF is 1
+//   FC  3S BS ST     S: 0 continue, 1 wait, 2 overflow
+class IsoTp {
+public:
+    using SendFn = bool (*)(uint32_t id, const uint8_t *data, uint8_t len);
+
+    static constexpr uint16_t MESSAGE_MAX  = 4095;
+    static constexpr uint8_t  SINGLE_MAX   = 7;
+    static constexpr uint32_t N_CR_MS      = 1000;  // max gap between consecutive frames
+    static constexpr uint32_t N_BS_MS      = 1000;  // max wait for the peer's flow control
+    // Floor for the gap between sent consecutive frames. The MCP2515 sends
+    // the highest-numbered of several pending equal-priority buffers first,
+    // so a frame is only queued once the previous one has surely left.
+    static constexpr uint8_t  TX_GAP_MIN_MS = 3;
+    static constexpr uint8_t  PADDING      = 0xCC;
+
+    enum Result : uint8_t {
+        NONE,      // frame consumed, message still incomplete
+        MESSAGE,   // a message of rxLength() bytes is in the buffer
+        ABORTED,   // sequence error; the buffer still holds what arrived
+    };
+
+    IsoTp(uint32_t txId, SendFn send, uint8_t blockSize, uint8_t stMinMs)
+        : txId_(txId), send_(send), blockSize_(blockSize), stMin_(stMinMs) {}
+
+    // Where received messages are assembled; longer ones are refused.
+    void setRxBuffer(uint8_t *buf, uint16_t cap);
+
+    Result onFrame(const uint8_t *data, uint8_t len, uint32_t nowMs);
+    // Sends due consecutive frames, retries a flow control frame the
+    // controller had no room for and times out stalled transfers.
+    void poll(uint32_t nowMs);
+
+    bool sendSingle(const uint8_t *data, uint8_t len);
+    // Starts a message: a single frame, or a first frame whose remainder
+    // follows once the peer grants it. `data` must stay valid while
+    // txBusy(). False (nothing sent) if a message is still in progress or
+    // the controller had no room.
+    bool send(const uint8_t *data, uint16_t len, uint32_t nowMs);
+
+    bool     txBusy() const { return txState_ != TX_IDLE; }
+    uint16_t rxLength() const { return rxLen_; }
+    uint32_t aborts() const { return aborts_; }
+
+private:
+    enum TxState : uint8_t { TX_IDLE, TX_WAIT_FC, TX_SENDING };
+
+    bool sendFlowControl(uint8_t status);
+    void onFlowControl(const uint8_t *data, uint8_t len, uint32_t nowMs);
+    void sendConsecutive(uint32_t nowMs);
+
+    uint32_t txId_;
+    SendFn   send_;
+    uint8_t  blockSize_;
+    uint8_t  stMin_;
+
+    uint8_t *rxBuf_      = nullptr;
+    uint16_t rxCap_      = 0;
+    uint16_t rxLen_      = 0;  // announced length of the message in progress
+    uint16_t rxPos_      = 0;
+    uint8_t  nextSn_     = 0;
+    uint8_t  blockLeft_  = 0;
+    bool     receiving_  = false;
+    bool     fcPending_  = false;
+    uint32_t lastRxMs_   = 0;
+
+    const uint8_t *txBuf_ = nullptr;
+    uint16_t txLen_       = 0;
+    uint16_t txPos_       = 0;
+    uint8_t  txSn_        = 0;
+    uint8_t  txBlockLeft_ = 0;  // consecutive frames until the next flow control; 0: unlimited
+    uint8_t  txGapMs_     = 0;
+    TxState  txState_     = TX_IDLE;
+    uint32_t txTimerMs_   = 0;  // last consecutive frame, or start of the flow control wait
+
+    uint32_t aborts_      = 0;
+};
@@ -0,0 +1,91 @@
+#include "link_quality.h"
+
+// Smoothing per event stream, chosen for its rate: pings at 1 Hz, health
+// samples at 5 Hz (~13 s time constant), TX per frame.
+static constexpr float ALPHA_DELIVERY = 1.0f / 8;
+static constexpr float ALPHA_TX       = 1.0f / 16;
+static constexpr float ALPHA_HEALTH   = 1.0f / 64;
+static constexpr float ALPHA_RTT      = 1.0f / 8;
+
+static constexpr float WEIGHTS[LinkQuality::COMPONENT_COUNT] = {
+    0.35f,  // DELIVERY
+    0.20f,  // TX
+    0.15f,  // RX
+    0.15f,  // STABILITY
+    0.15f,  // LATENCY
+};
+
+static inline void ewma(float &acc, float sample, float alpha)
+{
+    acc += alpha * (sample - acc);
+}
+
+static void putU16(uint8_t *&p, uint16_t v)
+{
+    *p++ = static_cast<uint8_t>(v);
+    *p++ = static_cast<uint8_t>(v >> 8);
+}
+
+static void putU32(uint8_t *&p, uint32_t v)
+{
+    putU16(p, static_cast<uint16_t>(v));
+    putU16(p, static_cast<uint16_t>(v >> 16));
+}
+
+void LinkQuality::onPingMatched(uint32_t rttUs)
+{
+    pings_++;
+    ewma(comp_[DELIVERY], 1.0f, ALPHA_DELIVERY);
+
+    if (rttEwmaUs_ == 0.0f) {
+        rttEwmaUs_ = static_cast<float>(rttUs);
+    } else {
+        ewma(rttEwmaUs_, static_cast<float>(rttUs), ALPHA_RTT);
+    }
+    comp_[LATENCY] = (rttEwmaUs_ <= RTT_TARGET_US) ? 1.0f : RTT_TARGET_US / rttEwmaUs_;
+}
+
+void LinkQuality::onPingFailed()
+{
+    pings_++;
+    failures_++;
+    ewma(comp_[DELIVERY], 0.0f, ALPHA_DELIVERY);
+}
+
+void LinkQuality::onTxResult(bool ok)
+{
+    ewma(comp_[TX], ok ? 1.0f : 0.0f, ALPHA_TX);
+}
+
+void LinkQuality::onHealthSample(bool overflow, bool reinit)
+{
+    ewma(comp_[RX], overflow ? 0.0f : 1.0f, ALPHA_HEALTH);
+    ewma(comp_[STABILITY], reinit ? 0.0f : 1.0f, ALPHA_HEALTH);
+}
+
+uint16_t LinkQuality::componentPermille(Component c) const
+{
+    return static_cast<uint16_t>(comp_[c] * 1000.0f + 0.5f);
+}
+
+uint16_t LinkQuality::scorePermille() const
+{
+    float s = 0.0f;
+    for (uint8_t i = 0; i < COMPONENT_COUNT; ++i) {
+        s += WEIGHTS[i] * comp_[i];
+    }
+    return static_cast<uint16_t>(s * 1000.0f + 0.5f);
+}
+
+size_t LinkQuality::encode(uint8_t *out) const
+{
+    uint8_t *p = out;
+    putU16(p, scorePermille());
+    for (uint8_t i = 0; i < COMPONENT_COUNT; ++i) {
+        putU16(p, componentPermille(static_cast<Component>(i)));
+    }
+    putU32(p, rttEwmaUs());
+    putU32(p, pings_);
+    putU32(p, failures_);
+    return static_cast<size_t>(p - out);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Exponentially weighted link quality score, updated in O(1) per event from
+// the stats the node already gathers. Each component is an EWMA in [0, 1];
+// the score is their weighted sum in permille. pi/link_quality.py implements
+// the same model for the Pi runner and decodes the telemetry record.
+class LinkQuality {
+public:
+    enum Component : uint8_t {
+        DELIVERY,   // ping answered with a matching payload
+        TX,         // sendMessage() accepted the frame
+        RX,         // no RX overflow in the health sample
+        STABILITY,  // no controller re-init in the health sample
+        LATENCY,    // RTT EWMA against the target
+        COMPONENT_COUNT
+    };
+
+    static constexpr uint32_t RTT_TARGET_US = 5000;
+
+    // Telemetry payload: score, components (u16 permille each), RTT EWMA,
+    // ping and failure counters (u32), little endian.
+    static constexpr size_t RECORD_SIZE = 2 * (1 + COMPONENT_COUNT) + 3 * 4;
+
+    void onPingMatched(uint32_t rttUs);
+    void onPingFailed();  // mismatch or no answer before the next ping
+    void onTxResult(bool ok);
+    void onHealthSample(bool overflow, bool reinit);
+
+    uint16_t componentPermille(Component c) const;
+    uint16_t scorePermille() const;
+    uint32_t rttEwmaUs() const { return static_cast<uint32_t>(rttEwmaUs_); }
+
+    size_t encode(uint8_t *out) const;
+
+private:
+    float    comp_[COMPONENT_COUNT] = {1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+    float    rttEwmaUs_ = 0.0f;
+    uint32_t pings_     = 0;
+    uint32_t failures_  = 0;
+};
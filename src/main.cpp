@@ -1,10 +1,89 @@
-#include <Arduino.h>
-#include <SPI.h>
-#include <mcp2515.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "burst_monitor.h"
+#include "can_driver.h"
+#include "capture_encoder.h"
+#include "console.h"
+#include "firmware_update.h"
+#include "histogram.h"
+#include "link_quality.h"
+#include "metric_history.h"
+#include "node_stats.h"
+#include "platform.h"
+#include "reinit_governor.h"
+#include "soak_monitor.h"
+#include "spi_calibration.h"
+#include "telemetry.h"
+#include "traffic_sketch.h"
+#include "uds_server.h"
+#include "xcp_slave.h"
+
+// Build with -DCAN_CAPTURE_STREAM=1 (env esp32-s3-devkitc-1-capture) to stream
+// every RX/TX frame as compressed telemetry; per-frame text logs are then muted.
+#ifndef CAN_CAPTURE_STREAM
+#define CAN_CAPTURE_STREAM 0
+#endif
+
+// Binary telemetry records (link quality, ...) alongside the text log. On by
+// default whenever the capture stream is, since the host must demux anyway.
+#ifndef CAN_TELEMETRY
+#define CAN_TELEMETRY CAN_CAPTURE_STREAM
+#endif
+
+// Build with -DCAN_BENCH=1 to print BENCH lines (TX burst rate at boot, echo
+// RTT every BENCH_REPORT_MS); scripts/bench_compare.py compares platforms.
+#ifndef CAN_BENCH
+#define CAN_BENCH 0
+#endif
+
+// Build with -DCAN_SOAK=1 (env esp32-s3-devkitc-1-soak) for multi-day runs:
+// every minute sample feeds a drift regression (RTT, error and re-init rates,
+// heap, stack, serial and RX high-water marks) and degradations are logged
+// as SOAK DRIFT lines.
+#ifndef CAN_SOAK
+#define CAN_SOAK 0
+#endif
+
+// Firmware download over ISO-TP into the OTA partition (pi/can_update.py).
+// Build with -DCAN_UPDATE=1 (env esp32-s3-devkitc-1-update) to accept images
+// over the bus.
+#ifndef CAN_UPDATE
+#define CAN_UPDATE 0
+#endif
+
+// XCP-on-CAN measurement slave with DAQ lists (pi/xcp_master.py). Build with
+// -DCAN_XCP=0 to drop it.
+#ifndef CAN_XCP
+#define CAN_XCP 1
+#endif
+
+// UDS diagnostic server on ISO-TP (pi/uds_tester.py). Build with -DCAN_UDS=0
+// to drop it.
+#ifndef CAN_UDS
+#define CAN_UDS 1
+#endif
+
+// Build with -DCAN_PROFILE=1 (env esp32-s3-devkitc-1-profile) to profile bus
+// traffic in fixed memory: heavy-hitter IDs, distinct-ID estimate and a top-K
+// table, logged as PROFILE lines. Per-frame TX/RX text is muted.
+#ifndef CAN_PROFILE
+#define CAN_PROFILE 0
+#endif
+
+// Ceiling for the exponential backoff between automatic MCP2515 re-inits.
+#ifndef CAN_REINIT_BACKOFF_MAX_MS
+#define CAN_REINIT_BACKOFF_MAX_MS 30000
+#endif
 
 // ESP32-S3 <-> MCP2515 pin mapping (8 MHz MCP2515 crystal)
 #define CAN_CS_PIN   41  // SPI chip-select
-#define CAN_INT_PIN  40  // Interrupt line from MCP2515 (currently polled)
+#define CAN_INT_PIN  40  // Interrupt line from MCP2515 (falls back to polling)
 #define CAN_SPI_SCK  48
 #define CAN_SPI_MISO 21
 #define CAN_SPI_MOSI 47
@@ -14,28 +93,152 @@ static constexpr uint32_t ESP_PING_ID = 0x123;  // ESP -> Pi
 static constexpr uint32_t ESP_PONG_ID = 0x124;  // Pi -> ESP
 static constexpr uint32_t PI_PING_ID  = 0x223;  // Pi -> ESP
 static constexpr uint32_t PI_PONG_ID  = 0x224;  // ESP -> Pi
+static constexpr uint32_t UPDATE_REQUEST_ID  = 0x6F0;  // Pi -> ESP, ISO-TP; below ping-pong priority
+static constexpr uint32_t UPDATE_RESPONSE_ID = 0x6F8;  // ESP -> Pi
+static constexpr uint32_t XCP_CRO_ID         = 0x6E0;  // Pi -> ESP, XCP commands
+static constexpr uint32_t XCP_DTO_ID         = 0x6E8;  // ESP -> Pi, responses and DAQ packets
+static constexpr uint32_t UDS_REQUEST_ID     = 0x6D0;  // Pi -> ESP, ISO-TP; 0x7E0 is the bench burst
+static constexpr uint32_t UDS_RESPONSE_ID    = 0x6D8;  // ESP -> Pi
+static constexpr uint32_t STRESS_ID          = 0x7C0;  // Pi load (bcm_stress.py, uds_tester.py), counted only
+
+static constexpr uint32_t CAN_BITRATE = 125000;
 
 // Timing and robustness parameters
 static constexpr uint32_t PING_PERIOD_MS       = 1000;  // ESP-initiated ping cadence
 static constexpr uint32_t ACTIVITY_TIMEOUT_MS  = 5000;  // re-init if idle and errors accumulate
 static constexpr uint8_t  ERROR_REINIT_LIMIT   = 5;     // consecutive send errors before re-init
 static constexpr uint32_t HEALTH_CHECK_PERIOD_MS = 200; // controller health poll
+static constexpr uint32_t CAPTURE_FLUSH_MS     = 100;   // max age of a partial capture block
+static constexpr uint32_t BENCH_REPORT_MS      = 10000; // BENCH rtt line cadence
+static constexpr uint32_t METRICS_REPORT_MS    = 10000; // METRICS line cadence
+static constexpr uint32_t REINIT_BACKOFF_MIN_MS = 250;  // spacing after the first re-init
+static constexpr uint32_t REINIT_STABLE_MS     = 30000; // healthy time that resets the backoff
+static constexpr uint16_t BENCH_BURST_FRAMES   = 500;   // frames in the boot TX burst
+static constexpr uint32_t BENCH_BURST_ID       = 0x7E0; // ignored by the Pi runner
+static constexpr uint32_t BENCH_COUNTER_INCS   = 200000; // increments per core in the counter bench
+static constexpr uint32_t SOAK_REPORT_MS       = 600000; // SOAK/TREND summary cadence
+static constexpr uint32_t PROFILE_REPORT_MS    = 60000; // PROFILE summary cadence
+static constexpr uint32_t UPDATE_REPORT_MS     = 5000;  // UPDATE progress cadence
+static constexpr uint32_t HEAP_INTERNAL_FLOOR  = 32768; // HEAP LOW below this free internal RAM
+static constexpr uint8_t  HISTORY_LINES_PER_LOOP = 4;   // history dump pacing
+static constexpr size_t   HISTORY_LINE_MAX     = 160;   // serial space one HIST line needs
+static constexpr uint32_t HEAP_PSRAM_FLOOR     = 65536; // same for PSRAM, when fitted
+// ISO-TP payload at 100 % bus load: 7 bytes per 8-byte consecutive frame of
+// 114 bits with stuff bits, the length isotp_capacity_bps() in
+// pi/can_update.py computes, so both ends report the same efficiency.
+static constexpr uint32_t UPDATE_FRAME_BITS    = 114;
+static constexpr uint32_t UPDATE_CAPACITY_BPS  = CAN_BITRATE * 7 / UPDATE_FRAME_BITS;
 
 static MCP2515 mcp2515(CAN_CS_PIN);
+static uint32_t spiClockHz = SPI_CALIBRATION_STEPS_HZ[0];
+static constexpr const char *SPI_CLOCK_KEY = "spi_hz";  // persisted calibration result
 
 static struct can_frame espPingFrame;
 static struct can_frame rxFrame;
 static struct can_frame lastEspPingSent;
 static bool             hasLastEspPing = false;
+static bool             espPingAnswered = false;
 static volatile bool    canIntPending  = false;
+static volatile uint32_t canIntUs      = 0;  // ISR timestamp of the latest INT edge
 
 static uint8_t  espPingCounter   = 0;
 static uint32_t lastPingMillis   = 0;
-static uint32_t lastActivityMs   = 0;
-static uint8_t  consecutiveSendErrors = 0;
-static uint8_t  consecutivePassiveErrors = 0;
 static uint32_t lastHealthCheckMs = 0;
 
+static uint32_t lastEspPingSentUs = 0;
+static uint32_t rttMinUs = UINT32_MAX;
+static uint32_t rttMaxUs = 0;
+static uint64_t rttSumUs = 0;
+static uint32_t rttCount = 0;
+static uint32_t lastBenchReportMs = 0;
+static uint32_t lastMetricsReportMs = 0;
+static bool     psramFitted         = false;
+static bool     heapLowReported     = false;
+static bool     psramLowReported    = false;
+static LatencyHistogram rttHistogram;  // ESP-initiated RTT, reset every METRICS_REPORT_MS
+static MetricHistory    metricHistory;
+static SoakMonitor      soakMonitor;
+static uint32_t         soakLastMinuteS  = 0;         // endS of the last minute fed to soakMonitor
+static uint32_t         lastSoakReportMs = 0;
+static size_t           soakTxFreeMin    = SIZE_MAX;  // per-minute high-water marks
+static uint16_t         soakRxBatchMax   = 0;
+static TrafficSketch    trafficSketch;
+static uint32_t         lastProfileReportMs = 0;
+static uint32_t         lastUpdateReportMs  = 0;
+
+// XCP DAQ event channels; pi/xcp_master.py mirrors this table.
+enum XcpEvent : uint8_t { XCP_EVENT_LOOP, XCP_EVENT_1MS, XCP_EVENT_RX, XCP_EVENT_COUNT };
+
+// Measurement values for XCP, refreshed right before DAQ events fire.
+static struct {
+    uint32_t rxFrames;
+    uint32_t txFrames;
+    uint32_t txErrors;
+    uint32_t rxOverflows;
+    uint32_t reinits;
+    uint32_t lastRttUs;
+    uint32_t loopUs;        // duration of the previous loop iteration
+    uint32_t serialTxFree;  // bytes free in the serial TX buffer
+    uint16_t rxBatch;       // frames drained from the MCP2515 in this iteration
+    uint8_t  sendErrorStreak;
+    uint32_t intEdges;
+    uint32_t idleMs;        // since the last successful RX or TX
+} xcpSignals;
+
+// Index = XCP address with extension 1; pi/xcp_master.py mirrors this table.
+static const XcpSlave::Variable XCP_VARIABLES[] = {
+    {"rx_frames",         &xcpSignals.rxFrames,        4},
+    {"tx_frames",         &xcpSignals.txFrames,        4},
+    {"tx_errors",         &xcpSignals.txErrors,        4},
+    {"rx_overflows",      &xcpSignals.rxOverflows,     4},
+    {"reinits",           &xcpSignals.reinits,         4},
+    {"last_rtt_us",       &xcpSignals.lastRttUs,       4},
+    {"loop_us",           &xcpSignals.loopUs,          4},
+    {"serial_tx_free",    &xcpSignals.serialTxFree,    4},
+    {"rx_batch",          &xcpSignals.rxBatch,         2},
+    {"send_error_streak", &xcpSignals.sendErrorStreak, 1},
+    {"int_edges",         &xcpSignals.intEdges,        4},
+    {"idle_ms",           &xcpSignals.idleMs,          4},
+};
+static uint32_t lastXcpTickUs = 0;
+
+// Request-to-response time on the node: RX time of a request's last frame
+// until the response's first frame is in the controller.
+static struct {
+    uint32_t requestUs;  // RX time of the latest UDS frame
+    uint32_t responses;
+    uint32_t maxUs;
+    uint32_t late;       // slower than the announced P2
+} udsTiming;
+
+// UDS data identifiers (big-endian on the wire); pi/uds_tester.py mirrors
+// this table. The counters share the XCP values, refreshed per request.
+static const UdsServer::DataId UDS_DIDS[] = {
+    {0x0100, &xcpSignals.rxFrames,     4},
+    {0x0101, &xcpSignals.txFrames,     4},
+    {0x0102, &xcpSignals.txErrors,     4},
+    {0x0103, &xcpSignals.rxOverflows,  4},
+    {0x0104, &xcpSignals.reinits,      4},
+    {0x0105, &xcpSignals.lastRttUs,    4},
+    {0x0106, &xcpSignals.loopUs,       4},
+    {0x0107, &xcpSignals.serialTxFree, 4},
+    {0x0108, &xcpSignals.intEdges,     4},
+    {0x0109, &xcpSignals.idleMs,       4},
+    {0x010A, &xcpSignals.sendErrorStreak, 1},
+    {0x0110, &udsTiming.responses,     4},
+    {0x0111, &udsTiming.maxUs,         4},
+    {0x0112, &udsTiming.late,          4},
+};
+
+static ReinitGovernor reinitGovernor({REINIT_BACKOFF_MIN_MS, CAN_REINIT_BACKOFF_MAX_MS, REINIT_STABLE_MS});
+static LinkQuality    linkQuality;
+static BurstMonitor   burstMonitor;
+static bool           reinitSinceHealthSample = false;
+
+static NodeStats   stats = {};  // loop-task working copy, published every iteration
+Seqlock<NodeStats> nodeStats;
+FrameCounters      frameCounters;
+
 // MCP2515 EFLG bit masks (per datasheet)
 static constexpr uint8_t EFLG_RX1OVR = 0x80;
 static constexpr uint8_t EFLG_RX0OVR = 0x40;
@@ -48,9 +251,48 @@ static constexpr uint8_t EFLG_EWARN  = 0x01;
 
 static void IRAM_ATTR onCanInt()
 {
+    canIntUs      = platformMicros();
+    frameCounters.intEdges.addFromIsr();
     canIntPending = true;
 }
 
+#if CAN_CAPTURE_STREAM
+static void emitCaptureBlock(const uint8_t *block, size_t len)
+{
+    telemetrySend(TELEMETRY_TYPE_CAPTURE, block, len);
+}
+
+// About 1 KB of dictionary and block buffer, so only capture builds carry it.
+static CaptureEncoder captureEncoder(emitCaptureBlock);
+static uint32_t       lastCaptureFlushMs = 0;
+#endif
+
+static void captureFrame(const struct can_frame &frame, bool tx)
+{
+#if CAN_CAPTURE_STREAM
+    captureEncoder.add(frame.can_id, frame.can_dlc, frame.data, platformMicros(), tx);
+#else
+    (void)frame;
+    (void)tx;
+#endif
+}
+
+static void flushCaptureIfStale(uint32_t now)
+{
+#if CAN_CAPTURE_STREAM
+    if (captureEncoder.pendingBytes() == 0) {
+        lastCaptureFlushMs = now;
+        return;
+    }
+    if ((now - lastCaptureFlushMs) >= CAPTURE_FLUSH_MS) {
+        captureEncoder.flush();
+        lastCaptureFlushMs = now;
+    }
+#else
+    (void)now;
+#endif
+}
+
 // Build the fixed test payload with a simple counter for verification.
 static void buildPattern(struct can_frame &frame, uint32_t id, uint8_t counter)
 {
@@ -98,18 +340,17 @@ static bool framesEqual(const struct can_frame &a, const struct can_frame &b)
 
 static void logFrame(const char *prefix, const struct can_frame &frame)
 {
-    Serial.print(prefix);
-    Serial.print(" ID=0x");
-    Serial.print(frame.can_id, HEX);
-    Serial.print(" DLC=");
-    Serial.print(frame.can_dlc);
-    Serial.print(" DATA=");
-    for (uint8_t i = 0; i < frame.can_dlc; ++i) {
-        if (frame.data[i] < 0x10) Serial.print('0');
-        Serial.print(frame.data[i], HEX);
-        Serial.print(' ');
+    if (CAN_CAPTURE_STREAM || CAN_PROFILE) {
+        return;  // frames travel in the capture stream / are summarised instead
     }
-    Serial.println();
+    char hex[3 * CAN_MAX_DLEN + 1];
+    size_t n = 0;
+    for (uint8_t i = 0; i < frame.can_dlc && i < CAN_MAX_DLEN; ++i) {
+        n += snprintf(hex + n, sizeof(hex) - n, "%02X ", frame.data[i]);
+    }
+    hex[n] = '\0';
+    logPrintf("%s ID=0x%lX DLC=%u DATA=%s\n", prefix,
+              static_cast<unsigned long>(frame.can_id), frame.can_dlc, hex);
 }
 
 static bool initCan()
@@ -118,55 +359,313 @@ static bool initCan()
 
     const auto bitrateErr = mcp2515.setBitrate(CAN_125KBPS, MCP_8MHZ);
     if (bitrateErr != MCP2515::ERROR_OK) {
-        Serial.print("setBitrate failed: ");
-        Serial.println(static_cast<int>(bitrateErr));
+        logPrintf("setBitrate failed: %d\n", static_cast<int>(bitrateErr));
         return false;
     }
 
     const auto modeErr = mcp2515.setNormalMode();
     if (modeErr != MCP2515::ERROR_OK) {
-        Serial.print("setNormalMode failed: ");
-        Serial.println(static_cast<int>(modeErr));
+        logPrintf("setNormalMode failed: %d\n", static_cast<int>(modeErr));
         return false;
     }
 
-    consecutiveSendErrors = 0;
-    lastActivityMs = millis();
+    stats.consecutiveSendErrors = 0;
+    stats.lastActivityMs = platformMillis();
     hasLastEspPing = false;
     canIntPending  = false;
-    consecutivePassiveErrors = 0;
-    lastHealthCheckMs = millis();
+    stats.consecutivePassiveErrors = 0;
+    lastHealthCheckMs = platformMillis();
 
-    Serial.println("MCP2515 ready (125kbps, 8MHz).");
+    logPrintf("MCP2515 ready (125kbps, 8MHz).\n");
     return true;
 }
 
-static void recoverIfStalled(uint32_t now)
+static void runSpiCalibration()
+{
+    const uint32_t startMs = platformMillis();
+    const SpiCalibration cal = spiCalibrate(mcp2515, CAN_CS_PIN);
+    logPrintf("SPICAL selected_hz=%lu highest_ok_hz=%lu first_fail_hz=%lu ms=%lu\n",
+              static_cast<unsigned long>(cal.selectedHz), static_cast<unsigned long>(cal.highestOkHz),
+              static_cast<unsigned long>(cal.firstFailHz),
+              static_cast<unsigned long>(platformMillis() - startMs));
+
+    if (cal.selectedHz == 0) {
+        logPrintf("SPI calibration failed at every clock; check MCP2515 wiring.\n");
+        spiClockHz = SPI_CALIBRATION_STEPS_HZ[0];
+        return;
+    }
+    spiClockHz = cal.selectedHz;
+    if (!platformStoreU32(SPI_CLOCK_KEY, spiClockHz)) {
+        logPrintf("Could not persist SPI clock.\n");
+    }
+}
+
+// Reuses the stored clock if it still verifies; otherwise recalibrates.
+static void setupSpiClock()
 {
-    if (consecutiveSendErrors >= ERROR_REINIT_LIMIT) {
-        Serial.println("Too many send errors; reinitializing CAN...");
-        if (initCan()) {
-            consecutiveSendErrors = 0;
+    uint32_t stored = 0;
+    if (platformLoadU32(SPI_CLOCK_KEY, stored)) {
+        for (uint32_t hz : SPI_CALIBRATION_STEPS_HZ) {
+            if (hz == stored && spiVerifyClock(mcp2515, CAN_CS_PIN, stored, 1)) {
+                spiClockHz = stored;
+                logPrintf("SPI clock %lu Hz (stored, verified)\n", static_cast<unsigned long>(stored));
+                return;
+            }
         }
+        logPrintf("Stored SPI clock %lu Hz no longer verifies; recalibrating.\n",
+                  static_cast<unsigned long>(stored));
+    }
+    runSpiCalibration();
+}
+
+// Every recovery, and a recalibration from the console, goes through here so
+// repeated faults back off instead of resetting the controller in a tight loop.
+static bool reinitWithBackoff(uint32_t now, const char *reason, bool recalibrate = false)
+{
+    if (!reinitGovernor.shouldReinit(now)) {
+        return false;
+    }
+    logPrintf("%s\n", reason);
+
+    const uint32_t startUs = platformMicros();
+    if (recalibrate) {
+        runSpiCalibration();  // resets the controller too, so it counts as re-init time
+    }
+    const bool ok = initCan();
+    reinitSinceHealthSample = true;
+    reinitGovernor.onReinitDone(platformMillis(), ok, platformMicros() - startUs);
+    return ok;
+}
+
+static void recoverIfStalled(uint32_t now)
+{
+    if (stats.consecutiveSendErrors >= ERROR_REINIT_LIMIT) {
+        reinitWithBackoff(now, "Too many send errors; reinitializing CAN...");
         return;
     }
 
-    if ((now - lastActivityMs) > ACTIVITY_TIMEOUT_MS && consecutiveSendErrors > 0) {
-        Serial.println("Activity timeout with errors; attempting CAN reinit...");
-        initCan();
+    if ((now - stats.lastActivityMs) > ACTIVITY_TIMEOUT_MS && stats.consecutiveSendErrors > 0) {
+        reinitWithBackoff(now, "Activity timeout with errors; attempting CAN reinit...");
+    }
+}
+
+// Heap taken by allocations made at runtime, which the linker map cannot
+// see. Each one is logged as a HEAP module=... line for
+// scripts/footprint.py --heap-log to check against the module's budget.
+struct HeapMark {
+    uint32_t internalFree;
+    uint32_t psramFree;
+};
+
+static HeapMark heapMark()
+{
+    return {platformFreeInternal(), platformFreePsram()};
+}
+
+static void logHeapUse(const char *module, const HeapMark &before)
+{
+    const HeapMark after = heapMark();
+    logPrintf("HEAP module=%s internal=%ld psram=%ld\n", module,
+              static_cast<long>(before.internalFree) - static_cast<long>(after.internalFree),
+              static_cast<long>(before.psramFree) - static_cast<long>(after.psramFree));
+}
+
+static void reportHeap()
+{
+    const uint32_t internalMin = platformMinFreeInternal();
+    const uint32_t psramMin    = platformMinFreePsram();
+    logPrintf("HEAP internal_free=%lu internal_min=%lu psram_free=%lu psram_min=%lu\n",
+              static_cast<unsigned long>(platformFreeInternal()), static_cast<unsigned long>(internalMin),
+              static_cast<unsigned long>(platformFreePsram()), static_cast<unsigned long>(psramMin));
+    if (!heapLowReported && internalMin < HEAP_INTERNAL_FLOOR) {
+        heapLowReported = true;
+        logPrintf("HEAP LOW internal_min=%lu floor=%lu\n", static_cast<unsigned long>(internalMin),
+                  static_cast<unsigned long>(HEAP_INTERNAL_FLOOR));
+    }
+    if (psramFitted && !psramLowReported && psramMin < HEAP_PSRAM_FLOOR) {
+        psramLowReported = true;
+        logPrintf("HEAP LOW psram_min=%lu floor=%lu\n", static_cast<unsigned long>(psramMin),
+                  static_cast<unsigned long>(HEAP_PSRAM_FLOOR));
     }
 }
 
-static void sendFrame(struct can_frame &frame)
+// Frame totals plus the node state snapshot of the last completed iteration.
+static void printStats(uint32_t now)
+{
+    NodeStats s;
+    nodeStats.read(s);
+    const FrameCounters::Totals f = frameCounters.totals();
+    logPrintf("STATS rx=%lu tx=%lu tx_err=%lu rx_ovf=%lu int_edges=%lu spi_hz=%lu "
+              "send_err_streak=%u idle_ms=%lu last_int_us=%lu\n",
+              static_cast<unsigned long>(f.rxFrames), static_cast<unsigned long>(f.txFrames),
+              static_cast<unsigned long>(f.txErrors), static_cast<unsigned long>(f.rxOverflows),
+              static_cast<unsigned long>(s.intEdges), static_cast<unsigned long>(spiClockHz),
+              s.consecutiveSendErrors, static_cast<unsigned long>(now - s.lastActivityMs),
+              static_cast<unsigned long>(s.lastIntUs));
+}
+
+static void reportMetrics(uint32_t now)
+{
+    if ((now - lastMetricsReportMs) < METRICS_REPORT_MS) {
+        return;
+    }
+    lastMetricsReportMs = now;
+
+    const ReinitGovernor::Metrics m = reinitGovernor.metrics(now);
+    logPrintf("METRICS reinit=%lu reinit_failed=%lu reinit_deferred=%lu backoff_ms=%lu "
+              "operational_ms=%llu recovering_ms=%llu reinit_us=%llu availability_permille=%u\n",
+              static_cast<unsigned long>(m.reinits), static_cast<unsigned long>(m.reinitFailures),
+              static_cast<unsigned long>(m.deferred), static_cast<unsigned long>(m.backoffMs),
+              static_cast<unsigned long long>(m.operationalMs),
+              static_cast<unsigned long long>(m.recoveringMs),
+              static_cast<unsigned long long>(m.reinitUs),
+              ReinitGovernor::availabilityPermille(m));
+
+    printStats(now);
+    reportHeap();
+
+    logPrintf("LINKQ score=%u delivery=%u tx=%u rx=%u stability=%u latency=%u rtt_ewma_us=%lu\n",
+              linkQuality.scorePermille(),
+              linkQuality.componentPermille(LinkQuality::DELIVERY),
+              linkQuality.componentPermille(LinkQuality::TX),
+              linkQuality.componentPermille(LinkQuality::RX),
+              linkQuality.componentPermille(LinkQuality::STABILITY),
+              linkQuality.componentPermille(LinkQuality::LATENCY),
+              static_cast<unsigned long>(linkQuality.rttEwmaUs()));
+
+    logPrintf("RTTH n=%lu p50=%lu p90=%lu p99=%lu p999=%lu max=%lu\n",
+              static_cast<unsigned long>(rttHistogram.count()),
+              static_cast<unsigned long>(rttHistogram.valueAtPercentile(50.0)),
+              static_cast<unsigned long>(rttHistogram.valueAtPercentile(90.0)),
+              static_cast<unsigned long>(rttHistogram.valueAtPercentile(99.0)),
+              static_cast<unsigned long>(rttHistogram.valueAtPercentile(99.9)),
+              static_cast<unsigned long>(rttHistogram.max()));
+
+    if (CAN_TELEMETRY) {
+        uint8_t record[LinkQuality::RECORD_SIZE];
+        telemetrySend(TELEMETRY_TYPE_LINK_QUALITY, record, linkQuality.encode(record));
+
+        // Interval histograms: the host merges them across periods and nodes.
+        uint8_t chunk[TELEMETRY_MAX_PAYLOAD];
+        uint16_t cursor = 0;
+        do {
+            const size_t len = rttHistogram.encode(chunk, sizeof(chunk), LatencyHistogram::SERIES_ESP_RTT, cursor);
+            telemetrySend(TELEMETRY_TYPE_HISTOGRAM, chunk, len);
+        } while (cursor < LatencyHistogram::BUCKETS);
+    }
+    rttHistogram.reset();
+}
+
+// Nominal frame length without stuff bits (SOF..EOF plus 3-bit IFS).
+static uint32_t frameBits(const struct can_frame &frame)
+{
+    const uint32_t overhead = (frame.can_id & CAN_EFF_FLAG) ? 67 : 47;
+    return overhead + ((frame.can_id & CAN_RTR_FLAG) ? 0 : 8U * frame.can_dlc);
+}
+
+static bool sendFrame(struct can_frame &frame)
 {
     const auto err = mcp2515.sendMessage(&frame);
+    linkQuality.onTxResult(err == MCP2515::ERROR_OK);
     if (err == MCP2515::ERROR_OK) {
-        consecutiveSendErrors = 0;
-        lastActivityMs = millis();
+        frameCounters.txFrames.add();
+        frameCounters.busBits.add(frameBits(frame));
+        stats.consecutiveSendErrors = 0;
+        stats.lastActivityMs = platformMillis();
+        captureFrame(frame, true);
     } else {
-        consecutiveSendErrors++;
-        Serial.print("Send error: ");
-        Serial.println(static_cast<int>(err));
+        frameCounters.txErrors.add();
+        stats.consecutiveSendErrors++;
+        logPrintf("Send error: %d\n", static_cast<int>(err));
+    }
+    return err == MCP2515::ERROR_OK;
+}
+
+static bool sendIsoTpFrame(uint32_t id, const uint8_t *data, uint8_t len)
+{
+    struct can_frame frame = {};
+    frame.can_id  = id;
+    frame.can_dlc = len;
+    memcpy(frame.data, data, len);
+    return sendFrame(frame);
+}
+
+static FirmwareUpdate firmwareUpdate(UPDATE_RESPONSE_ID, sendIsoTpFrame);
+
+// DAQ packets can find every TX buffer busy at high sampling rates. That is
+// an XCP overload, reported in the PID, not a link error, so this bypasses
+// sendFrame()'s error accounting and log line.
+static bool sendXcpFrame(uint32_t id, const uint8_t *data, uint8_t len)
+{
+    struct can_frame frame = {};
+    frame.can_id  = id;
+    frame.can_dlc = len;
+    memcpy(frame.data, data, len);
+    if (mcp2515.sendMessage(&frame) != MCP2515::ERROR_OK) {
+        return false;
+    }
+    frameCounters.txFrames.add();
+    frameCounters.busBits.add(frameBits(frame));
+    stats.lastActivityMs = platformMillis();
+    captureFrame(frame, true);
+    return true;
+}
+
+static XcpSlave xcp(XCP_DTO_ID, sendXcpFrame, XCP_VARIABLES,
+                    sizeof(XCP_VARIABLES) / sizeof(XCP_VARIABLES[0]), XCP_EVENT_COUNT);
+
+static UdsServer uds(UDS_RESPONSE_ID, sendIsoTpFrame, UDS_DIDS, sizeof(UDS_DIDS) / sizeof(UDS_DIDS[0]));
+
+static void refreshXcpSignals(uint32_t now, uint16_t rxBatch)
+{
+    const FrameCounters::Totals f = frameCounters.totals();
+    xcpSignals.rxFrames        = f.rxFrames;
+    xcpSignals.txFrames        = f.txFrames;
+    xcpSignals.txErrors        = f.txErrors;
+    xcpSignals.rxOverflows     = f.rxOverflows;
+    xcpSignals.reinits         = reinitGovernor.metrics(now).reinits;
+    xcpSignals.serialTxFree    = static_cast<uint32_t>(platformWriteFree());
+    xcpSignals.rxBatch         = rxBatch;
+
+    NodeStats s;
+    nodeStats.read(s);
+    xcpSignals.sendErrorStreak = s.consecutiveSendErrors;
+    xcpSignals.intEdges        = s.intEdges;
+    xcpSignals.idleMs          = now - s.lastActivityMs;
+}
+
+// Fires the per-loop and 1 ms DAQ events.
+static void tickXcp(uint32_t now, uint16_t rxBatch)
+{
+    if (!CAN_XCP || !xcp.daqRunning()) {
+        return;
+    }
+    const uint32_t nowUs = platformMicros();
+    refreshXcpSignals(now, rxBatch);
+    xcp.event(XCP_EVENT_LOOP, nowUs);
+    if (nowUs - lastXcpTickUs >= 1000) {
+        lastXcpTickUs = nowUs;
+        xcp.event(XCP_EVENT_1MS, nowUs);
+    }
+}
+
+static void noteUdsResponse()
+{
+    const uint32_t us = platformMicros() - udsTiming.requestUs;
+    udsTiming.responses++;
+    if (us > udsTiming.maxUs) {
+        udsTiming.maxUs = us;
+    }
+    if (us > UdsServer::P2_MS * 1000U) {
+        udsTiming.late++;
+    }
+}
+
+// Sends consecutive frames of long responses and late first frames.
+static void tickUds(uint32_t now)
+{
+    if (CAN_UDS && uds.poll(now)) {
+        noteUdsResponse();
     }
 }
 
@@ -179,49 +678,194 @@ static void handleHealth(uint32_t now)
 
     const uint8_t flags = mcp2515.getErrorFlags();
 
+    linkQuality.onHealthSample((flags & (EFLG_RX0OVR | EFLG_RX1OVR)) != 0, reinitSinceHealthSample);
+    reinitSinceHealthSample = false;
+
     if (flags & (EFLG_RX0OVR | EFLG_RX1OVR)) {
-        Serial.println("RX overflow detected; clearing.");
+        frameCounters.rxOverflows.add();
+        logPrintf("RX overflow detected; clearing.\n");
         mcp2515.clearRXnOVR();
     }
 
     if (flags & EFLG_TXBO) {
-        Serial.println("Bus-off detected; reinitializing CAN...");
-        initCan();
+        reinitWithBackoff(now, "Bus-off detected; reinitializing CAN...");
         return;
     }
 
     if (flags & (EFLG_TXEP | EFLG_RXEP)) {
-        consecutivePassiveErrors++;
-        if (consecutivePassiveErrors >= 3) {
-            Serial.println("Error-passive persists; reinitializing CAN...");
-            initCan();
+        stats.consecutivePassiveErrors++;
+        if (stats.consecutivePassiveErrors >= 3) {
+            reinitWithBackoff(now, "Error-passive persists; reinitializing CAN...");
             return;
         }
     } else {
-        consecutivePassiveErrors = 0;
+        stats.consecutivePassiveErrors = 0;
+        if (stats.consecutiveSendErrors == 0) {
+            reinitGovernor.onHealthy(now);
+        }
     }
 
     if (flags & EFLG_EWARN) {
-        Serial.println("Warning: error warning flag set (EWARN).");
+        logPrintf("Warning: error warning flag set (EWARN).\n");
+    }
+}
+
+static void noteRtt(uint32_t rttUs)
+{
+    if (rttUs < rttMinUs) rttMinUs = rttUs;
+    if (rttUs > rttMaxUs) rttMaxUs = rttUs;
+    rttSumUs += rttUs;
+    rttCount++;
+    rttHistogram.record(rttUs);
+    metricHistory.recordRtt(rttUs);
+    xcpSignals.lastRttUs = rttUs;
+}
+
+static void reportBench(uint32_t now)
+{
+    if (!CAN_BENCH || (now - lastBenchReportMs) < BENCH_REPORT_MS) {
+        return;
+    }
+    lastBenchReportMs = now;
+    if (rttCount == 0) {
+        logPrintf("BENCH platform=%s rtt_us n=0\n", PLATFORM_NAME);
+        return;
+    }
+    logPrintf("BENCH platform=%s rtt_us n=%lu min=%lu avg=%lu max=%lu\n", PLATFORM_NAME,
+              static_cast<unsigned long>(rttCount), static_cast<unsigned long>(rttMinUs),
+              static_cast<unsigned long>(rttSumUs / rttCount), static_cast<unsigned long>(rttMaxUs));
+}
+
+// Back-to-back TX burst: the achieved rate bounds what the driver/SPI path can
+// sustain (at 125 kbps the bus itself caps it near 1000 frames/s).
+static void benchTxBurst()
+{
+    struct can_frame frame;
+    buildPattern(frame, BENCH_BURST_ID, 0);
+
+    uint16_t sent = 0;
+    uint32_t busyRetries = 0;
+    const uint32_t startUs = platformMicros();
+    const uint32_t startMs = platformMillis();
+    while (sent < BENCH_BURST_FRAMES && (platformMillis() - startMs) < 5000) {
+        frame.data[0] = static_cast<uint8_t>(sent);
+        frame.data[1] = static_cast<uint8_t>(sent ^ 0xFF);
+        if (mcp2515.sendMessage(&frame) == MCP2515::ERROR_OK) {
+            sent++;
+        } else {
+            busyRetries++;
+        }
     }
+    const uint32_t elapsedUs = platformMicros() - startUs;
+    const uint64_t fps = elapsedUs ? (static_cast<uint64_t>(sent) * 1000000ULL) / elapsedUs : 0;
+
+    logPrintf("BENCH platform=%s tx_burst frames=%u us=%lu fps=%lu busy_retries=%lu\n", PLATFORM_NAME,
+              sent, static_cast<unsigned long>(elapsedUs), static_cast<unsigned long>(fps),
+              static_cast<unsigned long>(busyRetries));
+}
+
+// Counter bench: both cores hammer one counter, either a shared atomic or a
+// ShardedCounter, the way RX/TX/telemetry on separate cores would.
+struct CounterBenchJob {
+    std::atomic<uint32_t> *atomicCounter;  // null: use shardedCounter
+    ShardedCounter        *shardedCounter;
+    volatile bool          done;
+};
+
+static void runCounterIncs(CounterBenchJob &job)
+{
+    if (job.atomicCounter) {
+        for (uint32_t i = 0; i < BENCH_COUNTER_INCS; ++i) {
+            job.atomicCounter->fetch_add(1, std::memory_order_relaxed);
+        }
+    } else {
+        for (uint32_t i = 0; i < BENCH_COUNTER_INCS; ++i) {
+            job.shardedCounter->add();
+        }
+    }
+}
+
+static void counterBenchWorker(void *arg)
+{
+    CounterBenchJob *job = static_cast<CounterBenchJob *>(arg);
+    runCounterIncs(*job);
+    job->done = true;
+}
+
+// Returns ns per increment on this core while the other core competes.
+static uint32_t timeCounterIncs(CounterBenchJob &job)
+{
+    job.done = false;
+    const uint8_t other = platformCoreId() == 0 ? 1 : 0;
+    if (!platformRunOnCore(counterBenchWorker, &job, other)) {
+        job.done = true;
+    }
+    const uint32_t startUs = platformMicros();
+    runCounterIncs(job);
+    const uint32_t elapsedUs = platformMicros() - startUs;
+    while (!job.done) {
+        platformDelay(1);
+    }
+    return static_cast<uint32_t>((static_cast<uint64_t>(elapsedUs) * 1000U) / BENCH_COUNTER_INCS);
+}
+
+static void benchCounters()
+{
+    static std::atomic<uint32_t> atomicCounter{0};
+    static ShardedCounter        shardedCounter;
+
+    CounterBenchJob atomicJob  = {&atomicCounter, nullptr, false};
+    CounterBenchJob shardedJob = {nullptr, &shardedCounter, false};
+    const uint32_t atomicNs  = timeCounterIncs(atomicJob);
+    const uint32_t shardedNs = timeCounterIncs(shardedJob);
+
+    logPrintf("BENCH platform=%s counter_inc_ns atomic=%lu sharded=%lu saved=%ld total_ok=%u\n",
+              PLATFORM_NAME, static_cast<unsigned long>(atomicNs), static_cast<unsigned long>(shardedNs),
+              static_cast<long>(atomicNs) - static_cast<long>(shardedNs),
+              atomicCounter.load() == 2 * BENCH_COUNTER_INCS && shardedCounter.read() == 2 * BENCH_COUNTER_INCS);
+}
+
+static void reportBurstIfDone(uint32_t now)
+{
+    struct can_frame report;
+    if (!burstMonitor.takeReport(now, report.data)) {
+        return;
+    }
+    report.can_id  = BurstMonitor::REPORT_ID;
+    report.can_dlc = 8;
+
+    logPrintf("BURST rx burst=%u frames=%u seq_gaps=%u min_gap_us=%u avg_gap_us=%u max_gap_us=%u\n",
+              burstMonitor.burst(), burstMonitor.frames(), burstMonitor.seqGaps(),
+              report.data[2] | (report.data[3] << 8), report.data[4] | (report.data[5] << 8),
+              report.data[6] | (report.data[7] << 8));
+    sendFrame(report);
 }
 
-static void processRxFrame(const struct can_frame &frame)
+static void processRxFrame(const struct can_frame &frame, uint32_t rxUs)
 {
     // PONG for ESP-initiated PING
     if (frame.can_id == ESP_PONG_ID) {
         if (hasLastEspPing && framesEqual(lastEspPingSent, frame)) {
-            Serial.println("MATCHED (ESP-initiated)");
+            const uint32_t rttUs = platformMicros() - lastEspPingSentUs;
+            noteRtt(rttUs);
+            if (!espPingAnswered) {
+                linkQuality.onPingMatched(rttUs);
+            }
+            logPrintf("MATCHED (ESP-initiated)\n");
         } else {
-            Serial.println("MISMATCH (ESP-initiated)");
+            if (!espPingAnswered) {
+                linkQuality.onPingFailed();
+            }
+            logPrintf("MISMATCH (ESP-initiated)\n");
         }
+        espPingAnswered = true;
     }
     // PING coming from Pi that ESP must echo
     else if (frame.can_id == PI_PING_ID) {
         if (patternMatches(frame)) {
-            Serial.println("MATCHED (Pi->ESP PING)");
+            logPrintf("MATCHED (Pi->ESP PING)\n");
         } else {
-            Serial.println("MISMATCH pattern from Pi");
+            logPrintf("MISMATCH pattern from Pi\n");
         }
 
         struct can_frame pong = frame;
@@ -229,65 +873,431 @@ static void processRxFrame(const struct can_frame &frame)
         logFrame("TX PONG (ESP->Pi)", pong);
         sendFrame(pong);
     }
+    // Pi burst test frame: only timing is of interest
+    else if (frame.can_id == BurstMonitor::DATA_ID) {
+        burstMonitor.onFrame(frame.data, frame.can_dlc, rxUs, platformMillis());
+    }
+    else if (CAN_UPDATE && frame.can_id == UPDATE_REQUEST_ID) {
+        if (firmwareUpdate.active()) {
+            firmwareUpdate.onFrame(frame.data, frame.can_dlc, platformMillis());
+        } else {
+            const HeapMark before = heapMark();  // BEGIN allocates the buffers and writer task
+            firmwareUpdate.onFrame(frame.data, frame.can_dlc, platformMillis());
+            if (firmwareUpdate.active()) {
+                logHeapUse("firmware_update", before);
+            }
+        }
+    }
+    else if (CAN_XCP && frame.can_id == XCP_CRO_ID) {
+        xcp.onCommand(frame.data, frame.can_dlc, platformMicros());
+    }
+    else if (CAN_UDS && frame.can_id == UDS_REQUEST_ID) {
+        udsTiming.requestUs = rxUs;
+        refreshXcpSignals(platformMillis(), 0);
+        if (uds.onFrame(frame.data, frame.can_dlc, platformMillis())) {
+            noteUdsResponse();
+        }
+    }
+}
+
+static void tickHistory(uint32_t now)
+{
+    if (!metricHistory.due(now)) {
+        return;
+    }
+    const FrameCounters::Totals f = frameCounters.totals();
+    const MetricHistory::Totals totals = {
+        f.rxFrames, f.txFrames, f.txErrors + f.rxOverflows,
+        reinitGovernor.metrics(now).reinits, frameCounters.busBits.read(),
+    };
+    metricHistory.tick(now, totals);
+}
+
+static void reportSoak(uint32_t now)
+{
+    lastSoakReportMs = now;
+    logPrintf("SOAK uptime_s=%lu free_heap=%lu min_free_heap=%lu stack_free=%lu\n",
+              static_cast<unsigned long>(now / 1000),
+              static_cast<unsigned long>(platformFreeHeap()),
+              static_cast<unsigned long>(platformMinFreeHeap()),
+              static_cast<unsigned long>(platformStackFree()));
+    for (uint8_t i = 0; i < SoakMonitor::METRIC_COUNT; ++i) {
+        const SoakMonitor::Metric m = static_cast<SoakMonitor::Metric>(i);
+        const TrendTracker &t = soakMonitor.trend(m);
+        logPrintf("TREND %s n=%lu mean=%.1f slope_per_h=%.3f t=%.1f drift=%u\n",
+                  SoakMonitor::name(m), static_cast<unsigned long>(t.count()),
+                  static_cast<double>(t.meanY()), static_cast<double>(t.slope()),
+                  static_cast<double>(t.tStat()), soakMonitor.drifting(m));
+    }
+}
+
+// Feeds the drift regressions once per closed minute of metric history.
+static void tickSoak(uint32_t now, uint16_t rxBatch)
+{
+    if (!CAN_SOAK) {
+        return;
+    }
+    const size_t txFree = platformWriteFree();
+    if (txFree < soakTxFreeMin) {
+        soakTxFreeMin = txFree;
+    }
+    if (rxBatch > soakRxBatchMax) {
+        soakRxBatchMax = rxBatch;
+    }
+
+    MetricHistory::Sample m;
+    if (metricHistory.get(MetricHistory::MINUTES, 0, m) && m.endS != soakLastMinuteS) {
+        soakLastMinuteS = m.endS;
+
+        float values[SoakMonitor::METRIC_COUNT];
+        values[SoakMonitor::RTT_P50]      = m.rttP50Us ? m.rttP50Us : NAN;  // no pong that minute
+        values[SoakMonitor::RTT_P99]      = m.rttP99Us ? m.rttP99Us : NAN;
+        values[SoakMonitor::ERRORS]       = static_cast<float>(m.errors);
+        values[SoakMonitor::REINITS]      = m.reinits;
+        values[SoakMonitor::FREE_HEAP]    = static_cast<float>(platformFreeHeap());
+        values[SoakMonitor::STACK_FREE]   = static_cast<float>(platformStackFree());
+        values[SoakMonitor::TX_RING_FREE] = static_cast<float>(soakTxFreeMin);
+        values[SoakMonitor::RX_BATCH]     = soakRxBatchMax;
+        soakTxFreeMin  = SIZE_MAX;
+        soakRxBatchMax = 0;
+
+        const uint16_t raised = soakMonitor.add(static_cast<float>(m.endS) / 3600.0f, values);
+        for (uint8_t i = 0; i < SoakMonitor::METRIC_COUNT; ++i) {
+            if (raised & (1U << i)) {
+                const SoakMonitor::Metric metric = static_cast<SoakMonitor::Metric>(i);
+                const TrendTracker &t = soakMonitor.trend(metric);
+                logPrintf("SOAK DRIFT %s slope_per_h=%.3f t=%.1f n=%lu\n", SoakMonitor::name(metric),
+                          static_cast<double>(t.slope()), static_cast<double>(t.tStat()),
+                          static_cast<unsigned long>(t.count()));
+            }
+        }
+    }
+
+    if (now - lastSoakReportMs >= SOAK_REPORT_MS) {
+        reportSoak(now);
+    }
+}
+
+static void reportUpdateRate(const char *what, uint32_t now)
+{
+    const uint32_t ms   = firmwareUpdate.elapsedMs(now);
+    const uint32_t rate = ms ? static_cast<uint32_t>(firmwareUpdate.written() * 1000ULL / ms) : 0;
+    logPrintf("UPDATE %s bytes=%lu/%lu ms=%lu rate_Bps=%lu capacity_Bps=%lu efficiency=%lu%% "
+              "isotp_aborts=%lu\n",
+              what, static_cast<unsigned long>(firmwareUpdate.written()),
+              static_cast<unsigned long>(firmwareUpdate.imageSize()), static_cast<unsigned long>(ms),
+              static_cast<unsigned long>(rate), static_cast<unsigned long>(UPDATE_CAPACITY_BPS),
+              static_cast<unsigned long>(rate * 100 / UPDATE_CAPACITY_BPS),
+              static_cast<unsigned long>(firmwareUpdate.transportAborts()));
 }
 
+static void tickUpdate(uint32_t now)
+{
+    if (!CAN_UPDATE) {
+        return;
+    }
+    switch (firmwareUpdate.poll(now)) {
+    case FirmwareUpdate::EVENT_STARTED:
+        lastUpdateReportMs = now;
+        logPrintf("UPDATE started size=%lu erase_ms=%lu\n",
+                  static_cast<unsigned long>(firmwareUpdate.imageSize()),
+                  static_cast<unsigned long>(firmwareUpdate.eraseMs()));
+        break;
+    case FirmwareUpdate::EVENT_FAILED:
+        logPrintf("UPDATE failed status=%u\n", firmwareUpdate.lastStatus());
+        break;
+    case FirmwareUpdate::EVENT_DONE:
+        reportUpdateRate("done", now);
+        logPrintf("UPDATE rebooting into the new image\n");
+        platformDelay(200);  // let the END response and the log drain
+        platformRestart();
+        break;
+    case FirmwareUpdate::EVENT_NONE:
+        if (firmwareUpdate.active() && firmwareUpdate.written() &&
+            now - lastUpdateReportMs >= UPDATE_REPORT_MS) {
+            lastUpdateReportMs = now;
+            reportUpdateRate("progress", now);
+        }
+        break;
+    }
+}
+
+static void reportProfile(uint32_t now)
+{
+    lastProfileReportMs = now;
+    logPrintf("PROFILE frames=%lu distinct=%lu err_bound=%lu mem=%u\n",
+              static_cast<unsigned long>(trafficSketch.total()),
+              static_cast<unsigned long>(trafficSketch.distinct()),
+              static_cast<unsigned long>(trafficSketch.errorBound()),
+              static_cast<unsigned>(TrafficSketch::memoryBytes()));
+    TrafficSketch::Entry top[TrafficSketch::TOP_K];
+    const uint8_t n = trafficSketch.top(top);
+    for (uint8_t i = 0; i < n; ++i) {
+        const bool ext = top[i].key & CAN_EFF_FLAG;
+        logPrintf("PROFILE TOP %u id=0x%0*lX%s count=%lu\n", i + 1, ext ? 8 : 3,
+                  static_cast<unsigned long>(top[i].key & CAN_EFF_MASK), ext ? "x" : "",
+                  static_cast<unsigned long>(top[i].count));
+    }
+}
+
+static void tickProfile(uint32_t now)
+{
+    if (CAN_PROFILE && now - lastProfileReportMs >= PROFILE_REPORT_MS) {
+        reportProfile(now);
+    }
+}
+
+static const char HISTORY_TIER_NAMES[MetricHistory::TIER_COUNT] = {'s', 'm', 'h'};
+
+// A history dump in progress. It is paged out a few lines per loop iteration
+// while the serial buffer has room, so a 3600-line dump never holds the loop
+// task on the UART.
+static struct {
+    MetricHistory::Tier tier;
+    uint16_t            printed;
+    uint16_t            count;   // capped at the tier depth
+    uint32_t            pushed;  // metricHistory.pushed(tier) when the dump started
+    bool                active;
+} historyDump;
+
+static void startHistoryDump(MetricHistory::Tier tier, uint16_t count)
+{
+    logPrintf("HIST tier=%c samples=%u depth=%u psram=%u\n", HISTORY_TIER_NAMES[tier],
+              metricHistory.count(tier), metricHistory.depth(tier), metricHistory.inPsram());
+    historyDump.tier    = tier;
+    historyDump.printed = 0;
+    historyDump.count   = count < metricHistory.count(tier) ? count : metricHistory.count(tier);
+    historyDump.pushed  = metricHistory.pushed(tier);
+    historyDump.active  = true;
+}
+
+static void tickHistoryDump()
+{
+    if (!historyDump.active) {
+        return;
+    }
+    const MetricHistory::Tier tier = historyDump.tier;
+    MetricHistory::Sample s;
+    for (uint8_t lines = 0; lines < HISTORY_LINES_PER_LOOP; ++lines) {
+        if (lines > 0 && platformWriteFree() < HISTORY_LINE_MAX) {
+            return;
+        }
+        // Samples closed since the dump started push the remaining ones older.
+        const uint32_t age = historyDump.printed + (metricHistory.pushed(tier) - historyDump.pushed);
+        if (historyDump.printed == historyDump.count || age > UINT16_MAX ||
+            !metricHistory.get(tier, static_cast<uint16_t>(age), s)) {
+            logPrintf("HIST done tier=%c lines=%u\n", HISTORY_TIER_NAMES[tier], historyDump.printed);
+            historyDump.active = false;  // done, or the rest rotated out of the ring
+            return;
+        }
+        logPrintf("HIST %c -%u end_s=%lu rx=%lu tx=%lu err=%lu reinit=%u load_permille=%u "
+                  "rtt_p50_us=%u rtt_p99_us=%u\n",
+                  HISTORY_TIER_NAMES[tier], historyDump.printed, static_cast<unsigned long>(s.endS),
+                  static_cast<unsigned long>(s.rxFrames), static_cast<unsigned long>(s.txFrames),
+                  static_cast<unsigned long>(s.errors), s.reinits, s.busLoadPermille,
+                  s.rttP50Us, s.rttP99Us);
+        historyDump.printed++;
+    }
+}
+
+// Serial console commands, one per line.
+static void handleConsoleCommand(uint8_t argc, char **argv)
+{
+    if (strcmp(argv[0], "history") == 0) {
+        MetricHistory::Tier tier = MetricHistory::MINUTES;
+        if (argc > 1) {
+            switch (argv[1][0]) {
+            case 's': tier = MetricHistory::SECONDS; break;
+            case 'm': tier = MetricHistory::MINUTES; break;
+            case 'h': tier = MetricHistory::HOURS; break;
+            default:
+                logPrintf("usage: history [s|m|h] [count]\n");
+                return;
+            }
+        }
+        const uint16_t count = argc > 2 ? static_cast<uint16_t>(strtoul(argv[2], nullptr, 10)) : 60;
+        startHistoryDump(tier, count);  // replaces a dump still in progress
+        return;
+    }
+    if (strcmp(argv[0], "spical") == 0) {
+        const uint32_t now      = platformMillis();
+        const uint32_t deferred = reinitGovernor.metrics(now).deferred;
+        reinitWithBackoff(now, "SPI recalibration requested; reinitializing CAN...", true);
+        if (reinitGovernor.metrics(now).deferred != deferred) {
+            logPrintf("spical deferred by re-init backoff; try again later\n");
+        }
+        return;
+    }
+    if (strcmp(argv[0], "soak") == 0) {
+        reportSoak(platformMillis());
+        return;
+    }
+    if (strcmp(argv[0], "profile") == 0) {
+        if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+            trafficSketch.reset();
+            logPrintf("PROFILE reset\n");
+            return;
+        }
+        reportProfile(platformMillis());
+        return;
+    }
+    if (strcmp(argv[0], "xcp") == 0) {
+        logPrintf("XCP connected=%u daq_running=%u packets=%lu overloads=%lu\n", xcp.connected(),
+                  xcp.daqRunning(), static_cast<unsigned long>(xcp.daqPackets()),
+                  static_cast<unsigned long>(xcp.overloads()));
+        return;
+    }
+    if (strcmp(argv[0], "stats") == 0) {
+        printStats(platformMillis());
+        return;
+    }
+    if (strcmp(argv[0], "uds") == 0) {
+        logPrintf("UDS session=%u requests=%lu negatives=%lu dropped=%lu responses=%lu max_us=%lu "
+                  "late=%lu isotp_aborts=%lu\n",
+                  uds.session(), static_cast<unsigned long>(uds.requests()),
+                  static_cast<unsigned long>(uds.negatives()), static_cast<unsigned long>(uds.dropped()),
+                  static_cast<unsigned long>(udsTiming.responses), static_cast<unsigned long>(udsTiming.maxUs),
+                  static_cast<unsigned long>(udsTiming.late),
+                  static_cast<unsigned long>(uds.transportAborts()));
+        return;
+    }
+    logPrintf("commands: history [s|m|h] [count] | spical | soak | profile [reset] | xcp | uds | stats\n");
+}
+
+static Console console(handleConsoleCommand);
+
 void setup()
 {
-    Serial.begin(115200);
-    delay(1000);
+    platformBeginSerial(115200);
+    platformDelay(1000);
 
-    Serial.println();
-    Serial.println("ESP32-S3 MCP2515 CAN Ping-Pong (bidirectional, 8MHz MCP2515)");
+    logPrintf("\n");
+    logPrintf("ESP32-S3 MCP2515 CAN Ping-Pong (bidirectional, 8MHz MCP2515) [%s]\n", PLATFORM_NAME);
 
     // Initialize SPI with explicit pins
-    SPI.begin(CAN_SPI_SCK, CAN_SPI_MISO, CAN_SPI_MOSI, CAN_CS_PIN);
-    pinMode(CAN_INT_PIN, INPUT);  // reserved for interrupt-driven reception
-    attachInterrupt(digitalPinToInterrupt(CAN_INT_PIN), onCanInt, FALLING);
+    platformBeginSpi(CAN_SPI_SCK, CAN_SPI_MISO, CAN_SPI_MOSI, CAN_CS_PIN);
+    platformAttachFallingInterrupt(CAN_INT_PIN, onCanInt);
+    setupSpiClock();
 
     if (!initCan()) {
-        Serial.println("Fatal: cannot initialize MCP2515. Halting.");
+        logPrintf("Fatal: cannot initialize MCP2515. Halting.\n");
         while (true) {
-            delay(1000);
+            platformDelay(1000);
+        }
+    }
+
+    psramFitted = platformFreePsram() > 0;
+    HeapMark before = heapMark();
+    if (!metricHistory.begin(CAN_BITRATE)) {
+        logPrintf("Metric history disabled: out of memory.\n");
+    } else {
+        logHeapUse("metric_history", before);
+        if (!metricHistory.inPsram()) {
+            logPrintf("No PSRAM; metric history keeps %u s of seconds and %u min of minutes.\n",
+                      metricHistory.depth(MetricHistory::SECONDS), metricHistory.depth(MetricHistory::MINUTES));
+        }
+    }
+
+    if (CAN_PROFILE) {
+        before = heapMark();
+        if (!trafficSketch.begin()) {
+            logPrintf("Traffic profile disabled: out of memory.\n");
+        } else {
+            logHeapUse("traffic_sketch", before);
         }
     }
+
+    if (CAN_BENCH) {
+        benchTxBurst();
+        benchCounters();
+    }
 }
 
 void loop()
 {
-    const uint32_t now = millis();
+    const uint32_t now = platformMillis();
+    const uint32_t loopStartUs = platformMicros();
 
     // ESP-initiated PING towards Pi
     if (now - lastPingMillis >= PING_PERIOD_MS) {
         lastPingMillis = now;
 
+        if (hasLastEspPing && !espPingAnswered) {
+            linkQuality.onPingFailed();  // previous ping never came back
+        }
+
         buildPattern(espPingFrame, ESP_PING_ID, espPingCounter);
         logFrame("TX PING (ESP->Pi)", espPingFrame);
 
+        lastEspPingSentUs = platformMicros();
         sendFrame(espPingFrame);
 
         lastEspPingSent = espPingFrame;
         hasLastEspPing  = true;
+        espPingAnswered = false;
 
         espPingCounter++;
     }
 
-    bool handledRx = false;
+    bool     handledRx = false;
+    uint16_t rxBatch   = 0;
 
     // Drain all pending RX frames (interrupt-driven where available, with polling fallback).
     if (canIntPending || mcp2515.checkReceive() == MCP2515::ERROR_OK) {
+        // The first frame after an INT edge is stamped with the ISR time; frames
+        // already queued behind it only get their read time.
+        uint32_t rxUs = canIntPending ? canIntUs : platformMicros();
         canIntPending = false;
         while (mcp2515.readMessage(&rxFrame) == MCP2515::ERROR_OK) {
             handledRx = true;
-            lastActivityMs = millis();
-            logFrame("RX", rxFrame);
-            processRxFrame(rxFrame);
+            rxBatch++;
+            frameCounters.rxFrames.add();
+            frameCounters.busBits.add(frameBits(rxFrame));
+            stats.lastActivityMs = platformMillis();
+            captureFrame(rxFrame, false);
+            if (CAN_PROFILE) {
+                trafficSketch.add(rxFrame.can_id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+            }
+            // Updates, bursts and the Pi's stress load run at bus rate, where a
+            // log line per frame would saturate the UART. UDS is timed, and a
+            // tester in the extended session is measuring P2 under background load
+            // on any ID, so the RX log stays muted until the session ends or times out.
+            const bool udsTest = CAN_UDS && uds.session() != UdsServer::SESSION_DEFAULT;
+            if (!udsTest && rxFrame.can_id != UPDATE_REQUEST_ID &&
+                rxFrame.can_id != UDS_REQUEST_ID && rxFrame.can_id != BurstMonitor::DATA_ID &&
+                rxFrame.can_id != STRESS_ID) {
+                logFrame("RX", rxFrame);
+            }
+            processRxFrame(rxFrame, rxUs);
+            if (CAN_XCP && xcp.daqRunning()) {
+                refreshXcpSignals(now, rxBatch);
+                xcp.event(XCP_EVENT_RX, rxUs);
+            }
+            rxUs = platformMicros();
         }
     }
 
     handleHealth(now);
     recoverIfStalled(now);
+    flushCaptureIfStale(now);
+    reportBench(now);
+    reportMetrics(now);
+    reportBurstIfDone(now);
+    tickHistory(now);
+    tickHistoryDump();
+    tickSoak(now, rxBatch);
+    tickProfile(now);
+    tickUpdate(now);
+    tickXcp(now, rxBatch);
+    tickUds(now);
+    console.poll();
+
+    stats.lastIntUs = canIntUs;
+    stats.intEdges  = frameCounters.intEdges.read();
+    nodeStats.write(stats);
+    xcpSignals.loopUs = platformMicros() - loopStartUs;
 
     if (!handledRx) {
-        delay(1);  // tiny backoff only when idle
+        platformDelay(1);  // tiny backoff only when idle
     }
 }
@@ -0,0 +1,328 @@
+#if !defined(ARDUINO)
+
+#include "mcp2515_idf.h"
+
+#include <string.h>
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// SPI instructions
+static constexpr uint8_t INSTR_WRITE       = 0x02;
+static constexpr uint8_t INSTR_READ        = 0x03;
+static constexpr uint8_t INSTR_BITMOD      = 0x05;
+static constexpr uint8_t INSTR_READ_STATUS = 0xA0;
+static constexpr uint8_t INSTR_RESET       = 0xC0;
+
+// Registers
+static constexpr uint8_t REG_CANSTAT  = 0x0E;
+static constexpr uint8_t REG_CANCTRL  = 0x0F;
+static constexpr uint8_t REG_CNF3     = 0x28;
+static constexpr uint8_t REG_CANINTE  = 0x2B;
+static constexpr uint8_t REG_CANINTF  = 0x2C;
+static constexpr uint8_t REG_EFLG     = 0x2D;
+static constexpr uint8_t REG_TXB0CTRL = 0x30;
+static constexpr uint8_t REG_RXB0CTRL = 0x60;
+static constexpr uint8_t REG_RXB1CTRL = 0x70;
+static constexpr uint8_t REG_RXM0SIDH = 0x20;
+
+static constexpr uint8_t TXB_STRIDE   = 0x10;
+static constexpr uint8_t TXB_TXREQ    = 0x08;
+static constexpr uint8_t TXB_ABTF     = 0x40;
+static constexpr uint8_t TXB_MLOA     = 0x20;
+static constexpr uint8_t TXB_TXERR    = 0x10;
+
+static constexpr uint8_t CANCTRL_REQOP = 0xE0;
+static constexpr uint8_t MODE_NORMAL   = 0x00;
+static constexpr uint8_t MODE_LOOPBACK = 0x40;
+static constexpr uint8_t MODE_CONFIG   = 0x80;
+
+static constexpr uint8_t CANINTF_RX0IF = 0x01;
+static constexpr uint8_t CANINTF_RX1IF = 0x02;
+static constexpr uint8_t CANINTF_ERRIF = 0x20;
+static constexpr uint8_t CANINTF_MERRF = 0x80;
+
+static constexpr uint8_t STAT_RX0IF = 0x01;
+static constexpr uint8_t STAT_RX1IF = 0x02;
+
+static constexpr uint8_t RXB_RXM_MASK   = 0x60;
+static constexpr uint8_t RXB_RXM_STDEXT = 0x00;
+static constexpr uint8_t RXB0_BUKT      = 0x04;
+static constexpr uint8_t RXB_RTR        = 0x08;
+
+static constexpr uint8_t SIDL_EXIDE = 0x08;
+static constexpr uint8_t DLC_RTR    = 0x40;
+
+static constexpr uint8_t EFLG_RXOVR = 0xC0;
+
+// CNF1..3 for an 8 MHz crystal (same values as the autowp library)
+static const uint8_t CNF_8MHZ[][3] = {
+    {0x01, 0xB1, 0x85},  // 125 kbps
+    {0x00, 0xB1, 0x85},  // 250 kbps
+    {0x00, 0x90, 0x82},  // 500 kbps
+};
+
+MCP2515::MCP2515(uint8_t csPin, uint32_t spiClock) : csPin_(csPin), spiClock_(spiClock)
+{
+}
+
+MCP2515::~MCP2515()
+{
+    if (dev_ != nullptr) {
+        spi_bus_remove_device(dev_);
+    }
+}
+
+MCP2515::ERROR MCP2515::attach()
+{
+    if (dev_ != nullptr) {
+        return ERROR_OK;
+    }
+
+    // Added lazily: the bus is initialised by platformBeginSpi() in setup(),
+    // after static construction.
+    spi_device_interface_config_t cfg = {};
+    cfg.clock_speed_hz = static_cast<int>(spiClock_);
+    cfg.mode           = 0;
+    cfg.spics_io_num   = csPin_;
+    cfg.queue_size     = 1;
+
+    if (spi_bus_add_device(SPI2_HOST, &cfg, &dev_) != ESP_OK) {
+        dev_ = nullptr;
+        return ERROR_FAILINIT;
+    }
+    return ERROR_OK;
+}
+
+void MCP2515::transfer(const uint8_t *tx, uint8_t *rx, uint8_t n)
+{
+    spi_transaction_t t = {};
+    t.length    = static_cast<size_t>(n) * 8;
+    t.tx_buffer = tx;
+    t.rx_buffer = rx;
+    spi_device_polling_transmit(dev_, &t);
+}
+
+uint8_t MCP2515::readRegister(uint8_t reg)
+{
+    uint8_t value = 0;
+    readRegisters(reg, &value, 1);
+    return value;
+}
+
+void MCP2515::readRegisters(uint8_t reg, uint8_t *out, uint8_t n)
+{
+    uint8_t tx[2 + 14] = {INSTR_READ, reg};
+    uint8_t rx[2 + 14];
+    transfer(tx, rx, static_cast<uint8_t>(2 + n));
+    memcpy(out, rx + 2, n);
+}
+
+void MCP2515::setRegister(uint8_t reg, uint8_t value)
+{
+    setRegisters(reg, &value, 1);
+}
+
+void MCP2515::setRegisters(uint8_t reg, const uint8_t *values, uint8_t n)
+{
+    uint8_t tx[2 + 14] = {INSTR_WRITE, reg};
+    memcpy(tx + 2, values, n);
+    transfer(tx, nullptr, static_cast<uint8_t>(2 + n));
+}
+
+void MCP2515::modifyRegister(uint8_t reg, uint8_t mask, uint8_t data)
+{
+    const uint8_t tx[4] = {INSTR_BITMOD, reg, mask, data};
+    transfer(tx, nullptr, sizeof(tx));
+}
+
+uint8_t MCP2515::getStatus()
+{
+    const uint8_t tx[2] = {INSTR_READ_STATUS, 0};
+    uint8_t rx[2];
+    transfer(tx, rx, sizeof(tx));
+    return rx[1];
+}
+
+MCP2515::ERROR MCP2515::reset()
+{
+    if (attach() != ERROR_OK) {
+        return ERROR_FAILINIT;
+    }
+
+    const uint8_t cmd = INSTR_RESET;
+    transfer(&cmd, nullptr, 1);
+    vTaskDelay(pdMS_TO_TICKS(10) > 0 ? pdMS_TO_TICKS(10) : 1);
+
+    const uint8_t zeros[14] = {};
+    for (uint8_t i = 0; i < 3; ++i) {
+        setRegisters(static_cast<uint8_t>(REG_TXB0CTRL + i * TXB_STRIDE), zeros, sizeof(zeros));
+    }
+    setRegister(REG_RXB0CTRL, 0);
+    setRegister(REG_RXB1CTRL, 0);
+
+    setRegister(REG_CANINTE, CANINTF_RX0IF | CANINTF_RX1IF | CANINTF_ERRIF | CANINTF_MERRF);
+
+    // Accept everything: RXB0 rolls over into RXB1, masks zeroed.
+    modifyRegister(REG_RXB0CTRL, RXB_RXM_MASK | RXB0_BUKT, RXB_RXM_STDEXT | RXB0_BUKT);
+    modifyRegister(REG_RXB1CTRL, RXB_RXM_MASK, RXB_RXM_STDEXT);
+    const uint8_t noMask[8] = {};
+    setRegisters(REG_RXM0SIDH, noMask, sizeof(noMask));
+
+    return ERROR_OK;
+}
+
+MCP2515::ERROR MCP2515::setMode(uint8_t mode)
+{
+    modifyRegister(REG_CANCTRL, CANCTRL_REQOP, mode);
+
+    const int64_t deadline = esp_timer_get_time() + 10000;
+    while (esp_timer_get_time() < deadline) {
+        if ((readRegister(REG_CANSTAT) & CANCTRL_REQOP) == mode) {
+            return ERROR_OK;
+        }
+    }
+    return ERROR_FAIL;
+}
+
+MCP2515::ERROR MCP2515::setConfigMode()
+{
+    return setMode(MODE_CONFIG);
+}
+
+MCP2515::ERROR MCP2515::setNormalMode()
+{
+    return setMode(MODE_NORMAL);
+}
+
+MCP2515::ERROR MCP2515::setLoopbackMode()
+{
+    return setMode(MODE_LOOPBACK);
+}
+
+MCP2515::ERROR MCP2515::setBitrate(CAN_SPEED speed, CAN_CLOCK clock)
+{
+    if (clock != MCP_8MHZ || speed > CAN_500KBPS) {
+        return ERROR_FAIL;
+    }
+    const ERROR err = setConfigMode();
+    if (err != ERROR_OK) {
+        return err;
+    }
+
+    // CNF3, CNF2, CNF1 are consecutive registers starting at CNF3.
+    const uint8_t *cnf = CNF_8MHZ[speed];
+    const uint8_t regs[3] = {cnf[2], cnf[1], cnf[0]};
+    setRegisters(REG_CNF3, regs, sizeof(regs));
+    return ERROR_OK;
+}
+
+MCP2515::ERROR MCP2515::sendMessage(const struct can_frame *frame)
+{
+    if (frame->can_dlc > CAN_MAX_DLEN) {
+        return ERROR_FAILTX;
+    }
+
+    for (uint8_t i = 0; i < 3; ++i) {
+        const uint8_t ctrlReg = static_cast<uint8_t>(REG_TXB0CTRL + i * TXB_STRIDE);
+        if (readRegister(ctrlReg) & TXB_TXREQ) {
+            continue;
+        }
+
+        uint8_t buf[5 + CAN_MAX_DLEN];
+        const bool ext = (frame->can_id & CAN_EFF_FLAG) != 0;
+        const bool rtr = (frame->can_id & CAN_RTR_FLAG) != 0;
+        const uint32_t id = frame->can_id & (ext ? CAN_EFF_MASK : CAN_SFF_MASK);
+
+        if (ext) {
+            const uint16_t sid = static_cast<uint16_t>(id >> 16);
+            buf[0] = static_cast<uint8_t>(sid >> 5);
+            buf[1] = static_cast<uint8_t>(((sid & 0x1C) << 3) | (sid & 0x03) | SIDL_EXIDE);
+            buf[2] = static_cast<uint8_t>(id >> 8);
+            buf[3] = static_cast<uint8_t>(id);
+        } else {
+            buf[0] = static_cast<uint8_t>(id >> 3);
+            buf[1] = static_cast<uint8_t>((id & 0x07) << 5);
+            buf[2] = 0;
+            buf[3] = 0;
+        }
+        buf[4] = static_cast<uint8_t>(rtr ? (frame->can_dlc | DLC_RTR) : frame->can_dlc);
+        memcpy(buf + 5, frame->data, frame->can_dlc);
+
+        setRegisters(static_cast<uint8_t>(ctrlReg + 1), buf, static_cast<uint8_t>(5 + frame->can_dlc));
+        modifyRegister(ctrlReg, TXB_TXREQ, TXB_TXREQ);
+
+        if (readRegister(ctrlReg) & (TXB_ABTF | TXB_MLOA | TXB_TXERR)) {
+            return ERROR_FAILTX;
+        }
+        return ERROR_OK;
+    }
+    return ERROR_ALLTXBUSY;
+}
+
+MCP2515::ERROR MCP2515::readMessage(struct can_frame *frame)
+{
+    const uint8_t status = getStatus();
+    uint8_t ctrlReg;
+    uint8_t flag;
+    if (status & STAT_RX0IF) {
+        ctrlReg = REG_RXB0CTRL;
+        flag    = CANINTF_RX0IF;
+    } else if (status & STAT_RX1IF) {
+        ctrlReg = REG_RXB1CTRL;
+        flag    = CANINTF_RX1IF;
+    } else {
+        return ERROR_NOMSG;
+    }
+
+    // CTRL, SIDH, SIDL, EID8, EID0, DLC, D0..D7 in one burst
+    uint8_t buf[6 + CAN_MAX_DLEN];
+    readRegisters(ctrlReg, buf, sizeof(buf));
+
+    uint32_t id = (static_cast<uint32_t>(buf[1]) << 3) | (buf[2] >> 5);
+    const uint8_t dlc = buf[5] & 0x0F;
+    if (dlc > CAN_MAX_DLEN) {
+        modifyRegister(REG_CANINTF, flag, 0);
+        return ERROR_FAIL;
+    }
+
+    if (buf[2] & SIDL_EXIDE) {
+        id = (id << 2) | (buf[2] & 0x03);
+        id = (id << 8) | buf[3];
+        id = (id << 8) | buf[4];
+        id |= CAN_EFF_FLAG;
+        if (buf[5] & DLC_RTR) {
+            id |= CAN_RTR_FLAG;
+        }
+    } else if (buf[0] & RXB_RTR) {
+        id |= CAN_RTR_FLAG;
+    }
+
+    frame->can_id  = id;
+    frame->can_dlc = dlc;
+    memcpy(frame->data, buf + 6, dlc);
+
+    modifyRegister(REG_CANINTF, flag, 0);
+    return ERROR_OK;
+}
+
+MCP2515::ERROR MCP2515::checkReceive()
+{
+    return (getStatus() & (STAT_RX0IF | STAT_RX1IF)) ? ERROR_OK : ERROR_NOMSG;
+}
+
+uint8_t MCP2515::getErrorFlags()
+{
+    return readRegister(REG_EFLG);
+}
+
+void MCP2515::clearRXnOVR()
+{
+    if (getErrorFlags() != 0) {
+        modifyRegister(REG_EFLG, EFLG_RXOVR, 0);
+        setRegister(REG_CANINTF, 0);  // as the autowp driver does
+    }
+}
+
+#endif  // !ARDUINO
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <driver/spi_master.h>
+
+// Minimal MCP2515 driver on the ESP-IDF spi_master API. It mirrors the subset
+// of the autowp MCP2515 class (and its linux/can.h style frame) that the node
+// uses, so main.cpp compiles unchanged against either driver.
+
+typedef uint32_t canid_t;
+
+#define CAN_EFF_FLAG 0x80000000UL
+#define CAN_RTR_FLAG 0x40000000UL
+#define CAN_ERR_FLAG 0x20000000UL
+#define CAN_SFF_MASK 0x000007FFUL
+#define CAN_EFF_MASK 0x1FFFFFFFUL
+#define CAN_MAX_DLEN 8
+
+struct can_frame {
+    canid_t can_id;
+    uint8_t can_dlc;
+    uint8_t __pad;
+    uint8_t __res0;
+    uint8_t __res1;
+    uint8_t data[CAN_MAX_DLEN] __attribute__((aligned(8)));
+};
+
+enum CAN_SPEED {
+    CAN_125KBPS,
+    CAN_250KBPS,
+    CAN_500KBPS,
+};
+
+enum CAN_CLOCK {
+    MCP_8MHZ,
+};
+
+class MCP2515 {
+public:
+    enum ERROR {
+        ERROR_OK        = 0,
+        ERROR_FAIL      = 1,
+        ERROR_ALLTXBUSY = 2,
+        ERROR_FAILINIT  = 3,
+        ERROR_FAILTX    = 4,
+        ERROR_NOMSG     = 5,
+    };
+
+    explicit MCP2515(uint8_t csPin, uint32_t spiClock = 10000000);
+    ~MCP2515();
+
+    ERROR reset();
+    ERROR setBitrate(CAN_SPEED speed, CAN_CLOCK clock);
+    ERROR setNormalMode();
+    ERROR setLoopbackMode();
+    ERROR setConfigMode();
+
+    ERROR sendMessage(const struct can_frame *frame);
+    ERROR readMessage(struct can_frame *frame);
+    ERROR checkReceive();
+
+    uint8_t getErrorFlags();
+    void    clearRXnOVR();
+
+private:
+    ERROR   attach();
+    ERROR   setMode(uint8_t mode);
+    uint8_t readRegister(uint8_t reg);
+    void    readRegisters(uint8_t reg, uint8_t *out, uint8_t n);
+    void    setRegister(uint8_t reg, uint8_t value);
+    void    setRegisters(uint8_t reg, const uint8_t *values, uint8_t n);
+    void    modifyRegister(uint8_t reg, uint8_t mask, uint8_t data);
+    uint8_t getStatus();
+    void    transfer(const uint8_t *tx, uint8_t *rx, uint8_t n);
+
+    uint8_t             csPin_;
+    uint32_t            spiClock_;
+    spi_device_handle_t dev_ = nullptr;
+};
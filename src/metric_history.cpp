@@ -0,0 +1,141 @@
+#include "metric_history.h"
+
+#include <new>
+#include <stdlib.h>
+
+#include "platform.h"
+
+constexpr uint16_t MetricHistory::DEPTH[TIER_COUNT];
+constexpr uint16_t MetricHistory::DEPTH_INTERNAL[TIER_COUNT];
+
+static constexpr uint32_t TIER_SECONDS[MetricHistory::TIER_COUNT] = {1, 60, 3600};
+
+static uint16_t sat16(uint32_t v)
+{
+    return v > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(v);
+}
+
+bool MetricHistory::begin(uint32_t bitrate)
+{
+    bitrate_ = bitrate;
+
+    uint16_t depths[TIER_COUNT] = {DEPTH[SECONDS], DEPTH[MINUTES], DEPTH[HOURS]};
+    size_t samples = static_cast<size_t>(depths[SECONDS]) + depths[MINUTES] + depths[HOURS];
+    void *block = platformAllocPsram(TIER_COUNT * sizeof(LatencyHistogram) + samples * sizeof(Sample));
+    inPsram_ = block != nullptr;
+    if (!block) {
+        for (uint8_t t = 0; t < TIER_COUNT; ++t) {
+            depths[t] = DEPTH_INTERNAL[t];
+        }
+        samples = static_cast<size_t>(depths[SECONDS]) + depths[MINUTES] + depths[HOURS];
+        block = malloc(TIER_COUNT * sizeof(LatencyHistogram) + samples * sizeof(Sample));
+        if (!block) {
+            return false;
+        }
+    }
+
+    rtt_ = static_cast<LatencyHistogram *>(block);
+    for (uint8_t t = 0; t < TIER_COUNT; ++t) {
+        new (&rtt_[t]) LatencyHistogram();
+    }
+    Sample *next = reinterpret_cast<Sample *>(rtt_ + TIER_COUNT);
+    for (uint8_t t = 0; t < TIER_COUNT; ++t) {
+        tiers_[t] = {next, depths[t], 0, 0, 0};
+        next += depths[t];
+    }
+    return true;
+}
+
+void MetricHistory::recordRtt(uint32_t rttUs)
+{
+    if (!rtt_) {
+        return;
+    }
+    for (uint8_t t = 0; t < TIER_COUNT; ++t) {
+        rtt_[t].record(rttUs);
+    }
+}
+
+void MetricHistory::tick(uint32_t nowMs, const Totals &totals)
+{
+    if (!rtt_) {
+        return;
+    }
+    if (!started_) {
+        started_      = true;
+        last_         = totals;
+        nextSecondMs_ = nowMs + 1000;
+        for (uint8_t t = 0; t < TIER_COUNT; ++t) {
+            acc_[t].period = (nowMs / 1000) / TIER_SECONDS[t];
+        }
+        return;
+    }
+    if (static_cast<int32_t>(nowMs - nextSecondMs_) < 0) {
+        return;
+    }
+
+    // Normally one second; more if the loop was stalled (e.g. a re-init).
+    const uint32_t elapsedS = 1 + (nowMs - nextSecondMs_) / 1000;
+    nextSecondMs_ += elapsedS * 1000;
+    const uint32_t endS = nowMs / 1000;
+
+    for (uint8_t t = 0; t < TIER_COUNT; ++t) {
+        Accumulator &a = acc_[t];
+        a.rxFrames += totals.rxFrames - last_.rxFrames;
+        a.txFrames += totals.txFrames - last_.txFrames;
+        a.errors   += totals.errors - last_.errors;
+        a.reinits  += totals.reinits - last_.reinits;
+        a.busBits  += totals.busBits - last_.busBits;
+        a.seconds  += elapsedS;
+    }
+    last_ = totals;
+
+    closeTier(SECONDS, endS);
+    for (uint8_t t = MINUTES; t < TIER_COUNT; ++t) {
+        if (endS / TIER_SECONDS[t] != acc_[t].period) {
+            closeTier(static_cast<Tier>(t), endS);
+        }
+    }
+}
+
+void MetricHistory::closeTier(Tier t, uint32_t endS)
+{
+    Accumulator &a = acc_[t];
+    LatencyHistogram &h = rtt_[t];
+
+    Sample s;
+    s.endS            = endS;
+    s.rxFrames        = a.rxFrames;
+    s.txFrames        = a.txFrames;
+    s.errors          = a.errors;
+    s.reinits         = sat16(a.reinits);
+    s.busLoadPermille = a.seconds ? sat16(static_cast<uint32_t>(a.busBits * 1000U / (static_cast<uint64_t>(bitrate_) * a.seconds))) : 0;
+    s.rttP50Us        = sat16(h.valueAtPercentile(50.0));
+    s.rttP99Us        = sat16(h.valueAtPercentile(99.0));
+    push(t, s);
+
+    a = {};
+    a.period = endS / TIER_SECONDS[t];
+    h.reset();
+}
+
+void MetricHistory::push(Tier t, const Sample &s)
+{
+    Ring &r = tiers_[t];
+    r.samples[r.head] = s;
+    r.head = static_cast<uint16_t>((r.head + 1) % r.depth);
+    if (r.count < r.depth) {
+        r.count++;
+    }
+    r.pushed++;
+}
+
+bool MetricHistory::get(Tier t, uint16_t age, Sample &out) const
+{
+    const Ring &r = tiers_[t];
+    if (age >= r.count) {
+        return false;
+    }
+    out = r.samples[(r.head + r.depth - 1 - age) % r.depth];
+    return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+// On-device history of link metrics, so a node can show its last day without
+// a logger attached. Per-second samples roll up into per-minute and per-hour
+// tiers, each a fixed ring allocated once in PSRAM (internal RAM with a
+// shorter seconds tier when the board has none).
+//
+// Counters are sums over the sample; bus load is the mean; RTT percentiles
+// come from a histogram per tier, so minute and hour percentiles are exact
+// rather than averages of per-second values.
+class MetricHistory {
+public:
+    enum Tier : uint8_t { SECONDS, MINUTES, HOURS, TIER_COUNT };
+
+    struct Sample {
+        uint32_t endS;             // uptime at the end of the sample
+        uint32_t rxFrames;
+        uint32_t txFrames;
+        uint32_t errors;           // TX errors + RX overflows
+        uint16_t reinits;
+        uint16_t busLoadPermille;  // nominal (unstuffed) bits / bitrate
+        uint16_t rttP50Us;         // saturates at 65535
+        uint16_t rttP99Us;
+    };
+
+    // Cumulative counters as the node keeps them; history stores deltas.
+    struct Totals {
+        uint32_t rxFrames;
+        uint32_t txFrames;
+        uint32_t errors;
+        uint32_t reinits;
+        uint32_t busBits;
+    };
+
+    static constexpr uint16_t DEPTH[TIER_COUNT] = {3600, 1440, 168};  // 1 h, 24 h, 7 d
+    // Without PSRAM: 5 min, 2 h, 7 d, about 21 KB of internal RAM in total.
+    static constexpr uint16_t DEPTH_INTERNAL[TIER_COUNT] = {300, 120, 168};
+
+    // Allocates the rings; false if even the internal fallback fails.
+    bool begin(uint32_t bitrate);
+
+    void recordRtt(uint32_t rttUs);
+    // tick() has a second to close; lets the caller skip gathering totals.
+    bool due(uint32_t nowMs) const { return !started_ || static_cast<int32_t>(nowMs - nextSecondMs_) >= 0; }
+    // Closes the per-second sample (and minute/hour rollups) once a second is over.
+    void tick(uint32_t nowMs, const Totals &totals);
+
+    bool     inPsram() const { return inPsram_; }
+    uint16_t depth(Tier t) const { return tiers_[t].depth; }
+    uint16_t count(Tier t) const { return tiers_[t].count; }
+    // Samples ever written to the tier; a reader paging through it over time
+    // adds the growth to its ages to stay on the same samples.
+    uint32_t pushed(Tier t) const { return tiers_[t].pushed; }
+    // age 0 is the newest sample of the tier.
+    bool get(Tier t, uint16_t age, Sample &out) const;
+
+private:
+    struct Accumulator {
+        uint64_t busBits;
+        uint32_t rxFrames;
+        uint32_t txFrames;
+        uint32_t errors;
+        uint32_t reinits;
+        uint32_t seconds;
+        uint32_t period;  // endS / tier length of the sample being built
+    };
+
+    struct Ring {
+        Sample  *samples;
+        uint16_t depth;
+        uint16_t head;  // next write position
+        uint16_t count;
+        uint32_t pushed;
+    };
+
+    void closeTier(Tier t, uint32_t endS);
+    void push(Tier t, const Sample &s);
+
+    Ring              tiers_[TIER_COUNT] = {};
+    Accumulator       acc_[TIER_COUNT]   = {};
+    LatencyHistogram *rtt_               = nullptr;  // one per tier, same block as the rings
+    Totals            last_              = {};
+    uint32_t          bitrate_           = 0;
+    uint32_t          nextSecondMs_      = 0;
+    bool              started_           = false;
+    bool              inPsram_           = false;
+};
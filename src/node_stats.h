@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "seqlock.h"
+#include "sharded_counter.h"
+
+// Node state beyond plain counters. The loop task owns a working copy and
+// updates it with plain stores; once per loop iteration it publishes the copy
+// to nodeStats. Reporting (STATS line, console, XCP and UDS values) reads
+// snapshots from there rather than the working copy, so it always sees one
+// consistent iteration, whichever task it runs on.
+struct NodeStats {
+    uint32_t lastIntUs;       // ISR timestamp of the latest INT edge
+    uint32_t intEdges;        // MCP2515 INT edges counted by the ISR
+    uint32_t lastActivityMs;  // last successful RX or TX
+    uint8_t  consecutiveSendErrors;
+    uint8_t  consecutivePassiveErrors;
+};
+
+extern Seqlock<NodeStats> nodeStats;
+
+// Frame-path counters, sharded per core so RX, TX and telemetry never share
+// a cache line or pay for atomics; totals() aggregates on demand.
+struct FrameCounters {
+    ShardedCounter rxFrames;
+    ShardedCounter txFrames;
+    ShardedCounter txErrors;
+    ShardedCounter rxOverflows;
+    ShardedCounter intEdges;  // MCP2515 INT falling edges (ISR shard)
+    ShardedCounter busBits;   // nominal bits of every RX/TX frame, for bus load
+
+    struct Totals {
+        uint32_t rxFrames;
+        uint32_t txFrames;
+        uint32_t txErrors;
+        uint32_t rxOverflows;
+        uint32_t intEdges;
+    };
+
+    Totals totals() const
+    {
+        return {rxFrames.read(), txFrames.read(), txErrors.read(), rxOverflows.read(), intEdges.read()};
+    }
+};
+
+extern FrameCounters frameCounters;
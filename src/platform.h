@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+
+// Thin portability layer so the node logic in main.cpp builds unchanged on the
+// Arduino core (platform_arduino.cpp) and on bare ESP-IDF (platform_idf.cpp,
+// env esp32-s3-devkitc-1-idf). Only what the node actually uses lives here.
+
+#if defined(ARDUINO)
+#define PLATFORM_NAME "arduino"
+#else
+#define PLATFORM_NAME "idf"
+#endif
+
+// Serial link carrying the text log and binary telemetry.
+void platformBeginSerial(uint32_t baud);
+void platformWrite(const uint8_t *data, size_t len);
+void logPrintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+// Non-blocking read of console input; returns the number of bytes copied.
+size_t platformRead(uint8_t *buf, size_t cap);
+
+// MCP2515 wiring: SPI bus pins and the active-low INT line.
+void platformBeginSpi(int sck, int miso, int mosi, int cs);
+void platformAttachFallingInterrupt(int pin, void (*handler)());
+
+// Raw MCP2515 transfers at an explicit SPI clock, for SPI calibration. CS is
+// asserted for the whole transfer. On ESP-IDF the driver and the raw device
+// cannot both hold the CS pin: detach the driver before platformSpiRawBegin().
+bool platformSpiRawBegin(int cs, uint32_t hz);
+void platformSpiRawTransfer(const uint8_t *tx, uint8_t *rx, size_t n);
+void platformSpiRawEnd();
+
+// Small persistent settings (NVS); load returns false when the key is unset.
+bool platformLoadU32(const char *key, uint32_t &value);
+bool platformStoreU32(const char *key, uint32_t value);
+
+// ESP32-S3: two cores; cache lines are at most 64 bytes.
+static constexpr uint8_t PLATFORM_CORES      = 2;
+static constexpr size_t  PLATFORM_CACHE_LINE = 64;
+
+// Core the caller runs on; inline so it stays cheap on the frame path.
+static inline uint8_t IRAM_ATTR platformCoreId()
+{
+    return static_cast<uint8_t>(xPortGetCoreID());
+}
+
+// Runs fn(arg) once in a new task pinned to `core`; the task exits afterwards.
+bool platformRunOnCore(void (*fn)(void *), void *arg, uint8_t core);
+
+// Allocates from external PSRAM; nullptr when the board has none.
+void *platformAllocPsram(size_t size);
+
+// Resource gauges for soak testing.
+uint32_t platformFreeHeap();
+uint32_t platformMinFreeHeap();     // lowest free heap since boot
+
+// Heap split by memory type for the runtime footprint check; the PSRAM
+// figures are 0 on boards without it. Minimums are low-water marks since boot.
+uint32_t platformFreeInternal();
+uint32_t platformMinFreeInternal();
+uint32_t platformFreePsram();
+uint32_t platformMinFreePsram();
+uint32_t platformStackFree();       // calling task's stack high-water mark, bytes
+size_t   platformWriteFree();       // space left in the serial TX buffer
+
+// Firmware update into the next OTA app partition (esp_ota_ops). Begin
+// erases `size` bytes up front and takes seconds, so call it and the writes
+// off the loop task. End validates the image and selects it for the next
+// boot; restart then boots it.
+uint32_t platformOtaCapacity();     // bytes in the next OTA partition, 0 without one
+bool     platformOtaBegin(uint32_t size);
+bool     platformOtaWrite(const uint8_t *data, size_t len);
+bool     platformOtaEnd();
+void     platformOtaAbort();
+void     platformRestart();
+
+uint32_t platformMillis();
+uint32_t platformMicros();  // IRAM-safe: callable from ISRs
+void     platformDelay(uint32_t ms);
@@ -0,0 +1,233 @@
+#if defined(ARDUINO)
+
+#include "platform.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SPI.h>
+#include <esp_heap_caps.h>
+#include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+void platformBeginSerial(uint32_t baud)
+{
+    Serial.begin(baud);
+}
+
+void platformWrite(const uint8_t *data, size_t len)
+{
+    Serial.write(data, len);
+}
+
+void logPrintf(const char *fmt, ...)
+{
+    char line[192];
+    va_list args;
+    va_start(args, fmt);
+    const int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n > 0) {
+        Serial.write(reinterpret_cast<const uint8_t *>(line),
+                     static_cast<size_t>(n) < sizeof(line) ? static_cast<size_t>(n) : sizeof(line) - 1);
+    }
+}
+
+size_t platformRead(uint8_t *buf, size_t cap)
+{
+    size_t n = 0;
+    while (n < cap && Serial.available() > 0) {
+        buf[n++] = static_cast<uint8_t>(Serial.read());
+    }
+    return n;
+}
+
+void platformBeginSpi(int sck, int miso, int mosi, int cs)
+{
+    SPI.begin(sck, miso, mosi, cs);
+}
+
+void platformAttachFallingInterrupt(int pin, void (*handler)())
+{
+    pinMode(pin, INPUT);
+    attachInterrupt(digitalPinToInterrupt(pin), handler, FALLING);
+}
+
+void *platformAllocPsram(size_t size)
+{
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+static int         rawCs = -1;
+static SPISettings rawSettings;
+
+bool platformSpiRawBegin(int cs, uint32_t hz)
+{
+    rawCs       = cs;
+    rawSettings = SPISettings(hz, MSBFIRST, SPI_MODE0);
+    pinMode(cs, OUTPUT);
+    digitalWrite(cs, HIGH);
+    return true;
+}
+
+void platformSpiRawTransfer(const uint8_t *tx, uint8_t *rx, size_t n)
+{
+    SPI.beginTransaction(rawSettings);
+    digitalWrite(rawCs, LOW);
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t in = SPI.transfer(tx ? tx[i] : 0);
+        if (rx) {
+            rx[i] = in;
+        }
+    }
+    digitalWrite(rawCs, HIGH);
+    SPI.endTransaction();
+}
+
+void platformSpiRawEnd()
+{
+    rawCs = -1;
+}
+
+static constexpr const char *SETTINGS_NAMESPACE = "cantest";
+
+bool platformLoadU32(const char *key, uint32_t &value)
+{
+    Preferences prefs;
+    if (!prefs.begin(SETTINGS_NAMESPACE, true)) {
+        return false;
+    }
+    const bool found = prefs.isKey(key);
+    if (found) {
+        value = prefs.getUInt(key);
+    }
+    prefs.end();
+    return found;
+}
+
+bool platformStoreU32(const char *key, uint32_t value)
+{
+    Preferences prefs;
+    if (!prefs.begin(SETTINGS_NAMESPACE, false)) {
+        return false;
+    }
+    const bool ok = prefs.putUInt(key, value) == sizeof(value);
+    prefs.end();
+    return ok;
+}
+
+uint32_t platformFreeHeap()
+{
+    return esp_get_free_heap_size();
+}
+
+uint32_t platformMinFreeHeap()
+{
+    return esp_get_minimum_free_heap_size();
+}
+
+uint32_t platformFreeInternal()
+{
+    return heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t platformMinFreeInternal()
+{
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t platformFreePsram()
+{
+    return heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+
+uint32_t platformMinFreePsram()
+{
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+}
+
+uint32_t platformStackFree()
+{
+    return uxTaskGetStackHighWaterMark(nullptr);  // bytes on ESP-IDF ports
+}
+
+size_t platformWriteFree()
+{
+    return static_cast<size_t>(Serial.availableForWrite());
+}
+
+static const esp_partition_t *otaPartition = nullptr;
+static esp_ota_handle_t       otaHandle    = 0;
+
+uint32_t platformOtaCapacity()
+{
+    const esp_partition_t *part = esp_ota_get_next_update_partition(nullptr);
+    return part ? part->size : 0;
+}
+
+bool platformOtaBegin(uint32_t size)
+{
+    otaPartition = esp_ota_get_next_update_partition(nullptr);
+    return otaPartition && esp_ota_begin(otaPartition, size, &otaHandle) == ESP_OK;
+}
+
+bool platformOtaWrite(const uint8_t *data, size_t len)
+{
+    return esp_ota_write(otaHandle, data, len) == ESP_OK;
+}
+
+bool platformOtaEnd()
+{
+    return esp_ota_end(otaHandle) == ESP_OK && esp_ota_set_boot_partition(otaPartition) == ESP_OK;
+}
+
+void platformOtaAbort()
+{
+    esp_ota_abort(otaHandle);
+}
+
+void platformRestart()
+{
+    esp_restart();
+}
+
+uint32_t platformMillis()
+{
+    return millis();
+}
+
+uint32_t IRAM_ATTR platformMicros()
+{
+    return micros();
+}
+
+void platformDelay(uint32_t ms)
+{
+    delay(ms);
+}
+
+struct CoreJob {
+    void (*fn)(void *);
+    void *arg;
+};
+
+static void coreJobTask(void *param)
+{
+    CoreJob *job = static_cast<CoreJob *>(param);
+    job->fn(job->arg);
+    delete job;
+    vTaskDelete(nullptr);
+}
+
+bool platformRunOnCore(void (*fn)(void *), void *arg, uint8_t core)
+{
+    CoreJob *job = new CoreJob{fn, arg};
+    if (xTaskCreatePinnedToCore(coreJobTask, "core_job", 4096, job, 1, nullptr, core) != pdPASS) {
+        delete job;
+        return false;
+    }
+    return true;
+}
+
+#endif  // ARDUINO
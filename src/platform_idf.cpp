@@ -0,0 +1,310 @@
+#if !defined(ARDUINO)
+
+#include "platform.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <driver/gpio.h>
+#include <driver/spi_master.h>
+#include <driver/uart.h>
+#include <esp_heap_caps.h>
+#include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+// Arduino-style entry points implemented by main.cpp.
+void setup();
+void loop();
+
+static constexpr uart_port_t CONSOLE_UART = UART_NUM_0;  // USB-UART bridge on the DevKitC-1
+static constexpr size_t      UART_TX_BUF  = 4096;
+static constexpr size_t      UART_RX_BUF  = 1024;
+
+void platformBeginSerial(uint32_t baud)
+{
+    // Own the UART directly: the stdout console would translate '\n' inside
+    // binary telemetry records.
+    uart_config_t cfg = {};
+    cfg.baud_rate  = static_cast<int>(baud);
+    cfg.data_bits  = UART_DATA_8_BITS;
+    cfg.parity     = UART_PARITY_DISABLE;
+    cfg.stop_bits  = UART_STOP_BITS_1;
+    cfg.flow_ctrl  = UART_HW_FLOWCTRL_DISABLE;
+    cfg.source_clk = UART_SCLK_DEFAULT;
+
+    uart_driver_install(CONSOLE_UART, UART_RX_BUF, UART_TX_BUF, 0, nullptr, 0);
+    uart_param_config(CONSOLE_UART, &cfg);
+}
+
+void platformWrite(const uint8_t *data, size_t len)
+{
+    uart_write_bytes(CONSOLE_UART, data, len);
+}
+
+void logPrintf(const char *fmt, ...)
+{
+    char line[192];
+    va_list args;
+    va_start(args, fmt);
+    const int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n > 0) {
+        uart_write_bytes(CONSOLE_UART, line,
+                         static_cast<size_t>(n) < sizeof(line) ? static_cast<size_t>(n) : sizeof(line) - 1);
+    }
+}
+
+size_t platformRead(uint8_t *buf, size_t cap)
+{
+    const int n = uart_read_bytes(CONSOLE_UART, buf, static_cast<uint32_t>(cap), 0);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+}
+
+void platformBeginSpi(int sck, int miso, int mosi, int cs)
+{
+    (void)cs;  // CS is owned by the spi_master device (mcp2515_idf.cpp)
+
+    spi_bus_config_t bus = {};
+    bus.sclk_io_num     = sck;
+    bus.miso_io_num     = miso;
+    bus.mosi_io_num     = mosi;
+    bus.quadwp_io_num   = -1;
+    bus.quadhd_io_num   = -1;
+    bus.max_transfer_sz = 32;
+
+    // Transfers are at most 14 bytes; polling without DMA has the lowest latency.
+    spi_bus_initialize(SPI2_HOST, &bus, SPI_DMA_DISABLED);
+}
+
+static void IRAM_ATTR gpioTrampoline(void *arg)
+{
+    reinterpret_cast<void (*)()>(arg)();
+}
+
+void platformAttachFallingInterrupt(int pin, void (*handler)())
+{
+    const gpio_num_t gpio = static_cast<gpio_num_t>(pin);
+
+    gpio_config_t cfg = {};
+    cfg.pin_bit_mask = 1ULL << pin;
+    cfg.mode         = GPIO_MODE_INPUT;
+    cfg.pull_up_en   = GPIO_PULLUP_DISABLE;
+    cfg.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    cfg.intr_type    = GPIO_INTR_NEGEDGE;
+    gpio_config(&cfg);
+
+    gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    gpio_isr_handler_add(gpio, gpioTrampoline, reinterpret_cast<void *>(handler));
+}
+
+void *platformAllocPsram(size_t size)
+{
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+static spi_device_handle_t rawDev = nullptr;
+
+bool platformSpiRawBegin(int cs, uint32_t hz)
+{
+    spi_device_interface_config_t cfg = {};
+    cfg.clock_speed_hz = static_cast<int>(hz);
+    cfg.mode           = 0;
+    cfg.spics_io_num   = cs;
+    cfg.queue_size     = 1;
+    return spi_bus_add_device(SPI2_HOST, &cfg, &rawDev) == ESP_OK;
+}
+
+void platformSpiRawTransfer(const uint8_t *tx, uint8_t *rx, size_t n)
+{
+    spi_transaction_t t = {};
+    t.length    = n * 8;
+    t.tx_buffer = tx;
+    t.rx_buffer = rx;
+    spi_device_polling_transmit(rawDev, &t);
+}
+
+void platformSpiRawEnd()
+{
+    if (rawDev != nullptr) {
+        spi_bus_remove_device(rawDev);
+        rawDev = nullptr;
+    }
+}
+
+static constexpr const char *SETTINGS_NAMESPACE = "cantest";
+
+static bool settingsOpen(nvs_open_mode_t mode, nvs_handle_t &handle)
+{
+    static bool initialised = false;
+    if (!initialised) {
+        esp_err_t err = nvs_flash_init();
+        if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+            nvs_flash_erase();
+            err = nvs_flash_init();
+        }
+        if (err != ESP_OK) {
+            return false;
+        }
+        initialised = true;
+    }
+    return nvs_open(SETTINGS_NAMESPACE, mode, &handle) == ESP_OK;
+}
+
+bool platformLoadU32(const char *key, uint32_t &value)
+{
+    nvs_handle_t handle;
+    if (!settingsOpen(NVS_READONLY, handle)) {
+        return false;  // also when the namespace was never written
+    }
+    const bool found = nvs_get_u32(handle, key, &value) == ESP_OK;
+    nvs_close(handle);
+    return found;
+}
+
+bool platformStoreU32(const char *key, uint32_t value)
+{
+    nvs_handle_t handle;
+    if (!settingsOpen(NVS_READWRITE, handle)) {
+        return false;
+    }
+    const bool ok = nvs_set_u32(handle, key, value) == ESP_OK && nvs_commit(handle) == ESP_OK;
+    nvs_close(handle);
+    return ok;
+}
+
+uint32_t platformFreeHeap()
+{
+    return esp_get_free_heap_size();
+}
+
+uint32_t platformMinFreeHeap()
+{
+    return esp_get_minimum_free_heap_size();
+}
+
+uint32_t platformFreeInternal()
+{
+    return heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t platformMinFreeInternal()
+{
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t platformFreePsram()
+{
+    return heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+
+uint32_t platformMinFreePsram()
+{
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+}
+
+uint32_t platformStackFree()
+{
+    return uxTaskGetStackHighWaterMark(nullptr);  // bytes on ESP-IDF ports
+}
+
+size_t platformWriteFree()
+{
+    size_t free = 0;
+    uart_get_tx_buffer_free_size(CONSOLE_UART, &free);
+    return free;
+}
+
+static const esp_partition_t *otaPartition = nullptr;
+static esp_ota_handle_t       otaHandle    = 0;
+
+uint32_t platformOtaCapacity()
+{
+    const esp_partition_t *part = esp_ota_get_next_update_partition(nullptr);
+    return part ? part->size : 0;
+}
+
+bool platformOtaBegin(uint32_t size)
+{
+    otaPartition = esp_ota_get_next_update_partition(nullptr);
+    return otaPartition && esp_ota_begin(otaPartition, size, &otaHandle) == ESP_OK;
+}
+
+bool platformOtaWrite(const uint8_t *data, size_t len)
+{
+    return esp_ota_write(otaHandle, data, len) == ESP_OK;
+}
+
+bool platformOtaEnd()
+{
+    return esp_ota_end(otaHandle) == ESP_OK && esp_ota_set_boot_partition(otaPartition) == ESP_OK;
+}
+
+void platformOtaAbort()
+{
+    esp_ota_abort(otaHandle);
+}
+
+void platformRestart()
+{
+    esp_restart();
+}
+
+uint32_t platformMillis()
+{
+    return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+}
+
+uint32_t IRAM_ATTR platformMicros()
+{
+    return static_cast<uint32_t>(esp_timer_get_time());
+}
+
+void platformDelay(uint32_t ms)
+{
+    const TickType_t ticks = pdMS_TO_TICKS(ms);
+    vTaskDelay(ticks > 0 ? ticks : 1);
+}
+
+struct CoreJob {
+    void (*fn)(void *);
+    void *arg;
+};
+
+static void coreJobTask(void *param)
+{
+    CoreJob *job = static_cast<CoreJob *>(param);
+    job->fn(job->arg);
+    delete job;
+    vTaskDelete(nullptr);
+}
+
+bool platformRunOnCore(void (*fn)(void *), void *arg, uint8_t core)
+{
+    CoreJob *job = new CoreJob{fn, arg};
+    if (xTaskCreatePinnedToCore(coreJobTask, "core_job", 4096, job, 1, nullptr, core) != pdPASS) {
+        delete job;
+        return false;
+    }
+    return true;
+}
+
+static void nodeTask(void *)
+{
+    setup();
+    for (;;) {
+        loop();
+    }
+}
+
+// Same shape as the Arduino core: one loop task on the application core.
+extern "C" void app_main()
+{
+    xTaskCreatePinnedToCore(nodeTask, "node", 8192, nullptr, 1, nullptr, 1);
+}
+
+#endif  // !ARDUINO
@@ -0,0 +1,80 @@
+#include "reinit_governor.h"
+
+ReinitGovernor::ReinitGovernor(const Config &cfg) : cfg_(cfg)
+{
+    m_.backoffMs = cfg_.backoffMinMs;
+}
+
+void ReinitGovernor::accrue(uint32_t nowMs)
+{
+    if (!started_) {
+        started_ = true;
+        lastAccrueMs_   = nowMs;
+        healthySinceMs_ = nowMs;
+        return;
+    }
+
+    const uint32_t elapsed = nowMs - lastAccrueMs_;
+    lastAccrueMs_ = nowMs;
+    if (m_.recovering) {
+        m_.recoveringMs += elapsed;
+    } else {
+        m_.operationalMs += elapsed;
+        if ((nowMs - healthySinceMs_) >= cfg_.stableResetMs) {
+            m_.backoffMs = cfg_.backoffMinMs;
+        }
+    }
+}
+
+bool ReinitGovernor::shouldReinit(uint32_t nowMs)
+{
+    accrue(nowMs);
+    m_.recovering = true;
+
+    // Elapsed time since the last re-init in unsigned arithmetic stays right
+    // across millis() wrap and however long the node ran without one.
+    if (reinited_ && nowMs - lastReinitMs_ < appliedBackoffMs_) {
+        m_.deferred++;
+        return false;
+    }
+    return true;
+}
+
+void ReinitGovernor::onReinitDone(uint32_t nowMs, bool ok, uint32_t elapsedUs)
+{
+    accrue(nowMs);
+    m_.reinits++;
+    m_.reinitUs += elapsedUs;
+    if (!ok) {
+        m_.reinitFailures++;
+    }
+
+    reinited_         = true;
+    lastReinitMs_     = nowMs;
+    appliedBackoffMs_ = m_.backoffMs;
+    m_.backoffMs = (m_.backoffMs >= cfg_.backoffMaxMs / 2) ? cfg_.backoffMaxMs : m_.backoffMs * 2;
+}
+
+void ReinitGovernor::onHealthy(uint32_t nowMs)
+{
+    accrue(nowMs);
+    if (m_.recovering) {
+        m_.recovering   = false;
+        healthySinceMs_ = nowMs;
+    }
+}
+
+ReinitGovernor::Metrics ReinitGovernor::metrics(uint32_t nowMs)
+{
+    accrue(nowMs);
+    return m_;
+}
+
+uint16_t ReinitGovernor::availabilityPermille(const Metrics &m)
+{
+    const uint64_t total = m.operationalMs + m.recoveringMs;
+    if (total == 0) {
+        return 1000;
+    }
+    return static_cast<uint16_t>((m.operationalMs * 1000) / total);
+}
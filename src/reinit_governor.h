@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+// Damps MCP2515 re-init storms. Recovery paths ask shouldReinit() instead of
+// calling initCan() directly; consecutive re-inits are spaced by an
+// exponentially growing backoff (min..max), which resets once the controller
+// has stayed healthy for stableResetMs. Wall time is split into operational
+// and recovering so availability can be reported.
+class ReinitGovernor {
+public:
+    struct Config {
+        uint32_t backoffMinMs;
+        uint32_t backoffMaxMs;   // ceiling for the doubling backoff
+        uint32_t stableResetMs;  // healthy time that resets the backoff
+    };
+
+    struct Metrics {
+        uint32_t reinits;         // re-init attempts performed
+        uint32_t reinitFailures;  // attempts where initCan() failed
+        uint32_t deferred;        // requests suppressed by the backoff
+        uint32_t backoffMs;       // spacing applied to the next re-init
+        uint64_t operationalMs;
+        uint64_t recoveringMs;
+        uint64_t reinitUs;        // time spent inside initCan() (bus unavailable)
+        bool     recovering;
+    };
+
+    explicit ReinitGovernor(const Config &cfg);
+
+    // A recovery path wants a re-init; true means perform it now.
+    bool shouldReinit(uint32_t nowMs);
+    void onReinitDone(uint32_t nowMs, bool ok, uint32_t elapsedUs);
+    // Controller error-free again; ends the current recovery episode.
+    void onHealthy(uint32_t nowMs);
+
+    Metrics metrics(uint32_t nowMs);
+
+    // Availability in permille of tracked time (1000 = never recovering).
+    static uint16_t availabilityPermille(const Metrics &m);
+
+private:
+    void accrue(uint32_t nowMs);
+
+    Config   cfg_;
+    Metrics  m_ = {};
+    uint32_t lastAccrueMs_     = 0;
+    uint32_t lastReinitMs_     = 0;
+    uint32_t appliedBackoffMs_ = 0;  // spacing owed after lastReinitMs_
+    uint32_t healthySinceMs_   = 0;
+    bool     started_          = false;
+    bool     reinited_         = false;
+};
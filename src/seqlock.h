@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+// Single-writer sequence lock for small POD snapshots.
+//
+// The writer bumps the sequence to odd, copies the value in and bumps it back
+// to even; it never waits. Readers copy the value and retry if the sequence
+// was odd or changed meanwhile, so they get a torn-free copy without a
+// critical section or masking interrupts. Readers must not run in an ISR that
+// can preempt the writer on the same core (they would spin forever).
+template <typename T>
+class Seqlock {
+public:
+    void write(const T &value)
+    {
+        const uint32_t s = seq_.load(std::memory_order_relaxed);
+        seq_.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(const_cast<T *>(&value_), &value, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_release);
+        seq_.store(s + 2, std::memory_order_relaxed);
+    }
+
+    // Returns the number of retries needed (0 when uncontended).
+    uint32_t read(T &out) const
+    {
+        uint32_t retries = 0;
+        for (;;) {
+            const uint32_t before = seq_.load(std::memory_order_acquire);
+            if ((before & 1U) == 0) {
+                memcpy(&out, const_cast<const T *>(&value_), sizeof(T));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq_.load(std::memory_order_relaxed) == before) {
+                    return retries;
+                }
+            }
+            retries++;
+        }
+    }
+
+    uint32_t version() const { return seq_.load(std::memory_order_relaxed) >> 1; }
+
+private:
+    std::atomic<uint32_t> seq_{0};
+    volatile T            value_{};
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "platform.h"
+
+// Statistics counter split into one cache-line padded shard per writer
+// context: one per core for task code plus one for ISRs. Writers increment
+// their own shard with a plain load/store (no atomic RMW, no line shared with
+// the other core); readers sum the shards on demand. Totals are exact as long
+// as each core has a single writer task for a given counter, which holds for
+// the node task and its INT handler.
+class ShardedCounter {
+public:
+    static constexpr uint8_t SHARDS    = PLATFORM_CORES + 1;
+    static constexpr uint8_t ISR_SHARD = PLATFORM_CORES;
+
+    void IRAM_ATTR add(uint32_t n = 1) { bump(platformCoreId(), n); }
+    void IRAM_ATTR addFromIsr(uint32_t n = 1) { bump(ISR_SHARD, n); }
+
+    uint32_t read() const
+    {
+        uint32_t sum = 0;
+        for (uint8_t i = 0; i < SHARDS; ++i) {
+            sum += shards_[i].value;
+        }
+        return sum;
+    }
+
+private:
+    struct alignas(PLATFORM_CACHE_LINE) Shard {
+        volatile uint32_t value;
+    };
+
+    void IRAM_ATTR bump(uint8_t shard, uint32_t n) { shards_[shard].value = shards_[shard].value + n; }
+
+    Shard shards_[SHARDS] = {};
+};
@@ -0,0 +1,59 @@
+#include "soak_monitor.h"
+
+#include <math.h>
+
+struct MetricConfig {
+    const char *name;
+    int8_t      badDirection;    // +1: rising is a degradation, -1: falling
+    float       materialPerDay;  // smallest change per 24 h worth reporting
+};
+
+static constexpr MetricConfig METRICS[SoakMonitor::METRIC_COUNT] = {
+    {"rtt_p50_us",   +1, 200.0f},
+    {"rtt_p99_us",   +1, 500.0f},
+    {"errors_min",   +1, 1.0f},
+    {"reinits_min",  +1, 0.1f},
+    {"free_heap",    -1, 1024.0f},
+    {"stack_free",   -1, 64.0f},
+    {"tx_ring_free", -1, 64.0f},
+    {"rx_batch",     +1, 1.0f},
+};
+
+const char *SoakMonitor::name(Metric m)
+{
+    return METRICS[m].name;
+}
+
+bool SoakMonitor::evaluate(Metric m) const
+{
+    const TrendTracker &t = trends_[m];
+    if (t.count() < MIN_SAMPLES) {
+        return false;
+    }
+    const float slope = t.slope() * METRICS[m].badDirection;  // > 0 means degrading
+    return slope > 0.0f &&
+           fabsf(t.tStat()) >= T_THRESHOLD &&
+           slope * 24.0f >= METRICS[m].materialPerDay;
+}
+
+uint16_t SoakMonitor::add(float hours, const float values[METRIC_COUNT])
+{
+    uint16_t raised = 0;
+    for (uint8_t i = 0; i < METRIC_COUNT; ++i) {
+        if (isnan(values[i])) {
+            continue;
+        }
+        trends_[i].add(hours, values[i]);
+
+        const uint16_t bit = static_cast<uint16_t>(1U << i);
+        if (evaluate(static_cast<Metric>(i))) {
+            if (!(drifting_ & bit)) {
+                raised |= bit;
+            }
+            drifting_ |= bit;
+        } else {
+            drifting_ &= static_cast<uint16_t>(~bit);
+        }
+    }
+    return raised;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "trend.h"
+
+// Soak-test drift detection. Once per minute the node feeds one value per
+// metric; each metric has its own incremental regression against elapsed
+// hours. A metric is flagged as drifting when its slope points the bad way,
+// is statistically solid (|t| >= T_THRESHOLD over >= MIN_SAMPLES minutes)
+// and would amount to a material change over a day.
+class SoakMonitor {
+public:
+    enum Metric : uint8_t {
+        RTT_P50,        // us, per-minute percentile
+        RTT_P99,
+        ERRORS,         // TX errors + RX overflows per minute
+        REINITS,        // controller re-inits per minute
+        FREE_HEAP,      // bytes
+        STACK_FREE,     // node task stack high-water mark, bytes
+        TX_RING_FREE,   // lowest serial TX buffer space seen in the minute, bytes
+        RX_BATCH,       // most frames drained in one loop pass during the minute
+        METRIC_COUNT
+    };
+
+    static constexpr uint16_t MIN_SAMPLES = 30;
+    static constexpr float    T_THRESHOLD = 5.0f;
+
+    // NaN values (e.g. no RTT sample in that minute) are skipped. Returns a
+    // bitmask of metrics that became drifting with this sample.
+    uint16_t add(float hours, const float values[METRIC_COUNT]);
+
+    bool                drifting(Metric m) const { return (drifting_ >> m) & 1U; }
+    const TrendTracker &trend(Metric m) const { return trends_[m]; }
+    static const char  *name(Metric m);
+
+private:
+    bool evaluate(Metric m) const;
+
+    TrendTracker trends_[METRIC_COUNT];
+    uint16_t     drifting_ = 0;
+};
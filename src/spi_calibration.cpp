@@ -0,0 +1,138 @@
+#include "spi_calibration.h"
+
+#include <string.h>
+
+#include "platform.h"
+
+static constexpr uint8_t INSTR_WRITE = 0x02;
+static constexpr uint8_t INSTR_READ  = 0x03;
+static constexpr uint8_t INSTR_RESET = 0xC0;
+
+// Read/write in configuration mode with no side effects: TXB0 data and the
+// RXF0/RXF1 acceptance filters.
+static constexpr uint8_t TEST_REGS[]   = {0x36, 0x00};
+static constexpr uint8_t TEST_SPAN     = 8;
+static constexpr uint8_t PATTERN_COUNT = 6;
+static constexpr uint8_t LOOPBACK_FRAMES_PER_ROUND = 8;
+static constexpr uint8_t CONFIRM_ROUNDS = 8;
+static constexpr uint32_t LOOPBACK_TIMEOUT_MS = 20;
+
+static void fillPattern(uint8_t *buf, uint8_t pattern, uint8_t round)
+{
+    for (uint8_t i = 0; i < TEST_SPAN; ++i) {
+        switch (pattern) {
+        case 0: buf[i] = 0x55; break;
+        case 1: buf[i] = 0xAA; break;
+        case 2: buf[i] = 0x00; break;
+        case 3: buf[i] = 0xFF; break;
+        case 4: buf[i] = static_cast<uint8_t>(1U << ((i + round) & 7)); break;  // walking one
+        default: buf[i] = static_cast<uint8_t>(0x3B * (i + 1) + 0x71 * round); break;
+        }
+    }
+}
+
+static bool verifyRegisters(int cs, uint32_t hz, uint8_t rounds)
+{
+    if (!platformSpiRawBegin(cs, hz)) {
+        return false;
+    }
+    const uint8_t reset = INSTR_RESET;
+    platformSpiRawTransfer(&reset, nullptr, 1);
+    platformDelay(5);  // controller restarts in configuration mode
+
+    bool ok = true;
+    for (uint8_t round = 0; round < rounds && ok; ++round) {
+        for (uint8_t pattern = 0; pattern < PATTERN_COUNT && ok; ++pattern) {
+            for (uint8_t reg : TEST_REGS) {
+                uint8_t tx[2 + TEST_SPAN] = {INSTR_WRITE, reg};
+                fillPattern(tx + 2, pattern, round);
+                platformSpiRawTransfer(tx, nullptr, sizeof(tx));
+
+                uint8_t rd[2 + TEST_SPAN] = {INSTR_READ, reg};
+                uint8_t rx[2 + TEST_SPAN];
+                platformSpiRawTransfer(rd, rx, sizeof(rd));
+                if (memcmp(tx + 2, rx + 2, TEST_SPAN) != 0) {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+    }
+    platformSpiRawEnd();
+    return ok;
+}
+
+static bool verifyLoopback(MCP2515 &mcp, uint8_t rounds)
+{
+    if (mcp.reset() != MCP2515::ERROR_OK ||
+        mcp.setBitrate(CAN_125KBPS, MCP_8MHZ) != MCP2515::ERROR_OK ||
+        mcp.setLoopbackMode() != MCP2515::ERROR_OK) {
+        return false;
+    }
+
+    const uint16_t frames = static_cast<uint16_t>(rounds) * LOOPBACK_FRAMES_PER_ROUND;
+    for (uint16_t n = 0; n < frames; ++n) {
+        struct can_frame tx = {};
+        tx.can_id  = (n & 1) ? (0x15A5A5A5UL | CAN_EFF_FLAG) : 0x2AA;
+        tx.can_dlc = 8;
+        fillPattern(tx.data, static_cast<uint8_t>(n % PATTERN_COUNT), static_cast<uint8_t>(n));
+        if (mcp.sendMessage(&tx) != MCP2515::ERROR_OK) {
+            return false;
+        }
+
+        struct can_frame rx;
+        const uint32_t start = platformMillis();
+        while (mcp.readMessage(&rx) != MCP2515::ERROR_OK) {
+            if ((platformMillis() - start) > LOOPBACK_TIMEOUT_MS) {
+                return false;
+            }
+        }
+        if (rx.can_id != tx.can_id || rx.can_dlc != tx.can_dlc || memcmp(rx.data, tx.data, 8) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool spiVerifyClock(MCP2515 &mcp, uint8_t csPin, uint32_t hz, uint8_t rounds)
+{
+    canDriverSetSpiClock(mcp, csPin, hz);  // releases CS for the raw pass on ESP-IDF
+    if (!verifyRegisters(csPin, hz, rounds)) {
+        return false;
+    }
+    return verifyLoopback(mcp, rounds);
+}
+
+SpiCalibration spiCalibrate(MCP2515 &mcp, uint8_t csPin)
+{
+    constexpr uint8_t STEP_COUNT = sizeof(SPI_CALIBRATION_STEPS_HZ) / sizeof(SPI_CALIBRATION_STEPS_HZ[0]);
+
+    SpiCalibration result = {0, 0, 0};
+    int8_t lastOk = -1;
+    for (uint8_t i = 0; i < STEP_COUNT; ++i) {
+        if (!spiVerifyClock(mcp, csPin, SPI_CALIBRATION_STEPS_HZ[i], 1)) {
+            result.firstFailHz = SPI_CALIBRATION_STEPS_HZ[i];
+            break;
+        }
+        lastOk = static_cast<int8_t>(i);
+        result.highestOkHz = SPI_CALIBRATION_STEPS_HZ[i];
+    }
+
+    // Margin: after a failure, back off one step below the fastest passing one
+    // (the slowest step if that is all there is). With no failure the top step
+    // is the datasheet limit and is kept. The pick must also pass a
+    // CONFIRM_ROUNDS times longer run; otherwise step down until one does.
+    int8_t pick = (result.firstFailHz != 0) ? static_cast<int8_t>(lastOk - 1) : lastOk;
+    if (pick < 0 && lastOk >= 0) {
+        pick = 0;
+    }
+    for (; pick >= 0; --pick) {
+        if (spiVerifyClock(mcp, csPin, SPI_CALIBRATION_STEPS_HZ[pick], CONFIRM_ROUNDS)) {
+            result.selectedHz = SPI_CALIBRATION_STEPS_HZ[pick];
+            break;
+        }
+    }
+
+    canDriverSetSpiClock(mcp, csPin, result.selectedHz ? result.selectedHz : SPI_CALIBRATION_STEPS_HZ[0]);
+    return result;
+}
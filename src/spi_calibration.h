@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "can_driver.h"
+
+// Boot-time search for the fastest reliable MCP2515 SPI clock. Each step
+// resets the controller, writes and reads back register patterns over raw
+// SPI and passes frames through the controller in loopback mode. The search
+// walks up the step list until a step fails, then selects one step below the
+// fastest passing clock, i.e. two below the first failure, as frequency
+// margin. If every step passes it keeps the top step, the MCP2515 datasheet
+// limit. The selected clock must also pass an 8x longer run; a clock that
+// fails it is dropped for the next slower step.
+struct SpiCalibration {
+    uint32_t selectedHz;   // 0 if not even the slowest step passes
+    uint32_t highestOkHz;
+    uint32_t firstFailHz;  // 0 if every step passed
+};
+
+static constexpr uint32_t SPI_CALIBRATION_STEPS_HZ[] = {
+    1000000, 2000000, 4000000, 5000000, 8000000, 10000000,
+};
+
+// Leaves `mcp` re-created at the selected clock (or the slowest step).
+SpiCalibration spiCalibrate(MCP2515 &mcp, uint8_t csPin);
+
+// One verification pass at `hz`; `rounds` scales the pattern and frame count.
+bool spiVerifyClock(MCP2515 &mcp, uint8_t csPin, uint32_t hz, uint8_t rounds);
@@ -0,0 +1,32 @@
+#include "telemetry.h"
+
+#include "platform.h"
+
+// CRC-8, polynomial 0x07 (ATM HEC), no reflection.
+uint8_t telemetryCrc8(const uint8_t *data, size_t len, uint8_t crc)
+{
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (uint8_t b = 0; b < 8; ++b) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07)
+                               : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+bool telemetrySend(uint8_t type, const uint8_t *payload, size_t len)
+{
+    if (len > TELEMETRY_MAX_PAYLOAD) {
+        return false;
+    }
+
+    const uint8_t header[3] = {TELEMETRY_SYNC, type, static_cast<uint8_t>(len)};
+    uint8_t crc = telemetryCrc8(&header[1], 2);
+    crc = telemetryCrc8(payload, len, crc);
+
+    platformWrite(header, sizeof(header));
+    platformWrite(payload, len);
+    platformWrite(&crc, 1);
+    return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary telemetry records multiplexed with the text log on the serial link.
+//
+// Record: SYNC(0xA5) TYPE(u8) LEN(u8) PAYLOAD[LEN] CRC8(TYPE, LEN, PAYLOAD)
+//
+// Text logs are 7-bit ASCII, so SYNC never appears inside a log line; the
+// CRC rejects false starts from boot ROM noise. Host side: pi/telemetry.py.
+
+static constexpr uint8_t TELEMETRY_SYNC        = 0xA5;
+static constexpr uint8_t TELEMETRY_MAX_PAYLOAD = 250;
+
+// Record types (keep in sync with pi/telemetry.py)
+static constexpr uint8_t TELEMETRY_TYPE_CAPTURE      = 0x01;  // CaptureEncoder block
+static constexpr uint8_t TELEMETRY_TYPE_LINK_QUALITY = 0x02;  // LinkQuality::encode()
+static constexpr uint8_t TELEMETRY_TYPE_HISTOGRAM    = 0x03;  // LatencyHistogram::encode()
+
+uint8_t telemetryCrc8(const uint8_t *data, size_t len, uint8_t crc = 0);
+
+// Writes one record to the serial link. Payloads longer than TELEMETRY_MAX_PAYLOAD
+// are rejected (returns false) rather than truncated.
+bool telemetrySend(uint8_t type, const uint8_t *payload, size_t len);
@@ -0,0 +1,159 @@
+#include "traffic_sketch.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Odd multipliers for the per-row multiply-shift hashes.
+static constexpr uint32_t ROW_MULT[TrafficSketch::CMS_DEPTH] = {
+    0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu,
+};
+static constexpr uint32_t HLL_SEED = 0x5BD1E995u;
+
+// murmur3 finaliser: spreads the structured bits of CAN IDs over the word.
+static inline uint32_t mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline uint16_t rowIndex(uint32_t h, uint8_t row)
+{
+    return static_cast<uint16_t>((h * ROW_MULT[row]) >> (32 - TrafficSketch::CMS_BITS));
+}
+
+bool TrafficSketch::begin()
+{
+    if (!cms_) {
+        void *block = malloc(memoryBytes());
+        if (!block) {
+            return false;
+        }
+        cms_ = static_cast<uint32_t *>(block);
+        hll_ = reinterpret_cast<uint8_t *>(cms_ + CMS_DEPTH * CMS_WIDTH);
+    }
+    reset();
+    return true;
+}
+
+void TrafficSketch::reset()
+{
+    if (cms_) {
+        memset(cms_, 0, memoryBytes());
+    }
+    topCount_ = 0;
+    total_    = 0;
+}
+
+void TrafficSketch::add(uint32_t key)
+{
+    if (!cms_) {
+        return;
+    }
+    total_++;
+
+    // Count-min, conservative update: raise only the counters at the minimum.
+    const uint32_t h = mix32(key);
+    uint32_t *cells[CMS_DEPTH];
+    uint32_t est = UINT32_MAX;
+    for (uint8_t r = 0; r < CMS_DEPTH; ++r) {
+        cells[r] = &cms_[r * CMS_WIDTH + rowIndex(h, r)];
+        if (*cells[r] < est) {
+            est = *cells[r];
+        }
+    }
+    est++;
+    for (uint8_t r = 0; r < CMS_DEPTH; ++r) {
+        if (*cells[r] < est) {
+            *cells[r] = est;
+        }
+    }
+
+    // HyperLogLog: register from the top bits, rank of the first set bit below.
+    const uint32_t g    = mix32(key ^ HLL_SEED);
+    const uint16_t reg  = g >> (32 - HLL_BITS);
+    const uint32_t rest = (g << HLL_BITS) | (1U << (HLL_BITS - 1));  // guard bit caps the rank
+    const uint8_t  rank = static_cast<uint8_t>(__builtin_clz(rest) + 1);
+    if (rank > hll_[reg]) {
+        hll_[reg] = rank;
+    }
+
+    // Top-K: refresh the key's entry, or evict the lightest if this key now beats it.
+    uint8_t minSlot = 0;
+    for (uint8_t i = 0; i < topCount_; ++i) {
+        if (top_[i].key == key) {
+            top_[i].count = est;
+            return;
+        }
+        if (top_[i].count < top_[minSlot].count) {
+            minSlot = i;
+        }
+    }
+    if (topCount_ < TOP_K) {
+        top_[topCount_++] = {key, est};
+    } else if (est > top_[minSlot].count) {
+        top_[minSlot] = {key, est};
+    }
+}
+
+uint32_t TrafficSketch::estimate(uint32_t key) const
+{
+    if (!cms_) {
+        return 0;
+    }
+    const uint32_t h = mix32(key);
+    uint32_t est = UINT32_MAX;
+    for (uint8_t r = 0; r < CMS_DEPTH; ++r) {
+        const uint32_t c = cms_[r * CMS_WIDTH + rowIndex(h, r)];
+        if (c < est) {
+            est = c;
+        }
+    }
+    return est;
+}
+
+uint32_t TrafficSketch::errorBound() const
+{
+    // epsilon = e / width of the total count
+    return static_cast<uint32_t>(ceilf(2.7182818f * static_cast<float>(total_) / CMS_WIDTH));
+}
+
+uint32_t TrafficSketch::distinct() const
+{
+    if (!hll_) {
+        return 0;
+    }
+    float    sum   = 0.0f;
+    uint16_t zeros = 0;
+    for (uint16_t i = 0; i < HLL_REGISTERS; ++i) {
+        sum += ldexpf(1.0f, -hll_[i]);
+        zeros += hll_[i] == 0;
+    }
+    const float m     = HLL_REGISTERS;
+    const float alpha = 0.7213f / (1.0f + 1.079f / m);
+    float est = alpha * m * m / sum;
+    if (est <= 2.5f * m && zeros) {
+        est = m * logf(m / zeros);  // linear counting for small cardinalities
+    }
+    return static_cast<uint32_t>(est + 0.5f);
+}
+
+uint8_t TrafficSketch::top(Entry *out) const
+{
+    memcpy(out, top_, topCount_ * sizeof(Entry));
+    // Insertion sort; TOP_K is tiny and this only runs when reporting.
+    for (uint8_t i = 1; i < topCount_; ++i) {
+        const Entry e = out[i];
+        uint8_t j = i;
+        while (j > 0 && out[j - 1].count < e.count) {
+            out[j] = out[j - 1];
+            --j;
+        }
+        out[j] = e;
+    }
+    return topCount_;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-memory traffic profile for buses with too many IDs for an exact
+// table (29-bit J1939 space). Per frame, in constant time:
+//   - count-min sketch (conservative update) for per-ID frame counts; an
+//     estimate never undercounts and overcounts by at most errorBound()
+//     with ~98% probability (e^-CMS_DEPTH)
+//   - HyperLogLog over the same keys for the number of distinct IDs
+//     (standard error 1.04 / sqrt(HLL_REGISTERS), about 3%)
+//   - a TOP_K table of the heaviest IDs seen so far, ranked by their sketch
+//     estimate
+// Keys are linux can_id values with CAN_EFF_FLAG kept, so 11- and 29-bit
+// IDs stay apart.
+class TrafficSketch {
+public:
+    static constexpr uint8_t  CMS_DEPTH     = 4;
+    static constexpr uint8_t  CMS_BITS      = 10;
+    static constexpr uint16_t CMS_WIDTH     = 1U << CMS_BITS;
+    static constexpr uint8_t  HLL_BITS      = 10;
+    static constexpr uint16_t HLL_REGISTERS = 1U << HLL_BITS;
+    static constexpr uint8_t  TOP_K         = 16;
+
+    struct Entry {
+        uint32_t key;
+        uint32_t count;  // sketch estimate
+    };
+
+    // Allocates the sketch tables in internal RAM (memoryBytes()).
+    bool begin();
+    void reset();
+    void add(uint32_t key);
+
+    uint32_t total() const { return total_; }
+    uint32_t estimate(uint32_t key) const;
+    uint32_t errorBound() const;
+    uint32_t distinct() const;
+    // Copies the top table into out[TOP_K], heaviest first; returns the count.
+    uint8_t  top(Entry *out) const;
+
+    static constexpr size_t memoryBytes()
+    {
+        return sizeof(uint32_t) * CMS_DEPTH * CMS_WIDTH + HLL_REGISTERS;
+    }
+
+private:
+    uint32_t *cms_       = nullptr;  // CMS_DEPTH rows of CMS_WIDTH counters
+    uint8_t  *hll_       = nullptr;  // same block, after the counters
+    Entry     top_[TOP_K] = {};
+    uint8_t   topCount_  = 0;
+    uint32_t  total_     = 0;
+};
@@ -0,0 +1,38 @@
+#include "trend.h"
+
+#include <math.h>
+
+void TrendTracker::add(float x, float y)
+{
+    n_++;
+    const float dx = x - meanX_;
+    const float dy = y - meanY_;
+    meanX_ += dx / static_cast<float>(n_);
+    meanY_ += dy / static_cast<float>(n_);
+    // Co-moments with the old delta on one side and the new mean on the other.
+    cxx_ += dx * (x - meanX_);
+    cxy_ += dx * (y - meanY_);
+    cyy_ += dy * (y - meanY_);
+}
+
+float TrendTracker::slope() const
+{
+    return cxx_ > 0.0f ? cxy_ / cxx_ : 0.0f;
+}
+
+float TrendTracker::tStat() const
+{
+    if (n_ < 3 || cxx_ <= 0.0f) {
+        return 0.0f;
+    }
+    const float b = slope();
+    float residual = cyy_ - b * cxy_;
+    if (residual < 0.0f) {
+        residual = 0.0f;  // rounding on a perfect fit
+    }
+    const float se = sqrtf(residual / static_cast<float>(n_ - 2) / cxx_);
+    if (se == 0.0f) {
+        return b == 0.0f ? 0.0f : (b > 0.0f ? INFINITY : -INFINITY);
+    }
+    return b / se;
+}
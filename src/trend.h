@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+// Incremental least-squares line through (x, y) samples, O(1) per update.
+// Uses Welford-style centred co-moments so week-long soaks with large x and
+// y values keep their precision in float. The slope's t statistic tells a
+// real drift from noise.
+class TrendTracker {
+public:
+    void add(float x, float y);
+    void reset() { *this = TrendTracker(); }
+
+    uint32_t count() const { return n_; }
+    float    meanY() const { return meanY_; }
+    float    slope() const;
+    // slope / standard error of the slope; 0 until there are 3 samples.
+    float    tStat() const;
+
+private:
+    uint32_t n_     = 0;
+    float    meanX_ = 0.0f;
+    float    meanY_ = 0.0f;
+    float    cxx_   = 0.0f;
+    float    cxy_   = 0.0f;
+    float    cyy_   = 0.0f;
+};
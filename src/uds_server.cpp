@@ -0,0 +1,165 @@
+#include "uds_server.h"
+
+#include <string.h>
+
+static constexpr uint8_t SID_SESSION_CONTROL = 0x10;
+static constexpr uint8_t SID_READ_DID        = 0x22;
+static constexpr uint8_t SID_TESTER_PRESENT  = 0x3E;
+static constexpr uint8_t SID_NEGATIVE        = 0x7F;
+static constexpr uint8_t POSITIVE            = 0x40;  // response SID = request SID | POSITIVE
+static constexpr uint8_t SUPPRESS_POSITIVE   = 0x80;
+
+static constexpr uint8_t NRC_SERVICE_NOT_SUPPORTED     = 0x11;
+static constexpr uint8_t NRC_SUBFUNCTION_NOT_SUPPORTED = 0x12;
+static constexpr uint8_t NRC_INCORRECT_LENGTH          = 0x13;
+static constexpr uint8_t NRC_RESPONSE_TOO_LONG         = 0x14;
+static constexpr uint8_t NRC_REQUEST_OUT_OF_RANGE      = 0x31;
+
+static void writeU16(uint8_t *p, uint16_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+UdsServer::UdsServer(uint32_t responseId, IsoTp::SendFn send, const DataId *dids, uint8_t didCount)
+    : link_(responseId, send, 0, 0), dids_(dids), didCount_(didCount)
+{
+    link_.setRxBuffer(rxBuf_, sizeof(rxBuf_));
+}
+
+bool UdsServer::flush(uint32_t nowMs)
+{
+    if (!txPending_ || !link_.send(txBuf_, txLen_, nowMs)) {
+        return false;
+    }
+    txPending_ = false;
+    return true;
+}
+
+void UdsServer::positive(uint8_t sid, uint16_t len)
+{
+    txBuf_[0]  = sid | POSITIVE;
+    txLen_     = len;
+    txPending_ = true;
+}
+
+void UdsServer::negative(uint8_t sid, uint8_t nrc)
+{
+    txBuf_[0]  = SID_NEGATIVE;
+    txBuf_[1]  = sid;
+    txBuf_[2]  = nrc;
+    txLen_     = 3;
+    txPending_ = true;
+    negatives_++;
+}
+
+void UdsServer::readDataByIdentifier(uint16_t len)
+{
+    if (len < 3 || (len - 1) % 2) {
+        negative(SID_READ_DID, NRC_INCORRECT_LENGTH);
+        return;
+    }
+    uint16_t pos = 1;
+    for (uint16_t i = 1; i < len; i += 2) {
+        const uint16_t id = static_cast<uint16_t>((rxBuf_[i] << 8) | rxBuf_[i + 1]);
+        uint32_t value = 0;
+        uint8_t  size  = 0;
+        if (id == DID_ACTIVE_SESSION) {
+            value = session_;
+            size  = 1;
+        } else {
+            for (uint8_t d = 0; d < didCount_; ++d) {
+                if (dids_[d].id == id) {
+                    size = dids_[d].size;
+                    memcpy(&value, dids_[d].ptr, size);  // little-endian target
+                    break;
+                }
+            }
+        }
+        if (size == 0) {
+            continue;  // unsupported identifiers are left out of the response
+        }
+        if (pos + 2 + size > RESPONSE_MAX) {
+            negative(SID_READ_DID, NRC_RESPONSE_TOO_LONG);
+            return;
+        }
+        writeU16(txBuf_ + pos, id);
+        pos += 2;
+        for (uint8_t b = size; b-- > 0;) {
+            txBuf_[pos++] = static_cast<uint8_t>(value >> (8 * b));
+        }
+    }
+    if (pos == 1) {
+        negative(SID_READ_DID, NRC_REQUEST_OUT_OF_RANGE);  // none supported
+        return;
+    }
+    positive(SID_READ_DID, pos);
+}
+
+void UdsServer::handleRequest(uint16_t len, uint32_t nowMs)
+{
+    requests_++;
+    lastRequestMs_ = nowMs;
+    const uint8_t sid = rxBuf_[0];
+
+    switch (sid) {
+    case SID_SESSION_CONTROL: {
+        const uint8_t sub = len == 2 ? static_cast<uint8_t>(rxBuf_[1] & ~SUPPRESS_POSITIVE) : 0;
+        if (len != 2) {
+            negative(sid, NRC_INCORRECT_LENGTH);
+        } else if (sub != SESSION_DEFAULT && sub != SESSION_EXTENDED) {
+            negative(sid, NRC_SUBFUNCTION_NOT_SUPPORTED);
+        } else {
+            session_ = static_cast<Session>(sub);
+            if (!(rxBuf_[1] & SUPPRESS_POSITIVE)) {
+                txBuf_[1] = sub;
+                writeU16(txBuf_ + 2, P2_MS);
+                writeU16(txBuf_ + 4, P2_STAR_MS / 10);
+                positive(sid, 6);
+            }
+        }
+        return;
+    }
+
+    case SID_TESTER_PRESENT:
+        if (len != 2) {
+            negative(sid, NRC_INCORRECT_LENGTH);
+        } else if (rxBuf_[1] & ~SUPPRESS_POSITIVE) {
+            negative(sid, NRC_SUBFUNCTION_NOT_SUPPORTED);
+        } else if (!(rxBuf_[1] & SUPPRESS_POSITIVE)) {
+            txBuf_[1] = 0;
+            positive(sid, 2);
+        }
+        return;
+
+    case SID_READ_DID:
+        readDataByIdentifier(len);
+        return;
+
+    default:
+        negative(sid, NRC_SERVICE_NOT_SUPPORTED);
+        return;
+    }
+}
+
+bool UdsServer::onFrame(const uint8_t *data, uint8_t len, uint32_t nowMs)
+{
+    if (link_.onFrame(data, len, nowMs) != IsoTp::MESSAGE) {
+        return false;  // flow control, part of a request, or a broken one
+    }
+    if (txPending_ || link_.txBusy()) {
+        dropped_++;  // still answering the previous request
+        return false;
+    }
+    handleRequest(link_.rxLength(), nowMs);
+    return flush(nowMs);
+}
+
+bool UdsServer::poll(uint32_t nowMs)
+{
+    link_.poll(nowMs);
+    if (session_ != SESSION_DEFAULT && nowMs - lastRequestMs_ > S3_MS) {
+        session_ = SESSION_DEFAULT;
+    }
+    return flush(nowMs);
+}
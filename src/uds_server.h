@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "isotp.h"
+
+// Minimal UDS (ISO 14229-1) diagnostic server on ISO-TP (isotp.h), physical
+// addressing only:
+//
+//   DiagnosticSessionControl  10 ss        -> 50 ss P2:u16 P2*:u16
+//   ReadDataByIdentifier      22 did..     -> 62 did data [did data]..
+//   TesterPresent             3E 00        -> 7E 00
+//   negative response                      -> 7F sid nrc
+//
+// Integers are big-endian, as UDS specifies; P2 is in ms, P2* in 10 ms.
+// Sessions are default (01) and extended (03); the extended session falls
+// back to default after S3_MS without a request. Bit 7 of a subfunction
+// suppresses the positive response. Data identifiers are unsigned integers
+// from the table handed to the constructor, plus 0xF186 (active session).
+// Every request is answered as soon as it is complete, so the server never
+// needs response-pending (NRC 78); a request that arrives while a long
+// response is still going out is dropped, as there is only one ISO-TP
+// channel.
+class UdsServer {
+public:
+    struct DataId {
+        uint16_t    id;
+        const void *ptr;
+        uint8_t     size;  // 1, 2 or 4
+    };
+
+    static constexpr uint16_t P2_MS        = 50;    // announced server response time
+    static constexpr uint16_t P2_STAR_MS   = 5000;  // after a response-pending, never used here
+    static constexpr uint32_t S3_MS        = 5000;  // non-default session timeout
+    static constexpr uint16_t REQUEST_MAX  = 64;
+    static constexpr uint16_t RESPONSE_MAX = 128;
+    static constexpr uint16_t DID_ACTIVE_SESSION = 0xF186;
+
+    enum Session : uint8_t {
+        SESSION_DEFAULT  = 0x01,
+        SESSION_EXTENDED = 0x03,
+    };
+
+    UdsServer(uint32_t responseId, IsoTp::SendFn send, const DataId *dids, uint8_t didCount);
+
+    // Both return true when the first frame of a response went out, so the
+    // caller can time request-to-response on its own clock. A response the
+    // controller had no room for is retried by poll().
+    bool onFrame(const uint8_t *data, uint8_t len, uint32_t nowMs);
+    bool poll(uint32_t nowMs);
+
+    Session  session() const { return session_; }
+    uint32_t requests() const { return requests_; }
+    uint32_t negatives() const { return negatives_; }
+    uint32_t dropped() const { return dropped_; }
+    uint32_t transportAborts() const { return link_.aborts(); }
+
+private:
+    void handleRequest(uint16_t len, uint32_t nowMs);
+    void readDataByIdentifier(uint16_t len);
+    void positive(uint8_t sid, uint16_t len);  // txBuf_[1..len) already filled
+    void negative(uint8_t sid, uint8_t nrc);
+    bool flush(uint32_t nowMs);
+
+    IsoTp         link_;
+    const DataId *dids_;
+    uint8_t       didCount_;
+
+    uint8_t  rxBuf_[REQUEST_MAX]  = {};
+    uint8_t  txBuf_[RESPONSE_MAX] = {};
+    uint16_t txLen_     = 0;
+    bool     txPending_ = false;  // response built, first frame not yet sent
+
+    Session  session_       = SESSION_DEFAULT;
+    uint32_t lastRequestMs_ = 0;
+    uint32_t requests_      = 0;
+    uint32_t negatives_     = 0;
+    uint32_t dropped_       = 0;
+};
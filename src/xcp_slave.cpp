@@ -0,0 +1,454 @@
+#include "xcp_slave.h"
+
+#include <string.h>
+
+// Command codes (CTO PID)
+static constexpr uint8_t CMD_CONNECT                 = 0xFF;
+static constexpr uint8_t CMD_DISCONNECT              = 0xFE;
+static constexpr uint8_t CMD_GET_STATUS              = 0xFD;
+static constexpr uint8_t CMD_SYNCH                   = 0xFC;
+static constexpr uint8_t CMD_SHORT_UPLOAD            = 0xF4;
+static constexpr uint8_t CMD_SET_DAQ_PTR             = 0xE2;
+static constexpr uint8_t CMD_WRITE_DAQ               = 0xE1;
+static constexpr uint8_t CMD_SET_DAQ_LIST_MODE       = 0xE0;
+static constexpr uint8_t CMD_START_STOP_DAQ_LIST     = 0xDE;
+static constexpr uint8_t CMD_START_STOP_SYNCH        = 0xDD;
+static constexpr uint8_t CMD_GET_DAQ_CLOCK           = 0xDC;
+static constexpr uint8_t CMD_GET_DAQ_PROCESSOR_INFO  = 0xDA;
+static constexpr uint8_t CMD_GET_DAQ_RESOLUTION_INFO = 0xD9;
+static constexpr uint8_t CMD_FREE_DAQ                = 0xD6;
+static constexpr uint8_t CMD_ALLOC_DAQ               = 0xD5;
+static constexpr uint8_t CMD_ALLOC_ODT               = 0xD4;
+static constexpr uint8_t CMD_ALLOC_ODT_ENTRY         = 0xD3;
+
+static constexpr uint8_t PID_RES = 0xFF;
+static constexpr uint8_t PID_ERR = 0xFE;
+
+static constexpr uint8_t ERR_CMD_SYNCH        = 0x00;
+static constexpr uint8_t ERR_DAQ_ACTIVE       = 0x11;
+static constexpr uint8_t ERR_CMD_UNKNOWN      = 0x20;
+static constexpr uint8_t ERR_CMD_SYNTAX       = 0x21;
+static constexpr uint8_t ERR_OUT_OF_RANGE     = 0x22;
+static constexpr uint8_t ERR_ACCESS_DENIED    = 0x24;
+static constexpr uint8_t ERR_MODE_NOT_VALID   = 0x27;
+static constexpr uint8_t ERR_SEQUENCE         = 0x29;
+static constexpr uint8_t ERR_DAQ_CONFIG       = 0x2A;
+static constexpr uint8_t ERR_MEMORY_OVERFLOW  = 0x30;
+
+static constexpr uint8_t RESOURCE_DAQ        = 0x04;
+static constexpr uint8_t STATUS_DAQ_RUNNING  = 0x40;
+static constexpr uint8_t DAQ_MODE_TIMESTAMP  = 0x10;
+static constexpr uint8_t DAQ_MODE_PID_OFF    = 0x20;
+static constexpr uint8_t DAQ_MODE_DIRECTION  = 0x02;  // STIM
+static constexpr uint8_t PID_OVERLOAD        = 0x80;
+
+// DAQ_PROPERTIES: dynamic config, prescaler, timestamps, overload in PID MSB
+static constexpr uint8_t DAQ_PROPERTIES = 0x01 | 0x02 | 0x10 | 0x40;
+// TIMESTAMP_MODE: 4 bytes, unit 1 us
+static constexpr uint8_t TIMESTAMP_MODE = 0x04 | (0x3 << 4);
+
+static constexpr uint8_t MAX_DTO       = 8;
+static constexpr uint8_t TIMESTAMP_LEN = 4;
+
+static uint16_t readU16(const uint8_t *p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t readU32(const uint8_t *p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void writeU32(uint8_t *p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+const uint8_t *XcpSlave::resolve(uint8_t ext, uint32_t addr, uint8_t size) const
+{
+    if (ext == ADDR_EXT_TABLE) {
+        if (addr < varCount_ && size <= vars_[addr].size) {
+            return static_cast<const uint8_t *>(vars_[addr].ptr);
+        }
+        return nullptr;
+    }
+    if (ext != 0) {
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < varCount_; ++i) {
+        const uintptr_t base = reinterpret_cast<uintptr_t>(vars_[i].ptr);
+        // Offsets, not end addresses: addr + size wraps for addr near 4 GiB.
+        if (addr - base <= vars_[i].size && size <= vars_[i].size - (addr - base)) {
+            return static_cast<const uint8_t *>(vars_[i].ptr) + (addr - base);
+        }
+    }
+    return nullptr;
+}
+
+uint8_t XcpSlave::odtBytes(const Odt &odt) const
+{
+    uint8_t n = 0;
+    for (uint8_t e = 0; e < odt.entryCount; ++e) {
+        n += entries_[odt.firstEntry + e].size;
+    }
+    return n;
+}
+
+void XcpSlave::respond(const uint8_t *data, uint8_t len)
+{
+    send_(dtoId_, data, len);  // a lost response is a master timeout
+}
+
+void XcpSlave::error(uint8_t code)
+{
+    const uint8_t err[2] = {PID_ERR, code};
+    respond(err, sizeof(err));
+}
+
+void XcpSlave::freeDaq()
+{
+    memset(daq_, 0, sizeof(daq_));
+    memset(odts_, 0, sizeof(odts_));  // ALLOC_ODT_ENTRY refuses ODTs that already have entries
+    memset(entries_, 0, sizeof(entries_));
+    daqCount_     = 0;
+    odtUsed_      = 0;
+    entryUsed_    = 0;
+    runningLists_ = 0;
+    ptrValid_     = false;
+    allocStage_   = CMD_FREE_DAQ;
+}
+
+uint8_t XcpSlave::startList(uint8_t daq)
+{
+    DaqList &l = daq_[daq];
+    if (l.odtCount == 0) {
+        return ERR_DAQ_CONFIG;
+    }
+    for (uint8_t o = 0; o < l.odtCount; ++o) {
+        const uint8_t room = MAX_DTO - 1 - ((o == 0 && (l.mode & DAQ_MODE_TIMESTAMP)) ? TIMESTAMP_LEN : 0);
+        if (odtBytes(odts_[l.firstOdt + o]) > room) {
+            return ERR_DAQ_CONFIG;
+        }
+    }
+    l.countdown = 1;
+    l.overload  = false;
+    l.running   = true;
+    runningLists_ |= static_cast<uint8_t>(1U << daq);
+    return 0;
+}
+
+void XcpSlave::stopList(uint8_t daq)
+{
+    daq_[daq].running = false;
+    runningLists_ &= static_cast<uint8_t>(~(1U << daq));
+}
+
+void XcpSlave::event(uint8_t event, uint32_t nowUs)
+{
+    if (!runningLists_) {
+        return;
+    }
+    for (uint8_t d = 0; d < daqCount_; ++d) {
+        DaqList &l = daq_[d];
+        if (!l.running || l.event != event || --l.countdown != 0) {
+            continue;
+        }
+        l.countdown = l.prescaler;
+
+        for (uint8_t o = 0; o < l.odtCount; ++o) {
+            const Odt &odt = odts_[l.firstOdt + o];
+            uint8_t dto[MAX_DTO];
+            uint8_t n = 0;
+            dto[n++] = static_cast<uint8_t>((l.firstOdt + o) | (l.overload ? PID_OVERLOAD : 0));
+            if (o == 0 && (l.mode & DAQ_MODE_TIMESTAMP)) {
+                writeU32(dto + n, nowUs);
+                n += TIMESTAMP_LEN;
+            }
+            for (uint8_t e = 0; e < odt.entryCount; ++e) {
+                const Entry &entry = entries_[odt.firstEntry + e];
+                memcpy(dto + n, entry.ptr, entry.size);
+                n += entry.size;
+            }
+            if (!send_(dtoId_, dto, n)) {
+                l.overload = true;  // rest of this cycle is dropped
+                overloads_++;
+                break;
+            }
+            l.overload = false;
+            packets_++;
+        }
+    }
+}
+
+void XcpSlave::onCommand(const uint8_t *cmd, uint8_t len, uint32_t nowUs)
+{
+    if (len == 0) {
+        return;
+    }
+    if (cmd[0] == CMD_CONNECT) {
+        if (len < 2 || cmd[1] != 0) {
+            error(ERR_OUT_OF_RANGE);  // only normal mode
+            return;
+        }
+        connected_ = true;
+        const uint8_t res[8] = {PID_RES, RESOURCE_DAQ, 0x00 /* Intel, byte granularity */, MAX_DTO,
+                                MAX_DTO, 0, 0x01, 0x01};
+        respond(res, sizeof(res));
+        return;
+    }
+    if (!connected_) {
+        return;  // a disconnected slave stays silent
+    }
+
+    uint8_t res[8] = {PID_RES};
+    switch (cmd[0]) {
+    case CMD_DISCONNECT:
+        for (uint8_t d = 0; d < daqCount_; ++d) {
+            stopList(d);
+        }
+        connected_ = false;
+        respond(res, 1);
+        return;
+
+    case CMD_GET_STATUS:
+        res[1] = runningLists_ ? STATUS_DAQ_RUNNING : 0;
+        respond(res, 6);
+        return;
+
+    case CMD_SYNCH:
+        error(ERR_CMD_SYNCH);
+        return;
+
+    case CMD_SHORT_UPLOAD: {
+        if (len < 8) {
+            error(ERR_CMD_SYNTAX);
+            return;
+        }
+        const uint8_t n = cmd[1];
+        const uint8_t *src = n <= MAX_DTO - 1 ? resolve(cmd[3], readU32(cmd + 4), n) : nullptr;
+        if (!src) {
+            error(n <= MAX_DTO - 1 ? ERR_ACCESS_DENIED : ERR_OUT_OF_RANGE);
+            return;
+        }
+        memcpy(res + 1, src, n);
+        respond(res, static_cast<uint8_t>(1 + n));
+        return;
+    }
+
+    case CMD_GET_DAQ_CLOCK:
+        writeU32(res + 4, nowUs);
+        respond(res, 8);
+        return;
+
+    case CMD_GET_DAQ_PROCESSOR_INFO:
+        res[1] = DAQ_PROPERTIES;
+        res[2] = MAX_DAQ;
+        res[4] = eventCount_;
+        res[6] = 0;  // no predefined lists
+        res[7] = 0;  // absolute ODT number as PID, no address extension limits
+        respond(res, 8);
+        return;
+
+    case CMD_GET_DAQ_RESOLUTION_INFO:
+        res[1] = 1;               // ODT entry granularity
+        res[2] = MAX_ENTRY_SIZE;
+        res[3] = 1;               // STIM granularity
+        res[4] = 0;               // no STIM
+        res[5] = TIMESTAMP_MODE;
+        res[6] = 1;               // ticks per unit
+        respond(res, 8);
+        return;
+
+    case CMD_FREE_DAQ:
+        freeDaq();
+        respond(res, 1);
+        return;
+
+    case CMD_ALLOC_DAQ: {
+        if (len < 4) {
+            error(ERR_CMD_SYNTAX);
+        } else if (runningLists_) {
+            error(ERR_DAQ_ACTIVE);
+        } else if (allocStage_ != CMD_FREE_DAQ) {
+            error(ERR_SEQUENCE);
+        } else if (readU16(cmd + 2) > MAX_DAQ) {
+            error(ERR_MEMORY_OVERFLOW);
+        } else {
+            daqCount_   = static_cast<uint8_t>(readU16(cmd + 2));
+            allocStage_ = CMD_ALLOC_DAQ;
+            respond(res, 1);
+        }
+        return;
+    }
+
+    case CMD_ALLOC_ODT: {
+        const uint16_t daq = len >= 5 ? readU16(cmd + 2) : 0xFFFF;
+        if (len < 5) {
+            error(ERR_CMD_SYNTAX);
+        } else if (allocStage_ != CMD_ALLOC_DAQ && allocStage_ != CMD_ALLOC_ODT) {
+            error(ERR_SEQUENCE);
+        } else if (daq >= daqCount_ || daq_[daq].odtCount) {
+            error(ERR_OUT_OF_RANGE);
+        } else if (cmd[4] > MAX_ODT - odtUsed_) {
+            error(ERR_MEMORY_OVERFLOW);
+        } else {
+            daq_[daq].firstOdt = odtUsed_;
+            daq_[daq].odtCount = cmd[4];
+            daq_[daq].prescaler = 1;
+            odtUsed_ += cmd[4];
+            allocStage_ = CMD_ALLOC_ODT;
+            respond(res, 1);
+        }
+        return;
+    }
+
+    case CMD_ALLOC_ODT_ENTRY: {
+        const uint16_t daq = len >= 6 ? readU16(cmd + 2) : 0xFFFF;
+        if (len < 6) {
+            error(ERR_CMD_SYNTAX);
+        } else if (allocStage_ != CMD_ALLOC_ODT && allocStage_ != CMD_ALLOC_ODT_ENTRY) {
+            error(ERR_SEQUENCE);
+        } else if (daq >= daqCount_ || cmd[4] >= daq_[daq].odtCount ||
+                   odts_[daq_[daq].firstOdt + cmd[4]].entryCount) {
+            error(ERR_OUT_OF_RANGE);
+        } else if (cmd[5] > MAX_ENTRIES - entryUsed_) {
+            error(ERR_MEMORY_OVERFLOW);
+        } else {
+            Odt &odt = odts_[daq_[daq].firstOdt + cmd[4]];
+            odt.firstEntry = entryUsed_;
+            odt.entryCount = cmd[5];
+            entryUsed_ += cmd[5];
+            allocStage_ = CMD_ALLOC_ODT_ENTRY;
+            respond(res, 1);
+        }
+        return;
+    }
+
+    case CMD_SET_DAQ_PTR: {
+        const uint16_t daq = len >= 6 ? readU16(cmd + 2) : 0xFFFF;
+        if (len < 6) {
+            error(ERR_CMD_SYNTAX);
+        } else if (daq >= daqCount_ || cmd[4] >= daq_[daq].odtCount ||
+                   cmd[5] >= odts_[daq_[daq].firstOdt + cmd[4]].entryCount) {
+            error(ERR_OUT_OF_RANGE);
+        } else if (daq_[daq].running) {
+            error(ERR_DAQ_ACTIVE);
+        } else {
+            ptrDaq_   = static_cast<uint8_t>(daq);
+            ptrOdt_   = cmd[4];
+            ptrEntry_ = cmd[5];
+            ptrValid_ = true;
+            respond(res, 1);
+        }
+        return;
+    }
+
+    case CMD_WRITE_DAQ: {
+        if (len < 8) {
+            error(ERR_CMD_SYNTAX);
+            return;
+        }
+        const Odt &odt = odts_[daq_[ptrDaq_].firstOdt + ptrOdt_];
+        if (!ptrValid_ || ptrEntry_ >= odt.entryCount) {
+            error(ERR_SEQUENCE);
+            return;
+        }
+        const uint8_t size = cmd[2];
+        if (cmd[1] != 0xFF || size == 0 || size > MAX_ENTRY_SIZE) {
+            error(ERR_OUT_OF_RANGE);  // no bit-wise entries
+            return;
+        }
+        const uint8_t *src = resolve(cmd[3], readU32(cmd + 4), size);
+        if (!src) {
+            error(ERR_ACCESS_DENIED);
+            return;
+        }
+        Entry &entry = entries_[odt.firstEntry + ptrEntry_];
+        entry.ptr  = src;
+        entry.size = size;
+        if (odtBytes(odt) > MAX_DTO - 1) {
+            entry.size = 0;
+            error(ERR_DAQ_CONFIG);
+            return;
+        }
+        ptrEntry_++;
+        respond(res, 1);
+        return;
+    }
+
+    case CMD_SET_DAQ_LIST_MODE: {
+        const uint16_t daq = len >= 8 ? readU16(cmd + 2) : 0xFFFF;
+        if (len < 8) {
+            error(ERR_CMD_SYNTAX);
+        } else if (daq >= daqCount_ || readU16(cmd + 4) >= eventCount_) {
+            error(ERR_OUT_OF_RANGE);
+        } else if (cmd[1] & (DAQ_MODE_DIRECTION | DAQ_MODE_PID_OFF)) {
+            error(ERR_MODE_NOT_VALID);  // no STIM, PID always present
+        } else if (daq_[daq].running) {
+            error(ERR_DAQ_ACTIVE);
+        } else {
+            daq_[daq].mode      = cmd[1];
+            daq_[daq].event     = static_cast<uint8_t>(readU16(cmd + 4));
+            daq_[daq].prescaler = cmd[6] ? cmd[6] : 1;
+            respond(res, 1);
+        }
+        return;
+    }
+
+    case CMD_START_STOP_DAQ_LIST: {
+        const uint16_t daq = len >= 4 ? readU16(cmd + 2) : 0xFFFF;
+        if (len < 4) {
+            error(ERR_CMD_SYNTAX);
+            return;
+        }
+        if (daq >= daqCount_ || cmd[1] > 2) {
+            error(ERR_OUT_OF_RANGE);
+            return;
+        }
+        uint8_t err = 0;
+        switch (cmd[1]) {
+        case 0: stopList(static_cast<uint8_t>(daq)); break;
+        case 1: err = startList(static_cast<uint8_t>(daq)); break;
+        default: daq_[daq].selected = true; break;
+        }
+        if (err) {
+            error(err);
+            return;
+        }
+        res[1] = daq_[daq].firstOdt;
+        respond(res, 2);
+        return;
+    }
+
+    case CMD_START_STOP_SYNCH: {
+        if (len < 2 || cmd[1] > 2) {
+            error(len < 2 ? ERR_CMD_SYNTAX : ERR_OUT_OF_RANGE);
+            return;
+        }
+        for (uint8_t d = 0; d < daqCount_; ++d) {
+            if (cmd[1] == 0) {
+                stopList(d);
+            } else if (daq_[d].selected) {
+                daq_[d].selected = false;
+                if (cmd[1] == 2) {
+                    stopList(d);
+                } else if (const uint8_t err = startList(d)) {
+                    error(err);
+                    return;
+                }
+            }
+        }
+        respond(res, 1);
+        return;
+    }
+
+    default:
+        error(ERR_CMD_UNKNOWN);
+        return;
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal XCP-on-CAN slave (ASAM MCD-1 XCP 1.x) for measurement only:
+// CONNECT/DISCONNECT/GET_STATUS/SYNCH, SHORT_UPLOAD, GET_DAQ_CLOCK and
+// dynamic DAQ lists (FREE_DAQ, ALLOC_DAQ/ODT/ODT_ENTRY, SET_DAQ_PTR,
+// WRITE_DAQ, SET_DAQ_LIST_MODE, START_STOP_DAQ_LIST/SYNCH). Commands
+// (CTO) and DAQ packets (DTO) are single CAN frames, Intel byte order; DTOs
+// are only as long as their content.
+//
+// Only the variables in the table handed to the constructor can be read:
+// address extension 1 addresses them by table index, extension 0 by their
+// absolute address (as an A2L generated from the ELF would), provided the
+// whole access lies inside one variable.
+//
+// DAQ packets are PID (absolute ODT number), a 4-byte microsecond
+// timestamp in the first ODT when the list asks for it, then the ODT
+// entries. When the controller has no room for a packet the rest of that
+// list's cycle is skipped and bit 7 of the next PID flags the overload.
+class XcpSlave {
+public:
+    using SendFn = bool (*)(uint32_t id, const uint8_t *data, uint8_t len);
+
+    struct Variable {
+        const char *name;
+        const void *ptr;
+        uint8_t     size;
+    };
+
+    static constexpr uint8_t MAX_DAQ         = 4;
+    static constexpr uint8_t MAX_ODT         = 32;  // all lists together
+    static constexpr uint8_t MAX_ENTRIES     = 96;  // all ODTs together
+    static constexpr uint8_t MAX_ENTRY_SIZE  = 4;
+    static constexpr uint8_t ADDR_EXT_TABLE  = 1;
+
+    XcpSlave(uint32_t dtoId, SendFn send, const Variable *vars, uint8_t varCount, uint8_t eventCount)
+        : dtoId_(dtoId), send_(send), vars_(vars), varCount_(varCount), eventCount_(eventCount) {}
+
+    void onCommand(const uint8_t *data, uint8_t len, uint32_t nowUs);
+    // Samples every running DAQ list bound to `event`.
+    void event(uint8_t event, uint32_t nowUs);
+
+    bool     connected() const { return connected_; }
+    bool     daqRunning() const { return runningLists_ != 0; }
+    uint32_t daqPackets() const { return packets_; }
+    uint32_t overloads() const { return overloads_; }
+
+private:
+    struct Entry {
+        const uint8_t *ptr;
+        uint8_t        size;
+    };
+    struct Odt {
+        uint8_t firstEntry;
+        uint8_t entryCount;
+    };
+    struct DaqList {
+        uint8_t  firstOdt;
+        uint8_t  odtCount;
+        uint8_t  mode;
+        uint8_t  event;
+        uint8_t  prescaler;
+        uint8_t  countdown;
+        bool     selected;
+        bool     running;
+        bool     overload;
+    };
+
+    const uint8_t *resolve(uint8_t ext, uint32_t addr, uint8_t size) const;
+    uint8_t odtBytes(const Odt &odt) const;
+    uint8_t startList(uint8_t daq);  // 0 or an XCP error code
+    void    stopList(uint8_t daq);
+    void    freeDaq();
+    void    respond(const uint8_t *data, uint8_t len);
+    void    error(uint8_t code);
+
+    uint32_t        dtoId_;
+    SendFn          send_;
+    const Variable *vars_;
+    uint8_t         varCount_;
+    uint8_t         eventCount_;
+
+    bool    connected_    = false;
+    uint8_t allocStage_   = 0;  // FREE_DAQ -> ALLOC_DAQ -> ALLOC_ODT -> ALLOC_ODT_ENTRY
+    uint8_t daqCount_     = 0;
+    uint8_t odtUsed_      = 0;
+    uint8_t entryUsed_    = 0;
+    uint8_t runningLists_ = 0;  // bitmask
+    bool    ptrValid_     = false;
+    uint8_t ptrDaq_       = 0;
+    uint8_t ptrOdt_       = 0;
+    uint8_t ptrEntry_     = 0;
+
+    DaqList daq_[MAX_DAQ]         = {};
+    Odt     odts_[MAX_ODT]        = {};
+    Entry   entries_[MAX_ENTRIES] = {};
+
+    uint32_t packets_   = 0;
+    uint32_t overloads_ = 0;
+};
@@ -0,0 +1,59 @@
+// Host tests for the re-init governor: pio test -e native -f test_reinit_governor
+#include <unity.h>
+
+#include "reinit_governor.h"
+
+static const ReinitGovernor::Config CFG = {100, 1600, 10000};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void test_first_request_is_allowed(void)
+{
+    ReinitGovernor gov(CFG);
+    TEST_ASSERT_TRUE(gov.shouldReinit(0));
+}
+
+static void test_backoff_doubles_between_reinits(void)
+{
+    ReinitGovernor gov(CFG);
+    TEST_ASSERT_TRUE(gov.shouldReinit(1000));
+    gov.onReinitDone(1000, false, 0);
+    TEST_ASSERT_FALSE(gov.shouldReinit(1099));
+    TEST_ASSERT_TRUE(gov.shouldReinit(1100));
+    gov.onReinitDone(1100, false, 0);
+    TEST_ASSERT_FALSE(gov.shouldReinit(1299));
+    TEST_ASSERT_TRUE(gov.shouldReinit(1300));
+    TEST_ASSERT_EQUAL_UINT32(2, gov.metrics(1300).deferred);
+}
+
+// A node that last re-initialised more than 2^31 ms ago must not be deferred.
+static void test_allowed_after_2_pow_31_ms(void)
+{
+    ReinitGovernor gov(CFG);
+    TEST_ASSERT_TRUE(gov.shouldReinit(1000));
+    gov.onReinitDone(1000, true, 0);
+    gov.onHealthy(1050);
+    TEST_ASSERT_TRUE(gov.shouldReinit(1000 + 100 + 0x80000000u + 50));
+}
+
+static void test_backoff_holds_across_millis_wrap(void)
+{
+    ReinitGovernor gov(CFG);
+    const uint32_t t = 0xFFFFFFC0u;  // 64 ms before wrap
+    TEST_ASSERT_TRUE(gov.shouldReinit(t));
+    gov.onReinitDone(t, false, 0);
+    TEST_ASSERT_FALSE(gov.shouldReinit(t + 99));
+    TEST_ASSERT_TRUE(gov.shouldReinit(t + 100));
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_request_is_allowed);
+    RUN_TEST(test_backoff_doubles_between_reinits);
+    RUN_TEST(test_allowed_after_2_pow_31_ms);
+    RUN_TEST(test_backoff_holds_across_millis_wrap);
+    return UNITY_END();
+}
@@ -0,0 +1,152 @@
+// Host tests for the XCP slave: pio test -e native -f test_xcp_slave
+#include <string.h>
+#include <unity.h>
+
+#include "xcp_slave.h"
+
+static uint8_t  lastFrame[8];
+static uint8_t  lastLen;
+static uint32_t frames;
+
+static bool captureSend(uint32_t, const uint8_t *data, uint8_t len)
+{
+    memcpy(lastFrame, data, len);
+    lastLen = len;
+    frames++;
+    return true;
+}
+
+static uint32_t counter = 0x11223344;
+static uint16_t batch   = 7;
+static const XcpSlave::Variable VARS[] = {
+    {"counter", &counter, 4},
+    {"batch",   &batch,   2},
+};
+
+void setUp(void)
+{
+    lastLen = 0;
+    frames  = 0;
+}
+
+void tearDown(void) {}
+
+// Sends one command and expects a positive response.
+static void command(XcpSlave &xcp, const uint8_t *cmd, uint8_t len)
+{
+    lastLen = 0;
+    xcp.onCommand(cmd, len, 0);
+    TEST_ASSERT_TRUE(lastLen >= 1);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, lastFrame[0]);
+}
+
+// FREE_DAQ, one list with one ODT holding both variables, as pi/xcp_master.py does it.
+static void configure(XcpSlave &xcp)
+{
+    const uint8_t freeDaq[]    = {0xD6};
+    const uint8_t allocDaq[]   = {0xD5, 0, 1, 0};
+    const uint8_t allocOdt[]   = {0xD4, 0, 0, 0, 1};
+    const uint8_t allocEntry[] = {0xD3, 0, 0, 0, 0, 2};
+    const uint8_t setPtr[]     = {0xE2, 0, 0, 0, 0, 0};
+    const uint8_t write0[]     = {0xE1, 0xFF, 4, XcpSlave::ADDR_EXT_TABLE, 0, 0, 0, 0};
+    const uint8_t write1[]     = {0xE1, 0xFF, 2, XcpSlave::ADDR_EXT_TABLE, 1, 0, 0, 0};
+    command(xcp, freeDaq, sizeof(freeDaq));
+    command(xcp, allocDaq, sizeof(allocDaq));
+    command(xcp, allocOdt, sizeof(allocOdt));
+    command(xcp, allocEntry, sizeof(allocEntry));
+    command(xcp, setPtr, sizeof(setPtr));
+    command(xcp, write0, sizeof(write0));
+    command(xcp, write1, sizeof(write1));
+}
+
+static void test_reconfigure_after_free_daq(void)
+{
+    XcpSlave xcp(0x6E8, captureSend, VARS, 2, 1);
+    const uint8_t connect[] = {0xFF, 0};
+    command(xcp, connect, sizeof(connect));
+
+    for (int run = 0; run < 2; ++run) {
+        configure(xcp);
+        const uint8_t mode[]   = {0xE0, 0, 0, 0, 0, 0, 1, 0};
+        const uint8_t select[] = {0xDE, 2, 0, 0};
+        const uint8_t start[]  = {0xDD, 1};
+        const uint8_t stop[]   = {0xDD, 0};
+        command(xcp, mode, sizeof(mode));
+        command(xcp, select, sizeof(select));
+        command(xcp, start, sizeof(start));
+        TEST_ASSERT_TRUE(xcp.daqRunning());
+
+        lastLen = 0;
+        xcp.event(0, 0);
+        TEST_ASSERT_EQUAL(7, lastLen);  // PID + 4 + 2
+        TEST_ASSERT_EQUAL_HEX8(0x00, lastFrame[0]);
+        TEST_ASSERT_EQUAL_MEMORY(&counter, lastFrame + 1, 4);
+        TEST_ASSERT_EQUAL_MEMORY(&batch, lastFrame + 5, 2);
+
+        command(xcp, stop, sizeof(stop));
+        TEST_ASSERT_FALSE(xcp.daqRunning());
+    }
+}
+
+// A variable placed just below 4 GiB, addressed with extension 0 (a raw
+// address). Only ever resolved, never read: every upload below must fail.
+static const uintptr_t TOP_BASE = 0xFFFFFFF0u;
+static const XcpSlave::Variable TOP_VARS[] = {
+    {"top", reinterpret_cast<void *>(TOP_BASE), 8},
+};
+
+static void expectUploadDenied(XcpSlave &xcp, uint8_t n, uint32_t addr)
+{
+    const uint8_t upload[] = {0xF4, n, 0, 0, static_cast<uint8_t>(addr), static_cast<uint8_t>(addr >> 8),
+                              static_cast<uint8_t>(addr >> 16), static_cast<uint8_t>(addr >> 24)};
+    lastLen = 0;
+    xcp.onCommand(upload, sizeof(upload), 0);
+    TEST_ASSERT_EQUAL(2, lastLen);
+    TEST_ASSERT_EQUAL_HEX8(0xFE, lastFrame[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x24, lastFrame[1]);  // ERR_ACCESS_DENIED
+}
+
+static void test_short_upload_out_of_range_address(void)
+{
+    XcpSlave xcp(0x6E8, captureSend, TOP_VARS, 1, 1);
+    const uint8_t connect[] = {0xFF, 0};
+    command(xcp, connect, sizeof(connect));
+
+    expectUploadDenied(xcp, 1, TOP_BASE - 1);  // below the variable
+    expectUploadDenied(xcp, 1, TOP_BASE + 8);  // just past its end
+    expectUploadDenied(xcp, 4, TOP_BASE + 6);  // starts inside, ends outside
+}
+
+static void test_short_upload_wrapping_address(void)
+{
+    XcpSlave xcp(0x6E8, captureSend, TOP_VARS, 1, 1);
+    const uint8_t connect[] = {0xFF, 0};
+    command(xcp, connect, sizeof(connect));
+
+    // 0xFFFFFFFF + 1 wraps to 0 in 32 bits, which is below the variable's end.
+    expectUploadDenied(xcp, 1, 0xFFFFFFFFu);
+    expectUploadDenied(xcp, 7, 0xFFFFFFFCu);
+}
+
+static void test_alloc_entry_twice_is_refused(void)
+{
+    XcpSlave xcp(0x6E8, captureSend, VARS, 2, 1);
+    const uint8_t connect[] = {0xFF, 0};
+    command(xcp, connect, sizeof(connect));
+    configure(xcp);
+
+    const uint8_t allocEntry[] = {0xD3, 0, 0, 0, 0, 2};
+    xcp.onCommand(allocEntry, sizeof(allocEntry), 0);
+    TEST_ASSERT_EQUAL_HEX8(0xFE, lastFrame[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x22, lastFrame[1]);  // ERR_OUT_OF_RANGE: the ODT already has entries
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reconfigure_after_free_daq);
+    RUN_TEST(test_short_upload_out_of_range_address);
+    RUN_TEST(test_short_upload_wrapping_address);
+    RUN_TEST(test_alloc_entry_twice_is_refused);
+    return UNITY_END();
+}